@@ -12,7 +12,7 @@
 #ifdef XBIGENDIAN
 #define a3SwapEndian32(n) (n)
 #else
-#define a3SwapEndian32(n) (((n)>>24) | (((n) & 0x00ff0000) >> 8) | (((n) & 0x0000ff00) << 8) | ((n)<<24))
+#define a3SwapEndian32(n) ((((u32)(n))>>24) | (((u32)(n) & 0x00ff0000) >> 8) | (((u32)(n) & 0x0000ff00) << 8) | ((u32)(n)<<24))
 #endif
 #define a3Pack32(a, b, c, d) (((a)<<24) | ((b)<<16) | ((c)<<8) | ((d)<<0))
 #define a3ConsumeBits(n, p, b) (((n) & (((1 << (b)) - 1) << (p))) >> (p))
@@ -98,6 +98,7 @@ inline f32 ArcTan2f(f32 y, f32 x);
 inline f32 CopySignf(f32 a, f32 b);
 
 // v2, v3 and v4 data types are treated as basic types
+// NOTE(Zero): Members repeated across the anonymous structs are prefixed with `_`, only MSVC allows duplicate names
 struct v2
 {
 	union
@@ -115,8 +116,8 @@ struct v3
 		struct { f32 x, y, z; };
 		struct { f32 u, v, w; };
 		struct { f32 r, g, b; };
-		struct { v2 xy; f32 z; };
-		struct { f32 x; v2 yz; };
+		struct { v2 xy; f32 _z; };
+		struct { f32 _x; v2 yz; };
 		f32 values[3];
 	};
 };
@@ -128,9 +129,9 @@ struct v4
 		struct { f32 x, y, z, w; };
 		struct { f32 r, g, b, a; };
 		struct { v2 xy, zw; };
-		struct { v3 xyz; f32 w; };
-		struct { v3 rgb; f32 a; };
-		struct { f32 x; v3 yzw; };
+		struct { v3 xyz; f32 _w; };
+		struct { v3 rgb; f32 _a; };
+		struct { f32 _x; v3 yzw; };
 		f32 values[4];
 	};
 };
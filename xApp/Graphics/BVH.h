@@ -0,0 +1,1066 @@
+#pragma once
+#include "Common/Core.h"
+#include "Math/Math.h"
+#include "Platform/Platform.h"
+#include "Utility/AssetData.h"
+#include "Utility/Algorithm.h"
+#include "Utility/JobSystem.h"
+
+//
+// DECLARATIONS
+//
+
+// NOTE(Zero):
+// Maximum depth of the hierarchy, traversal uses a fixed size stack of this size
+// Builder stops splitting and creates leaves when this depth is reached
+#define A3BVHMAXDEPTH 64
+
+// NOTE(Zero): Refit hierarchies are rebuilt once their cost is this many times the cost they were built with
+#define A3_BVH_REBUILD_THRESHOLD 1.5f
+
+namespace a3 {
+
+	// NOTE(Zero):
+	// Node is 32 bytes so two nodes fit in a single cache line
+	// For interior nodes `Count` is 0 and `LeftFirst` is index of the left child,
+	// right child is always placed right after the left child i.e. `LeftFirst + 1`
+	// For leaf nodes `Count` is number of triangles and `LeftFirst` is the
+	// index of first triangle in `bvh::TriangleIndices`
+	struct bvh_node
+	{
+		v3 Min;
+		u32 LeftFirst;
+		v3 Max;
+		u32 Count;
+	};
+
+	// NOTE(Zero):
+	// Triangles packed for intersection tests as structure of arrays
+	// `E1` is `v1 - v0` and `E2` is `v2 - v0`, so the tests neither recompute the edges
+	// nor go through the vertex indices of the mesh
+	// Every array is aligned to 32 bytes and padded to a multiple of 8 triangles
+	struct triangle_block
+	{
+		f32* V0X;
+		f32* V0Y;
+		f32* V0Z;
+		f32* E1X;
+		f32* E1Y;
+		f32* E1Z;
+		f32* E2X;
+		f32* E2Y;
+		f32* E2Z;
+		void* Memory;
+		u32 NumOfTriangles;
+	};
+
+	// NOTE(Zero):
+	// Bounding volume hierarchy over triangles of a single mesh
+	// Mesh is not modified, `TriangleIndices` is the reordered list of triangle indices
+	// `Triangles` are stored in the same order as `TriangleIndices`, so leaves refer to a contiguous range in both
+	// Node at index 0 is always the root, children are always placed after their parent
+	// `BuildCost` is the cost of the hierarchy when it was built, see `ComputeBVHCost`
+	struct bvh
+	{
+		mesh* Mesh;
+		bvh_node* Nodes;
+		u32* TriangleIndices;
+		triangle_block Triangles;
+		u32 NumOfNodes;
+		u32 NumOfTriangles;
+		f32 BuildCost;
+	};
+
+	// NOTE(Zero):
+	// Filled by the builders when asked for, `BuildTime` is in seconds and `Cost` is `ComputeBVHCost` of the result
+	// Cheaper builds give higher costs, i.e. slower traversal
+	struct bvh_build_stats
+	{
+		f64 BuildTime;
+		f32 Cost;
+		u32 NumOfNodes;
+		u32 NumOfLeaves;
+		u32 MaxDepth;
+		u32 MaxLeafSize;
+		f32 AverageLeafSize;
+	};
+
+	// NOTE(Zero):
+	// Hierarchy of a mesh whose vertices move every frame while its triangles stay the same
+	// `Accel` is refit on every update, once its cost grows past `RebuildThreshold` times its `BuildCost` a new hierarchy
+	// is built on a separate thread from a copy of the vertices, and replaces `Accel` at the first update after it is done
+	// Only `Accel` should be used by the caller, rest belongs to the rebuild
+	struct dynamic_bvh
+	{
+		bvh Accel;
+		f32 RebuildThreshold;
+		f32 CostRatio;
+		u32 NumOfRefits;
+		u32 NumOfRebuilds;
+		bvh Pending;
+		mesh Snapshot;
+		thread_handle Thread;
+		volatile i32 Building;
+	};
+
+	// NOTE(Zero):
+	// Placement of a mesh in the scene, any number of instances can share the same hierarchy
+	// `Transform` takes the space of the mesh to world space and must be invertible,
+	// `InverseTransform` is computed by `BuildTLAS`
+	struct bvh_instance
+	{
+		const bvh* Accel;
+		m4x4 Transform;
+		m4x4 InverseTransform;
+	};
+
+	// NOTE(Zero):
+	// Top level hierarchy over the world space bounds of instances, leaves refer to `InstanceIndices` like the triangles
+	// of `bvh` and only have a single instance unless the maximum depth is reached
+	// `Instances` are a copy in the order they were given, which is the order of the indices reported by traversal
+	// Rays are moved to the space of an instance when they reach its leaf, so memory only grows with the unique meshes
+	struct tlas
+	{
+		bvh_node* Nodes;
+		u32* InstanceIndices;
+		bvh_instance* Instances;
+		u32 NumOfNodes;
+		u32 NumOfInstances;
+	};
+
+	// NOTE(Zero):
+	// Packs the triangles of the mesh in the given order, `order` can be null for the mesh order
+	// Returned block should be freed using `FreeTriangleBlock`
+	triangle_block BuildTriangleBlock(const mesh* meshObj, const u32* order, u32 numOfTriangles);
+	void FreeTriangleBlock(triangle_block* block);
+
+	// NOTE(Zero):
+	// Builds the hierarchy using Surface Area Heuristic by sweeping over sorted centroids in each axis
+	// Returned bvh should be freed using `FreeBVH`
+	bvh BuildBVH(mesh* meshObj, bvh_build_stats* stats = A3NULL);
+	void FreeBVH(bvh* accel);
+
+	// NOTE(Zero):
+	// Builds the hierarchy using Surface Area Heuristic evaluated at `A3_BVH_BINS` bins of the centroids in each axis
+	// Large nodes are binned in chunks by the job system and large subtrees are built as separate jobs,
+	// so it is much faster than `BuildBVH` for a slightly higher cost, `a3::Jobs` must be initialized
+	// Returned bvh should be freed using `FreeBVH`
+	bvh BuildBVHBinned(mesh* meshObj, bvh_build_stats* stats = A3NULL);
+
+	// NOTE(Zero):
+	// Expected cost of a ray through the hierarchy by Surface Area Heuristic, relative to its root box
+	// so it does not change when the whole mesh is moved or scaled
+	f32 ComputeBVHCost(const bvh* accel);
+
+	// NOTE(Zero):
+	// Updates the triangles and the node bounds bottom-up from the current vertices of `Mesh` in a single pass
+	// Triangles of the mesh must not change, returns the cost of the refit hierarchy
+	f32 RefitBVH(bvh* accel);
+
+	// NOTE(Zero):
+	// Call `UpdateDynamicBVH` after the vertices change, returns true if a rebuilt hierarchy replaced `Accel`
+	// `FreeDynamicBVH` waits for the rebuild in flight if any
+	dynamic_bvh CreateDynamicBVH(mesh* meshObj, f32 rebuildThreshold = A3_BVH_REBUILD_THRESHOLD);
+	b32 UpdateDynamicBVH(dynamic_bvh* dynamic);
+	void FreeDynamicBVH(dynamic_bvh* dynamic);
+
+	// NOTE(Zero):
+	// Builds the top level with the same heuristic, hierarchies of the instances must be built before and outlive it
+	// Returned tlas should be freed using `FreeTLAS`, which does not free the hierarchies of the instances
+	tlas BuildTLAS(const bvh_instance* instances, u32 numOfInstances);
+	void FreeTLAS(tlas* scene);
+
+	// NOTE(Zero):
+	// Slab test, `invDir` is component wise inverse of ray direction
+	// Returns true if the box is hit in range [0, tMax], `tEntry` is distance at which ray enters the box
+	inline b32 RayIntersectAABB(const v3& min, const v3& max, const v3& orig, const v3& invDir, f32 tMax, f32* tEntry);
+
+	// NOTE(Zero):
+	// Moves a ray to the space of an instance with its `InverseTransform`, direction is not normalized
+	// so distances along the ray are the same in both spaces
+	inline void TransformRay(const m4x4& transform, const v3& orig, const v3& dir, v3* localOrig, v3* localDir);
+
+}
+
+//
+// IMPLEMENTATION
+//
+
+#define A3_BVH_TRAVERSAL_COST 1.0f
+#define A3_BVH_INTERSECTION_COST 1.0f
+#define A3_BVH_MAX_LEAF_TRIANGLES 8
+
+// NOTE(Zero):
+// Binned builder splits nodes larger than `A3_BVH_BIN_CHUNK` triangles into chunks that are binned by separate jobs,
+// and builds both children of nodes larger than `A3_BVH_TASK_TRIANGLES` in parallel
+#define A3_BVH_BINS 16
+#define A3_BVH_BIN_CHUNK 16384
+#define A3_BVH_MAX_BIN_CHUNKS 64
+#define A3_BVH_TASK_TRIANGLES 4096
+
+// NOTE(Zero):
+// Same builder is used for triangles and instances, primitives are only seen through their bounds
+// `MaxLeafCount` is the largest leaf that is kept when splitting costs more, leaves of a single primitive are always kept
+struct a3_bvh_build
+{
+	a3::bvh_node* Nodes;
+	u32* Indices;
+	u32 NumOfNodes;
+	u32 MaxLeafCount;
+	v3* Centroids;
+	v3* TriangleMin;
+	v3* TriangleMax;
+	f32* LeftAreas;
+};
+
+static inline v3 a3_MinV3(const v3& a, const v3& b)
+{
+	return v3{ (a.x < b.x) ? a.x : b.x, (a.y < b.y) ? a.y : b.y, (a.z < b.z) ? a.z : b.z };
+}
+
+static inline v3 a3_MaxV3(const v3& a, const v3& b)
+{
+	return v3{ (a.x > b.x) ? a.x : b.x, (a.y > b.y) ? a.y : b.y, (a.z > b.z) ? a.z : b.z };
+}
+
+static inline f32 a3_AABBArea(const v3& min, const v3& max)
+{
+	v3 d = max - min;
+	return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+}
+
+static void a3_SortTrianglesOnAxis(a3_bvh_build* build, u32* indices, u32 count, i32 axis)
+{
+	v3* centroids = build->Centroids;
+	a3::Sort(indices, count, [centroids, axis](u32 a, u32 b) {
+		return centroids[a].values[axis] < centroids[b].values[axis];
+	});
+}
+
+static void a3_BuildBVHNode(a3_bvh_build* build, u32 nodeIndex, u32 first, u32 count, u32 depth)
+{
+	a3::bvh_node* node = build->Nodes + nodeIndex;
+	u32* indices = build->Indices + first;
+
+	v3 nodeMin = v3{ max_f32, max_f32, max_f32 };
+	v3 nodeMax = v3{ -max_f32, -max_f32, -max_f32 };
+	for (u32 i = 0; i < count; ++i)
+	{
+		nodeMin = a3_MinV3(nodeMin, build->TriangleMin[indices[i]]);
+		nodeMax = a3_MaxV3(nodeMax, build->TriangleMax[indices[i]]);
+	}
+	node->Min = nodeMin;
+	node->Max = nodeMax;
+	node->LeftFirst = first;
+	node->Count = count;
+
+	if (count == 1 || depth + 1 >= A3BVHMAXDEPTH) return;
+
+	// NOTE(Zero):
+	// For every axis, triangles are sorted by centroid and every split position is evaluated
+	// Left areas are accumulated in first sweep and the cost is evaluated in second sweep from right
+	f32 bestCost = max_f32;
+	i32 bestAxis = -1;
+	u32 bestSplit = 0;
+	for (i32 axis = 0; axis < 3; ++axis)
+	{
+		a3_SortTrianglesOnAxis(build, indices, count, axis);
+
+		v3 leftMin = v3{ max_f32, max_f32, max_f32 };
+		v3 leftMax = v3{ -max_f32, -max_f32, -max_f32 };
+		for (u32 i = 0; i < count; ++i)
+		{
+			leftMin = a3_MinV3(leftMin, build->TriangleMin[indices[i]]);
+			leftMax = a3_MaxV3(leftMax, build->TriangleMax[indices[i]]);
+			build->LeftAreas[i] = a3_AABBArea(leftMin, leftMax);
+		}
+
+		v3 rightMin = v3{ max_f32, max_f32, max_f32 };
+		v3 rightMax = v3{ -max_f32, -max_f32, -max_f32 };
+		for (u32 i = count - 1; i > 0; --i)
+		{
+			rightMin = a3_MinV3(rightMin, build->TriangleMin[indices[i]]);
+			rightMax = a3_MaxV3(rightMax, build->TriangleMax[indices[i]]);
+			f32 cost = build->LeftAreas[i - 1] * (f32)i + a3_AABBArea(rightMin, rightMax) * (f32)(count - i);
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = i;
+			}
+		}
+	}
+
+	f32 nodeArea = a3_AABBArea(nodeMin, nodeMax);
+	f32 splitCost = A3_BVH_TRAVERSAL_COST;
+	if (nodeArea > 0.0f) splitCost += A3_BVH_INTERSECTION_COST * bestCost / nodeArea;
+	f32 leafCost = A3_BVH_INTERSECTION_COST * (f32)count;
+	if (bestAxis < 0 || (splitCost >= leafCost && count <= build->MaxLeafCount))
+	{
+		return;
+	}
+
+	// NOTE(Zero): Triangles are still sorted on the last axis(z)
+	if (bestAxis != 2) a3_SortTrianglesOnAxis(build, indices, count, bestAxis);
+
+	u32 leftIndex = build->NumOfNodes;
+	build->NumOfNodes += 2;
+	node->LeftFirst = leftIndex;
+	node->Count = 0;
+
+	a3_BuildBVHNode(build, leftIndex, first, bestSplit, depth + 1);
+	a3_BuildBVHNode(build, leftIndex + 1, first + bestSplit, count - bestSplit, depth + 1);
+}
+
+// NOTE(Zero): Padding repeats the last triangle so that it never produces a new hit
+static void a3_FillTriangleBlock(a3::triangle_block* block, const a3::mesh* meshObj, const u32* order)
+{
+	u32 numOfTriangles = block->NumOfTriangles;
+	u32 stride = (numOfTriangles + 7) & ~7u;
+	v3* vertices = meshObj->Vertices;
+	u32* trisIndex = meshObj->VertexIndices;
+	for (u32 i = 0; i < stride; ++i)
+	{
+		u32 tri = (i < numOfTriangles) ? i : numOfTriangles - 1;
+		if (order) tri = order[tri];
+		const v3& v0 = vertices[trisIndex[tri * 3 + 0]];
+		v3 e1 = vertices[trisIndex[tri * 3 + 1]] - v0;
+		v3 e2 = vertices[trisIndex[tri * 3 + 2]] - v0;
+		block->V0X[i] = v0.x;
+		block->V0Y[i] = v0.y;
+		block->V0Z[i] = v0.z;
+		block->E1X[i] = e1.x;
+		block->E1Y[i] = e1.y;
+		block->E1Z[i] = e1.z;
+		block->E2X[i] = e2.x;
+		block->E2Y[i] = e2.y;
+		block->E2Z[i] = e2.z;
+	}
+}
+
+// NOTE(Zero): Same costs as the builder, summed over every node weighted by its area
+static f32 a3_ComputeNodeCost(const a3::bvh_node& node)
+{
+	f32 area = a3_AABBArea(node.Min, node.Max);
+	if (node.Count) return area * A3_BVH_INTERSECTION_COST * (f32)node.Count;
+	return area * A3_BVH_TRAVERSAL_COST;
+}
+
+static f32 a3_NormalizeCost(const a3::bvh_node& root, f32 cost)
+{
+	f32 rootArea = a3_AABBArea(root.Min, root.Max);
+	return (rootArea > 0.0f) ? cost / rootArea : 0.0f;
+}
+
+static u32 a3_RebuildBVHProc(void* userData)
+{
+	a3::dynamic_bvh* dynamic = (a3::dynamic_bvh*)userData;
+	dynamic->Pending = a3::BuildBVH(&dynamic->Snapshot);
+	a3::AtomicExchange(&dynamic->Building, false);
+	return 0;
+}
+
+
+// NOTE(Zero): Walks the finished hierarchy to fill everything except `BuildTime`
+static void a3_ComputeBuildStats(const a3::bvh* accel, f64 buildTime, a3::bvh_build_stats* stats)
+{
+	*stats = {};
+	stats->BuildTime = buildTime;
+	stats->Cost = a3::ComputeBVHCost(accel);
+	stats->NumOfNodes = accel->NumOfNodes;
+	if (!accel->NumOfNodes) return;
+
+	u32 stackNodes[A3BVHMAXDEPTH + 1];
+	u32 stackDepths[A3BVHMAXDEPTH + 1];
+	i32 stackSize = 0;
+	stackNodes[stackSize] = 0;
+	stackDepths[stackSize] = 0;
+	stackSize++;
+	while (stackSize)
+	{
+		stackSize--;
+		const a3::bvh_node* node = accel->Nodes + stackNodes[stackSize];
+		u32 depth = stackDepths[stackSize];
+		if (depth > stats->MaxDepth) stats->MaxDepth = depth;
+		if (node->Count)
+		{
+			stats->NumOfLeaves++;
+			if (node->Count > stats->MaxLeafSize) stats->MaxLeafSize = node->Count;
+		}
+		else
+		{
+			a3Assert(stackSize + 2 <= A3BVHMAXDEPTH + 1);
+			stackNodes[stackSize] = node->LeftFirst;
+			stackDepths[stackSize] = depth + 1;
+			stackSize++;
+			stackNodes[stackSize] = node->LeftFirst + 1;
+			stackDepths[stackSize] = depth + 1;
+			stackSize++;
+		}
+	}
+	stats->AverageLeafSize = (f32)accel->NumOfTriangles / (f32)stats->NumOfLeaves;
+}
+
+struct a3_bvh_bin
+{
+	v3 Min;
+	v3 Max;
+	u32 Count;
+};
+
+// NOTE(Zero): Bounds and bins of a contiguous range of the triangles of a node
+struct a3_bvh_chunk
+{
+	v3 Min;
+	v3 Max;
+	v3 CentroidMin;
+	v3 CentroidMax;
+	a3_bvh_bin Bins[3][A3_BVH_BINS];
+};
+
+// NOTE(Zero):
+// Shared by all the jobs of a binned build, `NumOfNodes` is incremented atomically by the subtrees being built
+// Nodes are still allocated in pairs after their parent, so refitting works the same as for `BuildBVH`
+struct a3_bvh_binned_build
+{
+	a3::bvh_node* Nodes;
+	u32* Indices;
+	v3* Centroids;
+	v3* TriangleMin;
+	v3* TriangleMax;
+	const a3::mesh* Mesh;
+	u32 NumOfTriangles;
+	volatile i32 NumOfNodes;
+};
+
+// NOTE(Zero): Range of triangles of a node being bounded or binned, `Chunks` has one entry per job
+struct a3_bvh_range
+{
+	a3_bvh_binned_build* Build;
+	const u32* Indices;
+	u32 Count;
+	u32 ChunkSize;
+	v3 CentroidMin;
+	v3 BinScale;
+	a3_bvh_chunk* Chunks;
+};
+
+struct a3_bvh_subtree
+{
+	a3_bvh_binned_build* Build;
+	u32 NodeIndex;
+	u32 First;
+	u32 Count;
+	u32 Depth;
+};
+
+static void a3_BoundTrianglesJob(void* userData, u32 chunkIndex, u32)
+{
+	a3_bvh_binned_build* build = (a3_bvh_binned_build*)userData;
+	u32 first = chunkIndex * A3_BVH_BIN_CHUNK;
+	u32 last = first + A3_BVH_BIN_CHUNK;
+	if (last > build->NumOfTriangles) last = build->NumOfTriangles;
+
+	v3* vertices = build->Mesh->Vertices;
+	u32* trisIndex = build->Mesh->VertexIndices;
+	for (u32 i = first; i < last; ++i)
+	{
+		const v3& v0 = vertices[trisIndex[i * 3 + 0]];
+		const v3& v1 = vertices[trisIndex[i * 3 + 1]];
+		const v3& v2 = vertices[trisIndex[i * 3 + 2]];
+		build->TriangleMin[i] = a3_MinV3(a3_MinV3(v0, v1), v2);
+		build->TriangleMax[i] = a3_MaxV3(a3_MaxV3(v0, v1), v2);
+		build->Centroids[i] = (v0 + v1 + v2) * (1.0f / 3.0f);
+		build->Indices[i] = i;
+	}
+}
+
+static void a3_BoundRangeJob(void* userData, u32 chunkIndex, u32)
+{
+	a3_bvh_range* range = (a3_bvh_range*)userData;
+	a3_bvh_binned_build* build = range->Build;
+	a3_bvh_chunk* chunk = range->Chunks + chunkIndex;
+	u32 first = chunkIndex * range->ChunkSize;
+	u32 last = first + range->ChunkSize;
+	if (last > range->Count) last = range->Count;
+
+	chunk->Min = v3{ max_f32, max_f32, max_f32 };
+	chunk->Max = v3{ -max_f32, -max_f32, -max_f32 };
+	chunk->CentroidMin = chunk->Min;
+	chunk->CentroidMax = chunk->Max;
+	for (u32 i = first; i < last; ++i)
+	{
+		u32 tri = range->Indices[i];
+		chunk->Min = a3_MinV3(chunk->Min, build->TriangleMin[tri]);
+		chunk->Max = a3_MaxV3(chunk->Max, build->TriangleMax[tri]);
+		chunk->CentroidMin = a3_MinV3(chunk->CentroidMin, build->Centroids[tri]);
+		chunk->CentroidMax = a3_MaxV3(chunk->CentroidMax, build->Centroids[tri]);
+	}
+}
+
+static inline u32 a3_BinOfCentroid(const a3_bvh_range* range, const v3& centroid, i32 axis)
+{
+	i32 bin = (i32)((centroid.values[axis] - range->CentroidMin.values[axis]) * range->BinScale.values[axis]);
+	if (bin < 0) bin = 0;
+	if (bin > A3_BVH_BINS - 1) bin = A3_BVH_BINS - 1;
+	return (u32)bin;
+}
+
+static void a3_BinRangeJob(void* userData, u32 chunkIndex, u32)
+{
+	a3_bvh_range* range = (a3_bvh_range*)userData;
+	a3_bvh_binned_build* build = range->Build;
+	a3_bvh_chunk* chunk = range->Chunks + chunkIndex;
+	u32 first = chunkIndex * range->ChunkSize;
+	u32 last = first + range->ChunkSize;
+	if (last > range->Count) last = range->Count;
+
+	for (i32 axis = 0; axis < 3; ++axis)
+	{
+		for (u32 b = 0; b < A3_BVH_BINS; ++b)
+		{
+			chunk->Bins[axis][b].Min = v3{ max_f32, max_f32, max_f32 };
+			chunk->Bins[axis][b].Max = v3{ -max_f32, -max_f32, -max_f32 };
+			chunk->Bins[axis][b].Count = 0;
+		}
+	}
+	for (u32 i = first; i < last; ++i)
+	{
+		u32 tri = range->Indices[i];
+		const v3& centroid = build->Centroids[tri];
+		for (i32 axis = 0; axis < 3; ++axis)
+		{
+			a3_bvh_bin* bin = chunk->Bins[axis] + a3_BinOfCentroid(range, centroid, axis);
+			bin->Min = a3_MinV3(bin->Min, build->TriangleMin[tri]);
+			bin->Max = a3_MaxV3(bin->Max, build->TriangleMax[tri]);
+			bin->Count++;
+		}
+	}
+}
+
+// NOTE(Zero): Runs `function` over the chunks of the range, on the calling thread alone when there is a single chunk
+static void a3_RunRangeJobs(a3_bvh_range* range, a3::job_function function, u32 numOfChunks, u32 threadIndex)
+{
+	if (numOfChunks == 1)
+	{
+		function(range, 0, threadIndex);
+		return;
+	}
+	a3::job_counter counter = {};
+	a3::Jobs.Dispatch(function, range, numOfChunks, &counter, threadIndex);
+	a3::Jobs.Wait(&counter, threadIndex);
+}
+
+// NOTE(Zero):
+// Sets the bounds of the node and finds the split of its triangles, which are partitioned in place
+// Returns the number of triangles that go to the left child, 0 if the node should be a leaf
+static u32 a3_SplitBinnedNode(a3_bvh_binned_build* build, a3::bvh_node* node, u32 first, u32 count, u32 depth, u32 threadIndex)
+{
+	u32* indices = build->Indices + first;
+
+	a3_bvh_chunk localChunk;
+	a3_bvh_range range;
+	range.Build = build;
+	range.Indices = indices;
+	range.Count = count;
+	range.Chunks = &localChunk;
+	u32 numOfChunks = 1;
+	range.ChunkSize = count;
+	if (count > A3_BVH_BIN_CHUNK)
+	{
+		numOfChunks = (count + A3_BVH_BIN_CHUNK - 1) / A3_BVH_BIN_CHUNK;
+		if (numOfChunks > A3_BVH_MAX_BIN_CHUNKS) numOfChunks = A3_BVH_MAX_BIN_CHUNKS;
+		range.ChunkSize = (count + numOfChunks - 1) / numOfChunks;
+		range.Chunks = a3Malloc(sizeof(a3_bvh_chunk) * numOfChunks, a3_bvh_chunk);
+	}
+
+	a3_RunRangeJobs(&range, a3_BoundRangeJob, numOfChunks, threadIndex);
+	v3 nodeMin = range.Chunks[0].Min;
+	v3 nodeMax = range.Chunks[0].Max;
+	v3 centroidMin = range.Chunks[0].CentroidMin;
+	v3 centroidMax = range.Chunks[0].CentroidMax;
+	for (u32 c = 1; c < numOfChunks; ++c)
+	{
+		nodeMin = a3_MinV3(nodeMin, range.Chunks[c].Min);
+		nodeMax = a3_MaxV3(nodeMax, range.Chunks[c].Max);
+		centroidMin = a3_MinV3(centroidMin, range.Chunks[c].CentroidMin);
+		centroidMax = a3_MaxV3(centroidMax, range.Chunks[c].CentroidMax);
+	}
+	node->Min = nodeMin;
+	node->Max = nodeMax;
+
+	u32 leftCount = 0;
+	if (count > 1 && depth + 1 < A3BVHMAXDEPTH)
+	{
+		// NOTE(Zero): Scale is slightly less than `A3_BVH_BINS / extent` so the largest centroid falls in the last bin
+		v3 extent = centroidMax - centroidMin;
+		range.CentroidMin = centroidMin;
+		for (i32 axis = 0; axis < 3; ++axis)
+		{
+			f32 e = extent.values[axis];
+			range.BinScale.values[axis] = (e > 0.0f) ? ((f32)A3_BVH_BINS * 0.9999f) / e : 0.0f;
+		}
+		a3_RunRangeJobs(&range, a3_BinRangeJob, numOfChunks, threadIndex);
+
+		// NOTE(Zero): Same sweeps as `a3_BuildBVHNode` but over the merged bins instead of every triangle
+		f32 bestCost = max_f32;
+		i32 bestAxis = -1;
+		u32 bestSplit = 0;
+		for (i32 axis = 0; axis < 3; ++axis)
+		{
+			if (extent.values[axis] <= 0.0f) continue;
+
+			a3_bvh_bin bins[A3_BVH_BINS];
+			for (u32 b = 0; b < A3_BVH_BINS; ++b)
+			{
+				bins[b] = range.Chunks[0].Bins[axis][b];
+				for (u32 c = 1; c < numOfChunks; ++c)
+				{
+					const a3_bvh_bin& other = range.Chunks[c].Bins[axis][b];
+					bins[b].Min = a3_MinV3(bins[b].Min, other.Min);
+					bins[b].Max = a3_MaxV3(bins[b].Max, other.Max);
+					bins[b].Count += other.Count;
+				}
+			}
+
+			f32 leftAreas[A3_BVH_BINS];
+			u32 leftCounts[A3_BVH_BINS];
+			v3 leftMin = v3{ max_f32, max_f32, max_f32 };
+			v3 leftMax = v3{ -max_f32, -max_f32, -max_f32 };
+			u32 leftSum = 0;
+			for (u32 b = 0; b < A3_BVH_BINS; ++b)
+			{
+				leftMin = a3_MinV3(leftMin, bins[b].Min);
+				leftMax = a3_MaxV3(leftMax, bins[b].Max);
+				leftSum += bins[b].Count;
+				leftAreas[b] = leftSum ? a3_AABBArea(leftMin, leftMax) : 0.0f;
+				leftCounts[b] = leftSum;
+			}
+
+			v3 rightMin = v3{ max_f32, max_f32, max_f32 };
+			v3 rightMax = v3{ -max_f32, -max_f32, -max_f32 };
+			u32 rightSum = 0;
+			for (u32 b = A3_BVH_BINS - 1; b > 0; --b)
+			{
+				rightMin = a3_MinV3(rightMin, bins[b].Min);
+				rightMax = a3_MaxV3(rightMax, bins[b].Max);
+				rightSum += bins[b].Count;
+				if (!rightSum || !leftCounts[b - 1]) continue;
+				f32 cost = leftAreas[b - 1] * (f32)leftCounts[b - 1] + a3_AABBArea(rightMin, rightMax) * (f32)rightSum;
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestSplit = b;
+				}
+			}
+		}
+
+		f32 nodeArea = a3_AABBArea(nodeMin, nodeMax);
+		f32 splitCost = A3_BVH_TRAVERSAL_COST;
+		if (nodeArea > 0.0f) splitCost += A3_BVH_INTERSECTION_COST * bestCost / nodeArea;
+		f32 leafCost = A3_BVH_INTERSECTION_COST * (f32)count;
+		if (bestAxis >= 0 && (splitCost < leafCost || count > A3_BVH_MAX_LEAF_TRIANGLES))
+		{
+			u32 left = 0;
+			u32 right = count;
+			while (left < right)
+			{
+				if (a3_BinOfCentroid(&range, build->Centroids[indices[left]], bestAxis) < bestSplit) left++;
+				else a3::Swap(&indices[left], &indices[--right]);
+			}
+			leftCount = left;
+		}
+		else if (bestAxis < 0 && count > A3_BVH_MAX_LEAF_TRIANGLES)
+		{
+			// NOTE(Zero): Every centroid is at the same point, any split is as good as another
+			leftCount = count / 2;
+		}
+	}
+
+	if (numOfChunks > 1) a3Free(range.Chunks);
+	return leftCount;
+}
+
+static void a3_BuildBinnedNode(a3_bvh_binned_build* build, u32 nodeIndex, u32 first, u32 count, u32 depth, u32 threadIndex);
+
+static void a3_BuildBinnedSubtreeJob(void* userData, u32, u32 threadIndex)
+{
+	a3_bvh_subtree* subtree = (a3_bvh_subtree*)userData;
+	a3_BuildBinnedNode(subtree->Build, subtree->NodeIndex, subtree->First, subtree->Count, subtree->Depth, threadIndex);
+}
+
+static void a3_BuildBinnedNode(a3_bvh_binned_build* build, u32 nodeIndex, u32 first, u32 count, u32 depth, u32 threadIndex)
+{
+	a3::bvh_node* node = build->Nodes + nodeIndex;
+	u32 leftCount = a3_SplitBinnedNode(build, node, first, count, depth, threadIndex);
+	if (!leftCount)
+	{
+		node->LeftFirst = first;
+		node->Count = count;
+		return;
+	}
+
+	u32 leftIndex = (u32)a3::AtomicAdd(&build->NumOfNodes, 2);
+	node->LeftFirst = leftIndex;
+	node->Count = 0;
+
+	// NOTE(Zero): Left subtree is left to the other threads while this one builds the right subtree
+	if (count > A3_BVH_TASK_TRIANGLES)
+	{
+		a3_bvh_subtree left = { build, leftIndex, first, leftCount, depth + 1 };
+		a3::job_counter counter = {};
+		a3::Jobs.Push(a3_BuildBinnedSubtreeJob, &left, 0, &counter, threadIndex);
+		a3_BuildBinnedNode(build, leftIndex + 1, first + leftCount, count - leftCount, depth + 1, threadIndex);
+		a3::Jobs.Wait(&counter, threadIndex);
+	}
+	else
+	{
+		a3_BuildBinnedNode(build, leftIndex, first, leftCount, depth + 1, threadIndex);
+		a3_BuildBinnedNode(build, leftIndex + 1, first + leftCount, count - leftCount, depth + 1, threadIndex);
+	}
+}
+
+namespace a3 {
+
+	bvh BuildBVH(mesh* meshObj, bvh_build_stats* stats)
+	{
+		f64 buildStart = Platform.GetTime();
+		bvh result = {};
+		result.Mesh = meshObj;
+		if (!meshObj || !meshObj->NumOfTriangles)
+		{
+			if (stats) *stats = {};
+			return result;
+		}
+
+		u32 numTris = meshObj->NumOfTriangles;
+		result.NumOfTriangles = numTris;
+		// NOTE(Zero): Binary tree with `n` leaves can never have more than `2n - 1` nodes
+		result.Nodes = a3Malloc(sizeof(bvh_node) * (2 * numTris - 1), bvh_node);
+		result.TriangleIndices = a3Malloc(sizeof(u32) * numTris, u32);
+
+		a3_bvh_build build;
+		build.Nodes = result.Nodes;
+		build.Indices = result.TriangleIndices;
+		build.NumOfNodes = 1;
+		build.MaxLeafCount = A3_BVH_MAX_LEAF_TRIANGLES;
+		build.Centroids = a3Malloc(sizeof(v3) * numTris, v3);
+		build.TriangleMin = a3Malloc(sizeof(v3) * numTris, v3);
+		build.TriangleMax = a3Malloc(sizeof(v3) * numTris, v3);
+		build.LeftAreas = a3Malloc(sizeof(f32) * numTris, f32);
+
+		v3* vertices = meshObj->Vertices;
+		u32* trisIndex = meshObj->VertexIndices;
+		for (u32 i = 0; i < numTris; ++i)
+		{
+			const v3& v0 = vertices[trisIndex[i * 3 + 0]];
+			const v3& v1 = vertices[trisIndex[i * 3 + 1]];
+			const v3& v2 = vertices[trisIndex[i * 3 + 2]];
+			build.TriangleMin[i] = a3_MinV3(a3_MinV3(v0, v1), v2);
+			build.TriangleMax[i] = a3_MaxV3(a3_MaxV3(v0, v1), v2);
+			build.Centroids[i] = (v0 + v1 + v2) * (1.0f / 3.0f);
+			result.TriangleIndices[i] = i;
+		}
+
+		a3_BuildBVHNode(&build, 0, 0, numTris, 0);
+		result.NumOfNodes = build.NumOfNodes;
+		result.Triangles = BuildTriangleBlock(meshObj, result.TriangleIndices, numTris);
+		result.BuildCost = ComputeBVHCost(&result);
+
+		a3Free(build.Centroids);
+		a3Free(build.TriangleMin);
+		a3Free(build.TriangleMax);
+		a3Free(build.LeftAreas);
+
+		if (stats) a3_ComputeBuildStats(&result, Platform.GetTime() - buildStart, stats);
+		return result;
+	}
+
+	bvh BuildBVHBinned(mesh* meshObj, bvh_build_stats* stats)
+	{
+		f64 buildStart = Platform.GetTime();
+		bvh result = {};
+		result.Mesh = meshObj;
+		if (!meshObj || !meshObj->NumOfTriangles)
+		{
+			if (stats) *stats = {};
+			return result;
+		}
+
+		u32 numTris = meshObj->NumOfTriangles;
+		result.NumOfTriangles = numTris;
+		result.Nodes = a3Malloc(sizeof(bvh_node) * (2 * numTris - 1), bvh_node);
+		result.TriangleIndices = a3Malloc(sizeof(u32) * numTris, u32);
+
+		a3_bvh_binned_build build;
+		build.Nodes = result.Nodes;
+		build.Indices = result.TriangleIndices;
+		build.Centroids = a3Malloc(sizeof(v3) * numTris, v3);
+		build.TriangleMin = a3Malloc(sizeof(v3) * numTris, v3);
+		build.TriangleMax = a3Malloc(sizeof(v3) * numTris, v3);
+		build.Mesh = meshObj;
+		build.NumOfTriangles = numTris;
+		build.NumOfNodes = 1;
+
+		job_counter counter = {};
+		Jobs.Dispatch(a3_BoundTrianglesJob, &build, (numTris + A3_BVH_BIN_CHUNK - 1) / A3_BVH_BIN_CHUNK, &counter);
+		Jobs.Wait(&counter);
+
+		a3_BuildBinnedNode(&build, 0, 0, numTris, 0, 0);
+		result.NumOfNodes = (u32)build.NumOfNodes;
+		result.Triangles = BuildTriangleBlock(meshObj, result.TriangleIndices, numTris);
+		result.BuildCost = ComputeBVHCost(&result);
+
+		a3Free(build.Centroids);
+		a3Free(build.TriangleMin);
+		a3Free(build.TriangleMax);
+
+		if (stats) a3_ComputeBuildStats(&result, Platform.GetTime() - buildStart, stats);
+		return result;
+	}
+
+	void FreeBVH(bvh* accel)
+	{
+		a3Free(accel->Nodes);
+		a3Free(accel->TriangleIndices);
+		FreeTriangleBlock(&accel->Triangles);
+		accel->Nodes = A3NULL;
+		accel->TriangleIndices = A3NULL;
+		accel->NumOfNodes = 0;
+		accel->NumOfTriangles = 0;
+	}
+
+	f32 ComputeBVHCost(const bvh* accel)
+	{
+		if (!accel->NumOfNodes) return 0.0f;
+		f32 cost = 0.0f;
+		for (u32 i = 0; i < accel->NumOfNodes; ++i) cost += a3_ComputeNodeCost(accel->Nodes[i]);
+		return a3_NormalizeCost(accel->Nodes[0], cost);
+	}
+
+	f32 RefitBVH(bvh* accel)
+	{
+		if (!accel->NumOfNodes) return 0.0f;
+
+		a3_FillTriangleBlock(&accel->Triangles, accel->Mesh, accel->TriangleIndices);
+
+		// NOTE(Zero): Children are always after their parent, so walking backwards visits them first
+		v3* vertices = accel->Mesh->Vertices;
+		u32* trisIndex = accel->Mesh->VertexIndices;
+		f32 cost = 0.0f;
+		for (u32 i = accel->NumOfNodes; i-- > 0;)
+		{
+			bvh_node* node = accel->Nodes + i;
+			if (node->Count)
+			{
+				v3 nodeMin = v3{ max_f32, max_f32, max_f32 };
+				v3 nodeMax = v3{ -max_f32, -max_f32, -max_f32 };
+				for (u32 t = node->LeftFirst; t < node->LeftFirst + node->Count; ++t)
+				{
+					u32 tri = accel->TriangleIndices[t];
+					for (u32 k = 0; k < 3; ++k)
+					{
+						const v3& v = vertices[trisIndex[tri * 3 + k]];
+						nodeMin = a3_MinV3(nodeMin, v);
+						nodeMax = a3_MaxV3(nodeMax, v);
+					}
+				}
+				node->Min = nodeMin;
+				node->Max = nodeMax;
+			}
+			else
+			{
+				const bvh_node& left = accel->Nodes[node->LeftFirst];
+				const bvh_node& right = accel->Nodes[node->LeftFirst + 1];
+				node->Min = a3_MinV3(left.Min, right.Min);
+				node->Max = a3_MaxV3(left.Max, right.Max);
+			}
+			cost += a3_ComputeNodeCost(*node);
+		}
+		return a3_NormalizeCost(accel->Nodes[0], cost);
+	}
+
+	dynamic_bvh CreateDynamicBVH(mesh* meshObj, f32 rebuildThreshold)
+	{
+		dynamic_bvh result = {};
+		result.Accel = BuildBVH(meshObj);
+		result.RebuildThreshold = rebuildThreshold;
+		result.CostRatio = 1.0f;
+		// NOTE(Zero): Rebuild reads its own copy of the vertices, the triangles are shared with the mesh
+		result.Snapshot = *meshObj;
+		result.Snapshot.Vertices = a3Malloc(sizeof(v3) * meshObj->NumOfVertices, v3);
+		return result;
+	}
+
+	b32 UpdateDynamicBVH(dynamic_bvh* dynamic)
+	{
+		b32 rebuilt = false;
+		if (dynamic->Thread && !AtomicLoad(&dynamic->Building))
+		{
+			Platform.WaitForThread(dynamic->Thread);
+			dynamic->Thread = A3NULL;
+			mesh* meshObj = dynamic->Accel.Mesh;
+			FreeBVH(&dynamic->Accel);
+			dynamic->Accel = dynamic->Pending;
+			dynamic->Accel.Mesh = meshObj;
+			dynamic->Pending = {};
+			dynamic->NumOfRebuilds++;
+			rebuilt = true;
+		}
+
+		// NOTE(Zero): Rebuilt hierarchy is also refit, vertices have moved since the copy was made
+		f32 cost = RefitBVH(&dynamic->Accel);
+		dynamic->NumOfRefits++;
+		dynamic->CostRatio = (dynamic->Accel.BuildCost > 0.0f) ? cost / dynamic->Accel.BuildCost : 1.0f;
+
+		if (!dynamic->Thread && dynamic->CostRatio > dynamic->RebuildThreshold)
+		{
+			mesh* meshObj = dynamic->Accel.Mesh;
+			a3::MemoryCopy(dynamic->Snapshot.Vertices, meshObj->Vertices, sizeof(v3) * meshObj->NumOfVertices);
+			AtomicExchange(&dynamic->Building, true);
+			dynamic->Thread = Platform.CreateThread(a3_RebuildBVHProc, dynamic);
+		}
+		return rebuilt;
+	}
+
+	void FreeDynamicBVH(dynamic_bvh* dynamic)
+	{
+		if (dynamic->Thread)
+		{
+			Platform.WaitForThread(dynamic->Thread);
+			FreeBVH(&dynamic->Pending);
+		}
+		FreeBVH(&dynamic->Accel);
+		a3Free(dynamic->Snapshot.Vertices);
+		*dynamic = {};
+	}
+
+	tlas BuildTLAS(const bvh_instance* instances, u32 numOfInstances)
+	{
+		tlas result = {};
+		if (!numOfInstances) return result;
+
+		result.NumOfInstances = numOfInstances;
+		result.Nodes = a3Malloc(sizeof(bvh_node) * (2 * numOfInstances - 1), bvh_node);
+		result.InstanceIndices = a3Malloc(sizeof(u32) * numOfInstances, u32);
+		result.Instances = a3Malloc(sizeof(bvh_instance) * numOfInstances, bvh_instance);
+
+		a3_bvh_build build;
+		build.Nodes = result.Nodes;
+		build.Indices = result.InstanceIndices;
+		build.NumOfNodes = 1;
+		build.MaxLeafCount = 1;
+		build.Centroids = a3Malloc(sizeof(v3) * numOfInstances, v3);
+		build.TriangleMin = a3Malloc(sizeof(v3) * numOfInstances, v3);
+		build.TriangleMax = a3Malloc(sizeof(v3) * numOfInstances, v3);
+		build.LeftAreas = a3Malloc(sizeof(f32) * numOfInstances, f32);
+
+		// NOTE(Zero): World bounds enclose the corners of the root box of each instance, empty ones are a point at their origin
+		for (u32 i = 0; i < numOfInstances; ++i)
+		{
+			bvh_instance* instance = result.Instances + i;
+			*instance = instances[i];
+			instance->InverseTransform = m4x4::Inverse(instance->Transform);
+			result.InstanceIndices[i] = i;
+
+			const bvh* accel = instance->Accel;
+			v3 boxMin = v3{ 0.0f, 0.0f, 0.0f };
+			v3 boxMax = v3{ 0.0f, 0.0f, 0.0f };
+			if (accel && accel->NumOfNodes)
+			{
+				boxMin = accel->Nodes[0].Min;
+				boxMax = accel->Nodes[0].Max;
+			}
+			v3 worldMin = v3{ max_f32, max_f32, max_f32 };
+			v3 worldMax = v3{ -max_f32, -max_f32, -max_f32 };
+			for (u32 c = 0; c < 8; ++c)
+			{
+				v3 corner = v3{ (c & 1) ? boxMax.x : boxMin.x, (c & 2) ? boxMax.y : boxMin.y, (c & 4) ? boxMax.z : boxMin.z };
+				v3 world = (v4{ corner.x, corner.y, corner.z, 1.0f } * instance->Transform).xyz;
+				worldMin = a3_MinV3(worldMin, world);
+				worldMax = a3_MaxV3(worldMax, world);
+			}
+			build.TriangleMin[i] = worldMin;
+			build.TriangleMax[i] = worldMax;
+			build.Centroids[i] = (worldMin + worldMax) * 0.5f;
+		}
+
+		a3_BuildBVHNode(&build, 0, 0, numOfInstances, 0);
+		result.NumOfNodes = build.NumOfNodes;
+
+		a3Free(build.Centroids);
+		a3Free(build.TriangleMin);
+		a3Free(build.TriangleMax);
+		a3Free(build.LeftAreas);
+
+		return result;
+	}
+
+	void FreeTLAS(tlas* scene)
+	{
+		a3Free(scene->Nodes);
+		a3Free(scene->InstanceIndices);
+		a3Free(scene->Instances);
+		*scene = {};
+	}
+
+	triangle_block BuildTriangleBlock(const mesh* meshObj, const u32* order, u32 numOfTriangles)
+	{
+		triangle_block result = {};
+		if (!numOfTriangles) return result;
+
+		// NOTE(Zero): Allocator does not guarantee 32 byte alignment, so the block is aligned by hand
+		u64 stride = (u64)((numOfTriangles + 7) & ~7u);
+		result.Memory = a3Malloc(sizeof(f32) * stride * 9 + 31, void);
+		f32* arrays = (f32*)(((u64)result.Memory + 31) & ~(u64)31);
+		result.V0X = arrays + stride * 0;
+		result.V0Y = arrays + stride * 1;
+		result.V0Z = arrays + stride * 2;
+		result.E1X = arrays + stride * 3;
+		result.E1Y = arrays + stride * 4;
+		result.E1Z = arrays + stride * 5;
+		result.E2X = arrays + stride * 6;
+		result.E2Y = arrays + stride * 7;
+		result.E2Z = arrays + stride * 8;
+		result.NumOfTriangles = numOfTriangles;
+		a3_FillTriangleBlock(&result, meshObj, order);
+		return result;
+	}
+
+	void FreeTriangleBlock(triangle_block* block)
+	{
+		a3Free(block->Memory);
+		*block = {};
+	}
+
+	inline b32 RayIntersectAABB(const v3& min, const v3& max, const v3& orig, const v3& invDir, f32 tMax, f32* tEntry)
+	{
+		f32 t0 = (min.x - orig.x) * invDir.x;
+		f32 t1 = (max.x - orig.x) * invDir.x;
+		f32 tNear = (t0 < t1) ? t0 : t1;
+		f32 tFar = (t0 < t1) ? t1 : t0;
+
+		t0 = (min.y - orig.y) * invDir.y;
+		t1 = (max.y - orig.y) * invDir.y;
+		if (t0 > t1) a3::Swap(&t0, &t1);
+		if (t0 > tNear) tNear = t0;
+		if (t1 < tFar) tFar = t1;
+
+		t0 = (min.z - orig.z) * invDir.z;
+		t1 = (max.z - orig.z) * invDir.z;
+		if (t0 > t1) a3::Swap(&t0, &t1);
+		if (t0 > tNear) tNear = t0;
+		if (t1 < tFar) tFar = t1;
+
+		*tEntry = tNear;
+		return (tFar >= tNear) && (tFar >= 0.0f) && (tNear <= tMax);
+	}
+
+	inline void TransformRay(const m4x4& transform, const v3& orig, const v3& dir, v3* localOrig, v3* localDir)
+	{
+		*localOrig = (v4{ orig.x, orig.y, orig.z, 1.0f } * transform).xyz;
+		*localDir = (v4{ dir.x, dir.y, dir.z, 0.0f } * transform).xyz;
+	}
+
+}
@@ -0,0 +1,306 @@
+#pragma once
+#include "Common/Core.h"
+#include "Math/Math.h"
+#include "Platform/Platform.h"
+#include "Utility/AssetData.h"
+#include "Graphics/BVH.h"
+
+#include <emmintrin.h>
+
+//
+// DECLARATIONS
+//
+
+// NOTE(Zero):
+// Traversal stack of the 4 wide hierarchy, every visited node pushes at most 3 more entries than it pops
+#define A3BVH4STACKSIZE (3 * A3BVHMAXDEPTH + 1)
+
+// NOTE(Zero):
+// Binary subtrees with at most this many triangles become a single leaf, their triangles are already contiguous
+// Box tests of a wide node cost about as much as a few triangles, so fewer and larger leaves are faster
+#define A3_BVH4_MAX_LEAF_TRIANGLES 4
+
+namespace a3 {
+
+	// NOTE(Zero):
+	// Node of the 4 wide hierarchy, 64 bytes so that every node is a single cache line
+	// Boxes of the children are quantized to 8 bits in a grid over the box of the node,
+	// minimum of child `c` on `axis` is `Origin[axis] + QMin[axis][c] * 2^Exponent[axis]`
+	// Steps of the grid are powers of 2, so decoding is exact and the decoded boxes always enclose the children
+	// Children are stored as structure of arrays so the boxes of all of them are tested at once
+	// Only the first `NumOfChildren` children are used, for leaf children `Count` is the number of triangles
+	// and `Child` is the index of first triangle in `bvh4::TriangleIndices`, otherwise `Count` is 0 and `Child` is the node
+	struct bvh4_node
+	{
+		v3 Origin;
+		i8 Exponent[3];
+		u8 NumOfChildren;
+		u8 QMin[3][4];
+		u8 QMax[3][4];
+		u32 Child[4];
+		u16 Count[4];
+	};
+
+	// NOTE(Zero):
+	// Binary hierarchy collapsed to 4 children per node, triangles are in the same order as the binary one
+	// Node at index 0 is always the root, nodes are aligned to cache lines and `NodeMemory` is what was allocated
+	struct bvh4
+	{
+		mesh* Mesh;
+		bvh4_node* Nodes;
+		void* NodeMemory;
+		u32* TriangleIndices;
+		triangle_block Triangles;
+		u32 NumOfNodes;
+		u32 NumOfTriangles;
+	};
+
+	// NOTE(Zero):
+	// Collapses the binary hierarchy by repeatedly opening the largest interior child until a node has 4 children,
+	// small subtrees are merged into leaves (see `A3_BVH4_MAX_LEAF_TRIANGLES`), result has its own copy of the triangles, so `accel` can be freed after the collapse
+	// Returned bvh4 should be freed using `FreeBVH4`
+	bvh4 BuildBVH4(const bvh* accel);
+	void FreeBVH4(bvh4* accel);
+
+	// NOTE(Zero):
+	// Decoded boxes of all the children, `min[axis][child]` and `max[axis][child]`, same arithmetic as the traversal
+	inline void DecodeChildBounds(const bvh4_node& node, f32 min[3][4], f32 max[3][4]);
+
+	// NOTE(Zero):
+	// Slab test of a single ray against all the children of the node at once
+	// Returns mask of the children hit in range [0, tMax], `tEntries` are the entry distances of every child
+	inline u32 RayIntersectChildren(const bvh4_node& node, const v3& orig, const v3& invDir, f32 tMax, f32* tEntries);
+
+}
+
+//
+// IMPLEMENTATION
+//
+
+static inline f32 a3_QuantizeStep(i8 exponent)
+{
+	u32 bits = (u32)(exponent + 127) << 23;
+	f32 result;
+	a3::MemoryCopy(&result, &bits, sizeof(result));
+	return result;
+}
+
+// NOTE(Zero):
+// Smallest power of 2 for which 255 steps cover `extent`, enlarged slightly since
+// `extent` is itself rounded, smallest normal float is the lower limit
+static i8 a3_QuantizeExponent(f32 extent)
+{
+	f32 step = extent * (1.0f / 255.0f) * 1.0001f;
+	u32 bits;
+	a3::MemoryCopy(&bits, &step, sizeof(bits));
+	i32 exponent = (i32)((bits >> 23) & 0xff) - 127;
+	if (bits & 0x7fffff) exponent++;
+	if (exponent < -126) exponent = -126;
+	return (i8)exponent;
+}
+
+// NOTE(Zero): Triangles under each binary node, `first` and `count` of the range in `bvh::TriangleIndices`
+struct a3_bvh4_collapse
+{
+	const a3::bvh_node* Nodes;
+	u32* First;
+	u32* Count;
+};
+
+static inline b32 a3_IsCollapsedLeaf(const a3_bvh4_collapse* collapse, u32 binaryIndex)
+{
+	return collapse->Nodes[binaryIndex].Count || collapse->Count[binaryIndex] <= A3_BVH4_MAX_LEAF_TRIANGLES;
+}
+
+static void a3_CollapseBVHNode(const a3_bvh4_collapse* collapse, a3::bvh4* wide, u32 wideIndex, u32 binaryIndex)
+{
+	const a3::bvh_node* nodes = collapse->Nodes;
+	const a3::bvh_node& binary = nodes[binaryIndex];
+
+	u32 children[4];
+	u32 numOfChildren = 0;
+	if (a3_IsCollapsedLeaf(collapse, binaryIndex))
+	{
+		// NOTE(Zero): Only happens when the whole hierarchy fits in a single leaf
+		children[numOfChildren++] = binaryIndex;
+	}
+	else
+	{
+		children[numOfChildren++] = binary.LeftFirst;
+		children[numOfChildren++] = binary.LeftFirst + 1;
+		while (numOfChildren < 4)
+		{
+			i32 largest = -1;
+			f32 largestArea = -1.0f;
+			for (u32 c = 0; c < numOfChildren; ++c)
+			{
+				const a3::bvh_node& child = nodes[children[c]];
+				if (a3_IsCollapsedLeaf(collapse, children[c])) continue;
+				f32 area = a3_AABBArea(child.Min, child.Max);
+				if (area > largestArea)
+				{
+					largestArea = area;
+					largest = (i32)c;
+				}
+			}
+			if (largest < 0) break;
+			u32 opened = children[largest];
+			children[largest] = nodes[opened].LeftFirst;
+			children[numOfChildren++] = nodes[opened].LeftFirst + 1;
+		}
+	}
+
+	a3::bvh4_node* node = wide->Nodes + wideIndex;
+	*node = {};
+	node->Origin = binary.Min;
+	node->NumOfChildren = (u8)numOfChildren;
+	for (i32 axis = 0; axis < 3; ++axis)
+	{
+		node->Exponent[axis] = a3_QuantizeExponent(binary.Max.values[axis] - binary.Min.values[axis]);
+	}
+
+	for (u32 c = 0; c < numOfChildren; ++c)
+	{
+		const a3::bvh_node& child = nodes[children[c]];
+		for (i32 axis = 0; axis < 3; ++axis)
+		{
+			f32 origin = node->Origin.values[axis];
+			f32 step = a3_QuantizeStep(node->Exponent[axis]);
+			f32 invStep = 1.0f / step;
+
+			// NOTE(Zero): Rounded outwards, then moved until the decoded box encloses the child
+			i32 qmin = (i32)Floorf((child.Min.values[axis] - origin) * invStep);
+			i32 qmax = (i32)Ceilf((child.Max.values[axis] - origin) * invStep);
+			qmin = (qmin < 0) ? 0 : ((qmin > 255) ? 255 : qmin);
+			qmax = (qmax < 0) ? 0 : ((qmax > 255) ? 255 : qmax);
+			while (qmin > 0 && origin + (f32)qmin * step > child.Min.values[axis]) qmin--;
+			while (qmax < 255 && origin + (f32)qmax * step < child.Max.values[axis]) qmax++;
+			a3Assert(origin + (f32)qmin * step <= child.Min.values[axis]);
+			a3Assert(origin + (f32)qmax * step >= child.Max.values[axis]);
+			node->QMin[axis][c] = (u8)qmin;
+			node->QMax[axis][c] = (u8)qmax;
+		}
+
+		if (a3_IsCollapsedLeaf(collapse, children[c]))
+		{
+			a3Assert(collapse->Count[children[c]] <= 0xffff);
+			node->Child[c] = collapse->First[children[c]];
+			node->Count[c] = (u16)collapse->Count[children[c]];
+		}
+		else
+		{
+			node->Child[c] = wide->NumOfNodes++;
+			node->Count[c] = 0;
+		}
+	}
+
+	for (u32 c = 0; c < numOfChildren; ++c)
+	{
+		if (!wide->Nodes[wideIndex].Count[c]) a3_CollapseBVHNode(collapse, wide, wide->Nodes[wideIndex].Child[c], children[c]);
+	}
+}
+
+// NOTE(Zero): Converts 4 quantized values to floats
+static inline __m128 a3_LoadQuantized4(const u8* q)
+{
+	u32 packed;
+	a3::MemoryCopy(&packed, q, sizeof(packed));
+	__m128i zero = _mm_setzero_si128();
+	__m128i bytes = _mm_cvtsi32_si128((i32)packed);
+	__m128i words = _mm_unpacklo_epi8(bytes, zero);
+	return _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero));
+}
+
+namespace a3 {
+
+	bvh4 BuildBVH4(const bvh* accel)
+	{
+		bvh4 result = {};
+		result.Mesh = accel->Mesh;
+		if (!accel->NumOfNodes) return result;
+
+		u32 numTris = accel->NumOfTriangles;
+		result.NumOfTriangles = numTris;
+		result.TriangleIndices = a3Malloc(sizeof(u32) * numTris, u32);
+		a3::MemoryCopy(result.TriangleIndices, accel->TriangleIndices, sizeof(u32) * numTris);
+		result.Triangles = BuildTriangleBlock(accel->Mesh, result.TriangleIndices, numTris);
+
+		// NOTE(Zero): Children are always after their parent, so walking backwards visits them first
+		a3_bvh4_collapse collapse;
+		collapse.Nodes = accel->Nodes;
+		collapse.First = a3Malloc(sizeof(u32) * accel->NumOfNodes, u32);
+		collapse.Count = a3Malloc(sizeof(u32) * accel->NumOfNodes, u32);
+		for (u32 i = accel->NumOfNodes; i-- > 0;)
+		{
+			const bvh_node& node = accel->Nodes[i];
+			if (node.Count)
+			{
+				collapse.First[i] = node.LeftFirst;
+				collapse.Count[i] = node.Count;
+			}
+			else
+			{
+				collapse.First[i] = collapse.First[node.LeftFirst];
+				collapse.Count[i] = collapse.Count[node.LeftFirst] + collapse.Count[node.LeftFirst + 1];
+			}
+		}
+
+		// NOTE(Zero): Every node except a single leaf root collapses at least one interior binary node
+		u32 maxNodes = (accel->NumOfNodes - 1) / 2 + 1;
+		// NOTE(Zero): Aligned by hand so that every node is a single cache line
+		result.NodeMemory = a3Malloc(sizeof(bvh4_node) * maxNodes + 63, void);
+		result.Nodes = (bvh4_node*)(((u64)result.NodeMemory + 63) & ~(u64)63);
+		result.NumOfNodes = 1;
+		a3_CollapseBVHNode(&collapse, &result, 0, 0);
+		a3Assert(result.NumOfNodes <= maxNodes);
+
+		a3Free(collapse.First);
+		a3Free(collapse.Count);
+
+		return result;
+	}
+
+	void FreeBVH4(bvh4* accel)
+	{
+		a3Free(accel->NodeMemory);
+		a3Free(accel->TriangleIndices);
+		FreeTriangleBlock(&accel->Triangles);
+		*accel = {};
+	}
+
+	inline void DecodeChildBounds(const bvh4_node& node, f32 min[3][4], f32 max[3][4])
+	{
+		for (i32 axis = 0; axis < 3; ++axis)
+		{
+			__m128 origin = _mm_set1_ps(node.Origin.values[axis]);
+			__m128 step = _mm_set1_ps(a3_QuantizeStep(node.Exponent[axis]));
+			_mm_storeu_ps(min[axis], _mm_add_ps(origin, _mm_mul_ps(a3_LoadQuantized4(node.QMin[axis]), step)));
+			_mm_storeu_ps(max[axis], _mm_add_ps(origin, _mm_mul_ps(a3_LoadQuantized4(node.QMax[axis]), step)));
+		}
+	}
+
+	inline u32 RayIntersectChildren(const bvh4_node& node, const v3& orig, const v3& invDir, f32 tMax, f32* tEntries)
+	{
+		__m128 tNear = _mm_set1_ps(-max_f32);
+		__m128 tFar = _mm_set1_ps(max_f32);
+		for (i32 axis = 0; axis < 3; ++axis)
+		{
+			__m128 origin = _mm_set1_ps(node.Origin.values[axis]);
+			__m128 step = _mm_set1_ps(a3_QuantizeStep(node.Exponent[axis]));
+			__m128 lo = _mm_add_ps(origin, _mm_mul_ps(a3_LoadQuantized4(node.QMin[axis]), step));
+			__m128 hi = _mm_add_ps(origin, _mm_mul_ps(a3_LoadQuantized4(node.QMax[axis]), step));
+			__m128 o = _mm_set1_ps(orig.values[axis]);
+			__m128 inv = _mm_set1_ps(invDir.values[axis]);
+			__m128 t0 = _mm_mul_ps(_mm_sub_ps(lo, o), inv);
+			__m128 t1 = _mm_mul_ps(_mm_sub_ps(hi, o), inv);
+			tNear = _mm_max_ps(tNear, _mm_min_ps(t0, t1));
+			tFar = _mm_min_ps(tFar, _mm_max_ps(t0, t1));
+		}
+		__m128 hit = _mm_cmpge_ps(tFar, tNear);
+		hit = _mm_and_ps(hit, _mm_cmpge_ps(tFar, _mm_setzero_ps()));
+		hit = _mm_and_ps(hit, _mm_cmple_ps(tNear, _mm_set1_ps(tMax)));
+		_mm_storeu_ps(tEntries, tNear);
+		return (u32)_mm_movemask_ps(hit) & ((1u << node.NumOfChildren) - 1);
+	}
+
+}
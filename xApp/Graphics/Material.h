@@ -0,0 +1,229 @@
+#pragma once
+#include "Common/Core.h"
+#include "Math/Math.h"
+
+//
+// DECLARATIONS
+//
+
+// NOTE(Zero):
+// Lower limit of `material::Roughness`, smoother surfaces make the density of the glossy lobe too large for f32
+#define A3_MATERIAL_MIN_ROUGHNESS 0.05f
+
+namespace a3 {
+
+	// NOTE(Zero):
+	// Surface description of the path tracer, sum of a Lambertian lobe and a GGX microfacet lobe
+	// `Albedo` is the reflectance of the diffuse lobe, `Specular` is the Fresnel reflectance of the glossy lobe at normal incidence
+	// `Roughness` is the perceptual roughness of the glossy lobe, alpha of GGX is its square
+	// `Emission` is the radiance leaving the front face (counter clockwise winding) of the surface
+	// Albedo + Specular should stay below 1 in every channel, lobes are not weighted against each other
+	struct material
+	{
+		v3 Albedo;
+		v3 Specular;
+		f32 Roughness;
+		v3 Emission;
+	};
+
+	material DiffuseMaterial(v3 albedo);
+	material GlossyMaterial(v3 specular, f32 roughness);
+	material EmissiveMaterial(v3 emission);
+
+	// NOTE(Zero):
+	// Random numbers of a single path, seeded by hashing the pixel and the sample so every path has its own sequence
+	// State is a single integer so paths traced by different threads never share anything
+	struct path_sampler
+	{
+		u32 State;
+	};
+
+	inline path_sampler CreatePathSampler(u32 pixelIndex, u32 sampleIndex);
+	// NOTE(Zero): Uniform in range [0, 1)
+	inline f32 NextSample(path_sampler* sampler);
+
+	inline f32 Luminance(v3 color);
+
+	// NOTE(Zero): Direction around `normal` with density cos(theta) / pi, `u1` and `u2` are uniform in [0, 1)
+	inline v3 SampleCosineHemisphere(v3 normal, f32 u1, f32 u2);
+
+	// NOTE(Zero):
+	// `wo` and `wi` point away from the surface, `normal` is on the side of `wo`
+	// Returns the value of the BSDF, `pdf` is the solid angle density with which `SampleMaterial` would return `wi`
+	v3 EvaluateMaterial(const material& mat, v3 normal, v3 wo, v3 wi, f32* pdf);
+
+	// NOTE(Zero):
+	// Picks one of the lobes by its reflectance and samples it, cosine distributed for the diffuse lobe
+	// and proportional to the GGX distribution of normals for the glossy lobe
+	// `weight` is BSDF * cos(theta) / pdf with the pdf of both lobes combined, returns false if no direction is sampled
+	b32 SampleMaterial(const material& mat, v3 normal, v3 wo, path_sampler* sampler, v3* wi, v3* weight, f32* pdf);
+
+}
+
+//
+// IMPLEMENTATION
+//
+
+// NOTE(Zero): Frame with `normal` as the z axis, from "Building an Orthonormal Basis, Revisited" (Duff et al.)
+static inline void a3_OrthonormalBasis(v3 normal, v3* tangent, v3* bitangent)
+{
+	f32 sign = CopySignf(1.0f, normal.z);
+	f32 a = -1.0f / (sign + normal.z);
+	f32 b = normal.x * normal.y * a;
+	*tangent = v3{ 1.0f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x };
+	*bitangent = v3{ b, sign + normal.y * normal.y * a, -normal.y };
+}
+
+static inline u32 a3_HashU32(u32 x)
+{
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+static inline f32 a3_MaterialSpecularProbability(const a3::material& mat)
+{
+	f32 diffuse = a3::Luminance(mat.Albedo);
+	f32 specular = a3::Luminance(mat.Specular);
+	if (diffuse + specular <= 0.0f) return 0.0f;
+	return specular / (diffuse + specular);
+}
+
+static inline f32 a3_GGXDistribution(f32 cosH, f32 alpha2)
+{
+	f32 d = cosH * cosH * (alpha2 - 1.0f) + 1.0f;
+	return alpha2 / (a3Pi32 * d * d);
+}
+
+// NOTE(Zero): Smith masking of a single direction, the masking of both directions is the product
+static inline f32 a3_GGXMasking(f32 cosV, f32 alpha2)
+{
+	return 2.0f * cosV / (cosV + Sqrtf(alpha2 + (1.0f - alpha2) * cosV * cosV));
+}
+
+namespace a3 {
+
+	material DiffuseMaterial(v3 albedo)
+	{
+		material result = {};
+		result.Albedo = albedo;
+		result.Roughness = 1.0f;
+		return result;
+	}
+
+	material GlossyMaterial(v3 specular, f32 roughness)
+	{
+		material result = {};
+		result.Specular = specular;
+		result.Roughness = roughness;
+		return result;
+	}
+
+	material EmissiveMaterial(v3 emission)
+	{
+		material result = {};
+		result.Roughness = 1.0f;
+		result.Emission = emission;
+		return result;
+	}
+
+	inline path_sampler CreatePathSampler(u32 pixelIndex, u32 sampleIndex)
+	{
+		path_sampler result;
+		result.State = a3_HashU32(pixelIndex ^ a3_HashU32(sampleIndex + 0x9e3779b9u));
+		return result;
+	}
+
+	// NOTE(Zero): PCG hash of a linear congruential sequence, top 24 bits are converted so the result is never 1
+	inline f32 NextSample(path_sampler* sampler)
+	{
+		sampler->State = sampler->State * 747796405u + 2891336453u;
+		u32 word = ((sampler->State >> ((sampler->State >> 28u) + 4u)) ^ sampler->State) * 277803737u;
+		word = (word >> 22u) ^ word;
+		return (f32)(word >> 8) * (1.0f / 16777216.0f);
+	}
+
+	inline f32 Luminance(v3 color)
+	{
+		return 0.2126f * color.r + 0.7152f * color.g + 0.0722f * color.b;
+	}
+
+	inline v3 SampleCosineHemisphere(v3 normal, f32 u1, f32 u2)
+	{
+		v3 tangent, bitangent;
+		a3_OrthonormalBasis(normal, &tangent, &bitangent);
+		f32 r = Sqrtf(u1);
+		f32 phi = 2.0f * a3Pi32 * u2;
+		f32 z = Sqrtf(1.0f - u1 > 0.0f ? 1.0f - u1 : 0.0f);
+		return tangent * (r * Cosf(phi)) + bitangent * (r * Sinf(phi)) + normal * z;
+	}
+
+	v3 EvaluateMaterial(const material& mat, v3 normal, v3 wo, v3 wi, f32* pdf)
+	{
+		*pdf = 0.0f;
+		f32 cosO = Dot(normal, wo);
+		f32 cosI = Dot(normal, wi);
+		if (cosO <= 0.0f || cosI <= 0.0f) return v3{ 0.0f, 0.0f, 0.0f };
+
+		f32 specularProbability = a3_MaterialSpecularProbability(mat);
+		v3 result = mat.Albedo * (1.0f / a3Pi32);
+		*pdf = (1.0f - specularProbability) * cosI / a3Pi32;
+
+		if (specularProbability > 0.0f)
+		{
+			f32 roughness = mat.Roughness > A3_MATERIAL_MIN_ROUGHNESS ? mat.Roughness : A3_MATERIAL_MIN_ROUGHNESS;
+			f32 alpha2 = roughness * roughness * roughness * roughness;
+			v3 half = Normalize(wo + wi);
+			f32 cosH = Dot(normal, half);
+			f32 cosOH = Dot(wo, half);
+			if (cosH > 0.0f && cosOH > 0.0f)
+			{
+				f32 d = a3_GGXDistribution(cosH, alpha2);
+				f32 g = a3_GGXMasking(cosO, alpha2) * a3_GGXMasking(cosI, alpha2);
+				f32 schlick = 1.0f - cosOH;
+				f32 schlick5 = schlick * schlick * schlick * schlick * schlick;
+				v3 fresnel = mat.Specular + (v3{ 1.0f, 1.0f, 1.0f } - mat.Specular) * schlick5;
+				result += fresnel * (d * g / (4.0f * cosO * cosI));
+				*pdf += specularProbability * d * cosH / (4.0f * cosOH);
+			}
+		}
+
+		return result;
+	}
+
+	b32 SampleMaterial(const material& mat, v3 normal, v3 wo, path_sampler* sampler, v3* wi, v3* weight, f32* pdf)
+	{
+		if (Luminance(mat.Albedo) + Luminance(mat.Specular) <= 0.0f) return false;
+
+		f32 lobe = NextSample(sampler);
+		f32 u1 = NextSample(sampler);
+		f32 u2 = NextSample(sampler);
+		if (lobe < a3_MaterialSpecularProbability(mat))
+		{
+			// NOTE(Zero): Half vector is sampled with density D(h) * cos(theta_h), direction is `wo` reflected about it
+			f32 roughness = mat.Roughness > A3_MATERIAL_MIN_ROUGHNESS ? mat.Roughness : A3_MATERIAL_MIN_ROUGHNESS;
+			f32 alpha2 = roughness * roughness * roughness * roughness;
+			f32 cosTheta2 = (1.0f - u1) / (1.0f + (alpha2 - 1.0f) * u1);
+			f32 cosTheta = Sqrtf(cosTheta2);
+			f32 sinTheta = Sqrtf(1.0f - cosTheta2 > 0.0f ? 1.0f - cosTheta2 : 0.0f);
+			f32 phi = 2.0f * a3Pi32 * u2;
+			v3 tangent, bitangent;
+			a3_OrthonormalBasis(normal, &tangent, &bitangent);
+			v3 half = tangent * (sinTheta * Cosf(phi)) + bitangent * (sinTheta * Sinf(phi)) + normal * cosTheta;
+			*wi = half * (2.0f * Dot(wo, half)) - wo;
+		}
+		else
+		{
+			*wi = SampleCosineHemisphere(normal, u1, u2);
+		}
+
+		v3 value = EvaluateMaterial(mat, normal, wo, *wi, pdf);
+		if (*pdf <= 0.0f) return false;
+		*weight = value * (Dot(normal, *wi) / *pdf);
+		return true;
+	}
+
+}
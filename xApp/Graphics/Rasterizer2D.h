@@ -1,6 +1,7 @@
 #pragma once
 #include "Common/Core.h"
 #include "Utility/AssetData.h"
+#include "Graphics/Texture.h"
 #include "Math/Math.h"
 #include "Utility/Algorithm.h"
 
@@ -20,6 +21,8 @@ namespace a3 {
 	// NOTE(Zero): Take alpha into consideration if `alpha` is true
 	void CopyImageBuffer(a3::image* dest, a3::image* src, const rect& destRect, const rect& srcRect, b32 alpha = false);
 	void CopyImageBuffer(a3::image* dest, a3::image* src, const rect& destRect, b32 alpha = false);
+	// NOTE(Zero): Scales the whole texture to `destRect`, filtered from the levels matching the scale
+	void CopyImageBuffer(a3::image* dest, const a3::texture* src, const rect& destRect, b32 alpha = false);
 
 	void SetPixel(a3::image* img, i32 x, i32 y, u32 color);
 	void SetRangedPixel(a3::image* img, i32 x, i32 y, u32 color);
@@ -157,6 +160,39 @@ namespace a3 {
 		a3::CopyImageBuffer(dest, src, destRect, rect{ 0, 0, src->Width, src->Height }, alpha);
 	}
 
+	void CopyImageBuffer(a3::image * dest, const a3::texture * src, const rect& destRect, b32 alpha)
+	{
+		a3Assert(destRect.x >= 0 && destRect.y >= 0);
+		a3Assert(destRect.x + destRect.w <= dest->Width && destRect.y + destRect.h <= dest->Height);
+
+		f32 du = 1.0f / (f32)destRect.w;
+		f32 dv = 1.0f / (f32)destRect.h;
+		f32 level = a3::QueryTextureLevel(src, v2{ du, 0.0f }, v2{ 0.0f, dv });
+		i32 mx = destRect.x + destRect.w;
+		i32 my = destRect.y + destRect.h;
+		u32* destPixels = (u32*)dest->Pixels;
+
+		for (i32 y = destRect.y; y < my; ++y)
+		{
+			for (i32 x = destRect.x; x < mx; ++x)
+			{
+				v2 uv = v2{ ((f32)(x - destRect.x) + 0.5f) * du, ((f32)(y - destRect.y) + 0.5f) * dv };
+				u32 srcPixel = a3::SampleTextureTrilinear(src, uv, level);
+				if (alpha)
+				{
+					const v4& srcColor = a3MakeRGBAv4(srcPixel);
+					v4 destColor = a3MakeRGBAv4(destPixels[x + y * dest->Width]);
+					destColor = srcColor.a * srcColor + (1.0f - srcColor.a) * destColor;
+					destPixels[x + y * dest->Width] = a3Normalv4ToRGBA(destColor);
+				}
+				else
+				{
+					destPixels[x + y * dest->Width] = srcPixel;
+				}
+			}
+		}
+	}
+
 	void SetPixel(a3::image * img, i32 x, i32 y, u32 color)
 	{
 		a3Assert(x >= 0 && x < img->Width);
@@ -171,18 +207,19 @@ namespace a3 {
 			((u32*)img->Pixels)[index] = color;
 	}
 
+	// NOTE(Zero): Opaque colors are written as is, translucent ones are blended with the pixel by their alpha
 	void SetPixelColor(a3::image * img, f32 x, f32 y, const v4& color)
 	{
 		i32 px = (i32)x;
 		i32 py = (i32)y;
 
-		f32 bx = (x - (f32)px);
-		f32 by = (y - (f32)py);
-		bx = (bx > 0.5f) ? (1.0f - bx) : bx;
-		by = (by > 0.5f) ? (1.0f - by) : by;
-		f32 blend = 4.0f * bx * by;
+		if (color.a >= 1.0f)
+		{
+			a3::SetPixel(img, px, py, a3Normalv4ToRGBA(color));
+			return;
+		}
 		u32 hc = a3::GetPixel(img, px, py);
-		a3::SetPixel(img, px, py, a3Normalv4ToRGBA(a3::BlendColor(a3MakeRGBAv4(hc), color, blend)));
+		a3::SetPixel(img, px, py, a3Normalv4ToRGBA(a3::BlendColor(a3MakeRGBAv4(hc), color, color.a)));
 	}
 
 
@@ -356,7 +393,7 @@ namespace a3 {
 
 	}
 
-	void a3::ResterizeFontsToBuffer(font_atlas_info* i, void * buffer, i32 length, f32 scale, void * drawBuffer, RasterizeFontCallback callback, void* userData)
+	void ResterizeFontsToBuffer(font_atlas_info* i, void * buffer, i32 length, f32 scale, void * drawBuffer, RasterizeFontCallback callback, void* userData)
 	{
 		stbtt_fontinfo info;
 		stbtt_InitFont(&info, (u8*)buffer, stbtt_GetFontOffsetForIndex((u8*)buffer, 0));
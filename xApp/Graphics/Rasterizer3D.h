@@ -3,11 +3,60 @@
 #include "Math/Math.h"
 #include "Platform/Platform.h"
 #include "Utility/Algorithm.h"
+#include "Utility/JobSystem.h"
+#include "Graphics/Rasterizer2D.h"
+#include "Graphics/Texture.h"
+#include "Math/Color.h"
 
 //
 // DECLARATIONS
 //
 
+// NOTE(Zero):
+// Render works in two phases, first triangles are transformed, clipped and set up in chunks of
+// `A3_RASTER_CHUNK_SIZE` and each chunk bins its triangles into the screen tiles they overlap,
+// then every tile is rasterized by a separate job so its color and depth rows stay in cache
+// Chunks and bins are walked in order, the image does not depend on the number of threads
+#define A3_RASTER_TILE_SIZE 64
+#define A3_RASTER_CHUNK_SIZE 1024
+
+// NOTE(Zero):
+// Before triangles are set up every vertex of the mesh is transformed to clip space once, 4 vertices
+// at a time, by jobs of `A3_RASTER_VERTEX_BATCH` vertices; triangles gather their corners from there
+#define A3_RASTER_VERTEX_BATCH 4096
+
+// NOTE(Zero):
+// Triangles are only clipped if they cross the near/far planes or leave the guard band, which extends
+// `A3_RASTER_GUARD_BAND` pixels beyond each side of the frame buffer, otherwise the rasterizer scissors them
+// The range keeps edge functions of the snapped vertices in 32 bits when stepped inside of a block
+#define A3_RASTER_GUARD_BAND 4096.0f
+
+// NOTE(Zero):
+// Tiles are covered by blocks of `A3_RASTER_BLOCK_SIZE` pixels which are skipped or filled without
+// edge tests when they are completely outside or inside of a triangle, rest is tested 4 pixels at a time
+// Vertices are snapped to 1/16 of a pixel so shared edges are evaluated exactly the same for both triangles
+#define A3_RASTER_BLOCK_SIZE 8
+#define A3_RASTER_SUBPIXEL_BITS 4
+#define A3_RASTER_SUBPIXEL_STEPS (1 << A3_RASTER_SUBPIXEL_BITS)
+
+// NOTE(Zero):
+// With multisampling each pixel keeps `A3_RASTER_SAMPLE_COUNT` color and depth samples on a rotated grid,
+// coverage and depth are tested per sample but the color is shaded once per pixel at its center
+// Samples are at most `A3_RASTER_SAMPLE_SPREAD` subpixels away from the center on each axis,
+// every tile resolves its samples into the frame buffer when it is done
+#define A3_RASTER_SAMPLE_COUNT 4
+#define A3_RASTER_SAMPLE_SPREAD 6
+
+// NOTE(Zero):
+// Depth offset of the receivers when they are compared with a shadow map, in units of its reversed depth,
+// is the constant bias + slope bias * change of the depth of the receiver over a texel of the map, the slope term is
+// limited to `A3_RASTER_SHADOW_MAX_SLOPE_BIAS` so that surfaces seen edge on by the light still receive shadows
+// Spot lights fade out between the inner cone, `A3_RASTER_SPOT_INNER` of the angle of the light, and the edge
+#define A3_RASTER_SHADOW_BIAS 0.0005f
+#define A3_RASTER_SHADOW_SLOPE_BIAS 1.5f
+#define A3_RASTER_SHADOW_MAX_SLOPE_BIAS 0.05f
+#define A3_RASTER_SPOT_INNER 0.8f
+
 namespace a3 {
 
 	enum render_type
@@ -15,9 +64,109 @@ namespace a3 {
 		RenderTriangle,
 		RenderShade,
 		RenderShadeWithOutline,
-		RenderMapTexture
+		RenderMapTexture,
+		// NOTE(Zero): Only the depth buffer is written, pixels of the frame buffer are not touched and can be null
+		RenderDepth
+	};
+
+	// NOTE(Zero):
+	// Depth is stored reversed, 1 at the near plane and 0 at the far plane, so larger values are nearer
+	// Unorm 24 is kept in 32 bits like D24X8, it trades precision but not bandwidth, unorm 16 halves both
+	enum depth_format
+	{
+		DepthFloat32,
+		DepthUnorm24,
+		DepthUnorm16
+	};
+
+	// NOTE(Zero):
+	// Bounds of a mesh in its own space, computed once with `ComputeMeshBounds` and shared by its instances
+	// Sphere is centered at the center of the box and encloses every vertex
+	struct mesh_bounds
+	{
+		v3 Min;
+		v3 Max;
+		v3 Center;
+		f32 Radius;
+	};
+
+	// NOTE(Zero):
+	// A mesh drawn with its own model transform, `Texture` is used for `RenderMapTexture`
+	// and if it is null the texture of the swapchain is used instead
+	struct draw_instance
+	{
+		mesh* Mesh;
+		const texture* Texture;
+		mesh_bounds Bounds;
+		m4x4 Model;
+		v3 Shade;
+	};
+
+	// NOTE(Zero): Instances in the order they were added, `ResetDrawList` keeps the memory for the next frame
+	struct draw_list
+	{
+		draw_instance* Instances;
+		u32 NumOfInstances;
+		u32 Capacity;
+	};
+
+	enum light_type
+	{
+		LightDirectional,
+		LightSpot
+	};
+
+	// NOTE(Zero):
+	// `Direction` is the way the light travels, `Position` is only used by spot lights and `Angle` is the full
+	// angle of their cone in radians, `Ambient` is the fraction of the shade that is lit when facing away or in shadow
+	struct light
+	{
+		light_type Type;
+		v3 Position;
+		v3 Direction;
+		f32 Angle;
+		f32 Ambient;
 	};
 
+	// NOTE(Zero):
+	// Reversed depth of a `RenderDepth` pass from the view of a light, copied out by `swapchain::CopyShadowMap`
+	// `ViewProjection` takes world space to the clip space of the light, receivers are lit if their depth + `Bias`
+	// + `SlopeBias` * (change of their depth over a texel) is not farther than the map
+	struct shadow_map
+	{
+		f32* Depth;
+		i32 Width;
+		i32 Height;
+		m4x4 ViewProjection;
+		f32 Bias;
+		f32 SlopeBias;
+	};
+
+	// NOTE(Zero):
+	// Pixel stage of the rasterizer, internal to the swapchain but its shading functions are templates on it
+	// Depth is the stripped down path of `RenderDepth`, neither colors nor texture coordinates are interpolated
+	enum raster_shading
+	{
+		ShadingDepth,
+		ShadingFlat,
+		ShadingTexture
+	};
+
+	// NOTE(Zero): Map with the default biases, depth is allocated by the first `swapchain::CopyShadowMap`
+	shadow_map CreateShadowMap();
+	void FreeShadowMap(shadow_map* map);
+
+	mesh_bounds ComputeMeshBounds(const mesh* meshObj);
+	void AddDrawInstance(draw_list* list, mesh* meshObj, const mesh_bounds& bounds, const m4x4& model, const v3& shade = a3::color::White, const texture* tex = A3NULL);
+	void ResetDrawList(draw_list* list);
+	void FreeDrawList(draw_list* list);
+
+	struct swapchain;
+	// NOTE(Zero):
+	// Releases the buffers of the frame and the storage kept between frames, the frame buffer itself is not owned
+	// Swapchain needs `SetFrameBuffer` before it is used again
+	void FreeSwapchain(swapchain* chain);
+
 	struct swapchain
 	{
 	private:
@@ -25,23 +174,203 @@ namespace a3 {
 		m4x4 m_View;
 		rect m_Viewport;
 		mesh* m_Meshes;
-		image* m_Texture;
+		const texture* m_Texture;
 		image* m_FrameBuffer;
-		f32* m_DepthBuffer;
+		u8* m_DepthBuffer;
+		depth_format m_DepthFormat;
+		i32 m_DepthBytes;
 		b32 m_DrawNormals;
 
+		// NOTE(Zero): Samples of a pixel are consecutive, both arrays are in a single allocation
+		u32* m_SampleColor;
+		u8* m_SampleDepth;
+		b32 m_Multisample;
+
+		// NOTE(Zero): Both are owned by the caller and must stay alive until the last `Render` that uses them
+		const light* m_Light;
+		const shadow_map* m_ShadowMap;
+
 		struct polygon
 		{
 			v4 vertices[10];
 			v2 textureCoords[10];
 			i32 numVertices;
 		};
-		void ClipPolygonOnWAxis(polygon* face, b32 textures);
-		void ClipPolygonForAxis(polygon* face, i32 comp, b32 textures);
-		void ClipPolygon(polygon* face, b32 textures = false);
+		// NOTE(Zero): Texture coordinates are only clipped along with the vertices if `textures` is true
+		template <b32 textures> void ClipPolygonOnWAxis(polygon* face);
+		template <b32 textures> void ClipPolygonForAxis(polygon* face, i32 comp);
+		template <b32 textures> void ClipPolygon(polygon* face);
+
+		// NOTE(Zero): Outcodes of the clip space vertices, a bit is set for each plane the vertex is outside of
+		enum clip_outcode
+		{
+			ClipLeft = 0x01,
+			ClipRight = 0x02,
+			ClipBottom = 0x04,
+			ClipTop = 0x08,
+			ClipNear = 0x10,
+			ClipFar = 0x20,
+			ClipBehind = 0x40,
+			ClipGuardBand = 0x80,
+			ClipFrustum = 0x7f,
+			ClipRequired = ClipNear | ClipFar | ClipBehind | ClipGuardBand
+		};
+
+		// NOTE(Zero):
+		// Screen space triangle set up for half-space rasterization, vertices are snapped to the subpixel grid
+		// and ordered counter clockwise, edge `i` is opposite to vertex `i` and is positive inside,
+		// e = edgeA * (x - fixedX[i + 1]) + edgeB * (y - fixedY[i + 1]) in fixed point
+		// Depth (m_DepthScale / w + m_DepthBias) is the plane depth + depthDx * (x - vertices[0].x) + depthDy * (y - vertices[0].y),
+		// texture coordinates divided by w are planes of the same form, only set up for textured triangles
+		// Lit triangles also have planes of their position in the clip space of the light divided by w, the shadow
+		// map is sampled at their ratio, `ambient` and `diffuse` are the lighting of the triangle without shadows
+		// `shadowSlope` is how much the depth of the triangle in the shadow map changes over a texel of it
+		struct raster_triangle
+		{
+			v2 vertices[3];
+			v2 normal;
+			u32 color;
+			b32 degenerate;
+			f32 depthMax;
+			i32 fixedX[3];
+			i32 fixedY[3];
+			i32 edgeA[3];
+			i32 edgeB[3];
+			i32 edgeBias[3];
+			f32 depth;
+			f32 depthDx;
+			f32 depthDy;
+			v2 uv;
+			v2 uvDx;
+			v2 uvDy;
+			v4 light;
+			v4 lightDx;
+			v4 lightDy;
+			f32 ambient;
+			f32 diffuse;
+			f32 shadowSlope;
+		};
+
+		// NOTE(Zero):
+		// Mesh instance of the frame, its vertices start at `firstVertex` in the clip space arrays
+		// `textureObj` is null unless the instance is texture mapped, `depth` is only used for sorting
+		// `lit` instances are shaded by the light per pixel, otherwise lighting is baked in the color of the triangles
+		struct raster_draw
+		{
+			mesh* meshObj;
+			const texture* textureObj;
+			m4x4 model;
+			m4x4 mvp;
+			v3 shade;
+			b32 lit;
+			u32 firstVertex;
+			f32 depth;
+		};
+
+		// NOTE(Zero): Vertices of a draw in range [first, last) transformed by one vertex job
+		struct raster_batch
+		{
+			u32 draw;
+			u32 first;
+			u32 last;
+		};
+
+		// NOTE(Zero):
+		// Triangles of a draw in range [firstTriangle, lastTriangle) set up by one geometry job, after binning
+		// the triangles of tile `t` are indexed by `binIndices` in range [binOffsets[t - 1], binOffsets[t]),
+		// 0 is the start for first tile
+		struct raster_chunk
+		{
+			u32 draw;
+			u32 firstTriangle;
+			u32 lastTriangle;
+			raster_triangle* triangles;
+			u32 numTriangles;
+			u32 triangleCapacity;
+			u32* binOffsets;
+			u32 binOffsetCapacity;
+			u32* binIndices;
+			u32 binIndexCapacity;
+		};
+
+		raster_chunk* m_Chunks;
+		u32 m_NumOfChunks;
+
+		// NOTE(Zero): Draws and vertex batches of the frame, kept between frames like the chunks
+		raster_draw* m_Draws;
+		u32 m_NumOfDraws;
+		u32 m_DrawCapacity;
+		raster_batch* m_Batches;
+		u32 m_NumOfBatches;
+		u32 m_BatchCapacity;
+
+		// NOTE(Zero): Clip space positions of the mesh vertices, structure of arrays in a single allocation
+		f32* m_ClipX;
+		f32* m_ClipY;
+		f32* m_ClipZ;
+		f32* m_ClipW;
+		u8* m_ClipCodes;
+		u32 m_ClipVertexCapacity;
+		v2 m_GuardBand;
+
+		// NOTE(Zero):
+		// Depth hierarchy, each block of `A3_RASTER_BLOCK_SIZE` pixels keeps a lower bound of its depth values
+		// (the farthest one) so triangles and blocks that can not pass the depth test are skipped early
+		// `Clear` only marks the blocks, a block is cleared when a triangle first touches it and
+		// the blocks nothing touched get the clear color at the end of `Render`, their depth stays pending
+		// With multisampling the flags are for the samples, pixels are always written by the resolve
+		enum block_flags
+		{
+			BlockClearColor = 0x1,
+			BlockClearDepth = 0x2
+		};
+		f32* m_BlockDepth;
+		u8* m_BlockFlags;
+		i32 m_NumOfBlocksX;
+		i32 m_NumOfBlocksY;
+		u32 m_ClearColor;
+
+		// NOTE(Zero): State of the frame being rendered, only read by the jobs
+		// Reversed depth is affine in 1/w, d = m_DepthScale / w + m_DepthBias, which comes from the projection
+		// Orthographic projections keep w at 1, their depth (1 - z/w) / 2 is affine in z instead
+		// `m_ClipToLight` takes the clip space of the camera to the clip space of the shadow map
+		render_type m_RenderType;
+		f32 m_DepthScale;
+		f32 m_DepthBias;
+		b32 m_Orthographic;
+		m4x4 m_ClipToLight;
+		u32 m_NumOfFrameChunks;
+		i32 m_NumOfTilesX;
+		i32 m_NumOfTilesY;
+
+		static void VertexJob(void* userData, u32 batchIndex, u32 threadIndex);
+		static void GeometryJob(void* userData, u32 chunkIndex, u32 threadIndex);
+		static void TileJob(void* userData, u32 tileIndex, u32 threadIndex);
+		void ReserveDraws(u32 count);
+		void RenderDraws(render_type type, const v3& outline);
+		void TransformVertices(u32 batchIndex);
+		template <b32 textured> void SetupChunk(raster_chunk* chunk);
+		void BinChunk(raster_chunk* chunk);
+		void RasterizeTile(u32 tileIndex);
+		// NOTE(Zero): Each array has the 3 vertices of the triangle, `uvs` and `lights` are null if they are not interpolated
+		void SetupTriangle(raster_triangle* tri, const v2* points, const f32* invW, const f32* depths, const v2* uvs, const v4* lights);
+		// NOTE(Zero):
+		// Rasterizer is instantiated for every combination of the pipeline state so its inner loops have no
+		// branches on it, `s_RasterizeTriangle` is indexed by [shading][lit][multisample][depth format]
+		// and the instantiation is picked once for each chunk of a draw, depth only is never lit
+		typedef b32(swapchain::*rasterize_triangle_proc)(const raster_triangle& tri, const texture* tex, i32 tileX0, i32 tileY0, i32 tileX1, i32 tileY1, f32 tileDepth);
+		static const rasterize_triangle_proc s_RasterizeTriangle[3][2][2][3];
+		template <raster_shading shading, b32 lit, b32 multisample, depth_format format>
+		b32 RasterizeTriangle(const raster_triangle& tri, const texture* tex, i32 tileX0, i32 tileY0, i32 tileX1, i32 tileY1, f32 tileDepth);
+		void ClearBlock(i32 blockX, i32 blockY, u32 flags);
+		void ResolveBlock(i32 blockX, i32 blockY);
+		void AllocateSamples();
+		void AllocateDepth();
+		f32 QueryTileDepth(i32 tileX0, i32 tileY0, i32 tileX1, i32 tileY1);
 
 	public:
 		swapchain();
+		friend void FreeSwapchain(swapchain* chain);
 		void SetProjection(const m4x4& proj);
 		void SetProjection(f32 fov, f32 aspectRatio, f32 cNear, f32 cFar);
 		void SetView(const m4x4& view);
@@ -49,14 +378,30 @@ namespace a3 {
 		void SetCamera(const m4x4& camera);
 		void SetViewport(i32 x, i32 y, i32 w, i32 h);
 		void SetMesh(mesh* meshCube);
-		void SetTexture(image* tex);
+		void SetTexture(const texture* tex);
 		void SetFrameBuffer(image* tex);
 		void SetDrawNormals(b32 normals);
+		// NOTE(Zero): Turns 4x multisampling on or off, contents of the frame are lost and it is cleared by the next `Render`
+		void SetMultisample(b32 multisample);
+		// NOTE(Zero): Contents of the frame are lost and it is cleared by the next `Render` like `SetMultisample`
+		void SetDepthFormat(depth_format format);
+		// NOTE(Zero):
+		// Light of the following renders, null goes back to shading by the angle to the camera
+		// The shadow map is only used while a light is set, null renders without shadows
+		void SetLight(const light* lightObj);
+		void SetShadowMap(const shadow_map* map);
+		// NOTE(Zero):
+		// Sets view and projection to the view of the light so the sphere at `center` is inside of it, for a shadow pass
+		// Directional lights get an orthographic projection, spot lights a perspective one with the angle of their cone
+		void SetLightView(const light& lightObj, const v3& center, f32 radius);
+		// NOTE(Zero): Copies the depth buffer and the view projection of the last `Render` to `map`, it is reallocated if its size differs
+		void CopyShadowMap(shadow_map* map);
 		void Clear(v3 color = a3::color::Black);
 		void Render(const m4x4& model, render_type type, const v3& shade = a3::color::White, const v3& outline = a3::color::Yellow);
-	private:
-		void TextureTriangle(i32 x, i32 y, v2 t1, f32 w1, i32 x2, i32 y2, v2 t2, f32 w2, i32 x3, i32 y3, v2 t3, f32 w3);
-		void ShadeTriangle(i32 x, i32 y, f32 w1, i32 x2, i32 y2, f32 w2, i32 x3, i32 y3, f32 w3, const v3& shade);
+		// NOTE(Zero):
+		// Draws the instances of the list that are inside of the view frustum in a single batch, nearest first
+		// Returns the number of instances drawn
+		u32 Render(const draw_list& list, render_type type, const v3& outline = a3::color::Yellow);
 	};
 
 }
@@ -69,7 +414,8 @@ namespace a3 {
 
 namespace a3 {
 
-	void swapchain::ClipPolygonOnWAxis(polygon* face, b32 textures)
+	template <b32 textures>
+	void swapchain::ClipPolygonOnWAxis(polygon* face)
 	{
 		f32 wPlane = 0.00001f;
 
@@ -91,6 +437,8 @@ namespace a3 {
 		v4 intersectionPoint;
 
 
+		if (face->numVertices == 0) return;
+
 		previousVertice = &face->vertices[face->numVertices - 1];
 		previousDot = (previousVertice->w < wPlane) ? -1 : 1;
 		currentVertice = &face->vertices[0];
@@ -155,7 +503,8 @@ namespace a3 {
 		insideNumVertices = 0;
 	}
 
-	void swapchain::ClipPolygonForAxis(polygon* face, i32 comp, b32 textures)
+	template <b32 textures>
+	void swapchain::ClipPolygonForAxis(polygon* face, i32 comp)
 	{
 		v4* currentVertice;
 		v4* previousVertice;
@@ -174,6 +523,8 @@ namespace a3 {
 		f32 intersectionFactor;
 		v4 intersectionPoint;
 
+		if (face->numVertices == 0) return;
+
 		previousVertice = &face->vertices[face->numVertices - 1];
 		previousDot = (previousVertice->values[comp] <= previousVertice->w) ? 1 : -1;
 		currentVertice = &face->vertices[0];
@@ -239,6 +590,8 @@ namespace a3 {
 		face->numVertices = insideNumVertices;
 		insideNumVertices = 0;
 
+		if (face->numVertices == 0) return;
+
 		previousVertice = &face->vertices[face->numVertices - 1];
 		previousDot = ((-previousVertice->values[comp]) <= previousVertice->w) ? 1 : -1;
 		currentVertice = &face->vertices[0];
@@ -305,20 +658,48 @@ namespace a3 {
 		insideNumVertices = 0;
 	}
 
-	void swapchain::ClipPolygon(polygon* face, b32 textures)
+	template <b32 textures>
+	void swapchain::ClipPolygon(polygon* face)
 	{
-		ClipPolygonOnWAxis(face, textures);		// w
-		ClipPolygonForAxis(face, 0, textures);	// x
-		ClipPolygonForAxis(face, 1, textures);	// y
-		ClipPolygonForAxis(face, 2, textures);	// z
+		ClipPolygonOnWAxis<textures>(face);		// w
+		ClipPolygonForAxis<textures>(face, 0);	// x
+		ClipPolygonForAxis<textures>(face, 1);	// y
+		ClipPolygonForAxis<textures>(face, 2);	// z
 	}
 
 	swapchain::swapchain()
 	{
 		m_FrameBuffer = A3NULL;
 		m_DepthBuffer = A3NULL;
+		m_DepthFormat = a3::DepthFloat32;
+		m_DepthBytes = sizeof(f32);
+		m_DepthScale = 1.0f;
+		m_DepthBias = 0.0f;
+		m_Orthographic = false;
+		m_SampleColor = A3NULL;
+		m_SampleDepth = A3NULL;
+		m_Multisample = false;
+		m_Light = A3NULL;
+		m_ShadowMap = A3NULL;
 		m_Texture = A3NULL;
+		m_Meshes = A3NULL;
 		m_DrawNormals = false;
+		m_Chunks = A3NULL;
+		m_NumOfChunks = 0;
+		m_Draws = A3NULL;
+		m_NumOfDraws = 0;
+		m_DrawCapacity = 0;
+		m_Batches = A3NULL;
+		m_NumOfBatches = 0;
+		m_BatchCapacity = 0;
+		m_ClipX = m_ClipY = m_ClipZ = m_ClipW = A3NULL;
+		m_ClipCodes = A3NULL;
+		m_BlockDepth = A3NULL;
+		m_BlockFlags = A3NULL;
+		m_NumOfBlocksX = 0;
+		m_NumOfBlocksY = 0;
+		m_ClearColor = 0;
+		m_ClipVertexCapacity = 0;
 		m_Projection = m4x4::PerspectiveR(a3ToRadians(90.0f), a3AspectRatio(), 0.1f, 1000.0f);
 		m_Viewport = { 0,0,1280,720 };
 	}
@@ -361,15 +742,59 @@ namespace a3 {
 		m_Meshes = meshObj;
 	}
 
-	inline void swapchain::SetTexture(image * tex)
+	inline void swapchain::SetTexture(const texture * tex)
 	{
 		m_Texture = tex;
 	}
 
+	void swapchain::SetLight(const light* lightObj)
+	{
+		m_Light = lightObj;
+	}
+
+	void swapchain::SetShadowMap(const shadow_map* map)
+	{
+		m_ShadowMap = map;
+	}
+
+	void swapchain::SetLightView(const light& lightObj, const v3& center, f32 radius)
+	{
+		v3 direction = Normalize(lightObj.Direction);
+		// NOTE(Zero): Up of the view must not be parallel to the light
+		v3 up = (FAbsf(direction.y) > 0.99f) ? v3{ 0.0f, 0.0f, 1.0f } : v3{ 0.0f, 1.0f, 0.0f };
+		if (lightObj.Type == a3::LightDirectional)
+		{
+			v3 from = center - direction * (2.0f * radius);
+			m_View = m4x4::Inverse(m4x4::LookR(from, center, up));
+			m_Projection = m4x4::OrthographicR(-radius, radius, -radius, radius, radius, 3.0f * radius);
+		}
+		else
+		{
+			f32 distance = Length(center - lightObj.Position);
+			f32 cFar = distance + radius;
+			f32 cNear = distance - radius;
+			if (cNear < 0.001f * cFar) cNear = 0.001f * cFar;
+			m_View = m4x4::Inverse(m4x4::LookR(lightObj.Position, lightObj.Position + direction, up));
+			m_Projection = m4x4::PerspectiveR(lightObj.Angle, 1.0f, cNear, cFar);
+		}
+	}
+
 	void swapchain::SetFrameBuffer(image * tex)
 	{
 		m_FrameBuffer = tex;
-		m_DepthBuffer = a3Reallocate(m_DepthBuffer, sizeof(f32)*tex->Width*tex->Height, f32);
+		AllocateDepth();
+
+		m_NumOfBlocksX = (tex->Width + A3_RASTER_BLOCK_SIZE - 1) / A3_RASTER_BLOCK_SIZE;
+		m_NumOfBlocksY = (tex->Height + A3_RASTER_BLOCK_SIZE - 1) / A3_RASTER_BLOCK_SIZE;
+		i32 numBlocks = m_NumOfBlocksX * m_NumOfBlocksY;
+		m_BlockDepth = a3Reallocate(m_BlockDepth, (sizeof(f32) + sizeof(u8)) * numBlocks, f32);
+		m_BlockFlags = (u8*)(m_BlockDepth + numBlocks);
+		// NOTE(Zero): 0 is a lower bound of any depth, nothing is rejected until the blocks are written
+		for (i32 i = 0; i < numBlocks; ++i)
+		{
+			m_BlockDepth[i] = 0.0f;
+			m_BlockFlags[i] = 0;
+		}
 	}
 
 	void swapchain::SetDrawNormals(b32 normals)
@@ -377,406 +802,1660 @@ namespace a3 {
 		m_DrawNormals = normals;
 	}
 
+	void swapchain::SetMultisample(b32 multisample)
+	{
+		if (m_Multisample == multisample) return;
+		m_Multisample = multisample;
+		if (m_Multisample && m_FrameBuffer) AllocateSamples();
+
+		// NOTE(Zero): Depth of the other mode is not valid, so everything is cleared again
+		i32 numBlocks = m_NumOfBlocksX * m_NumOfBlocksY;
+		for (i32 i = 0; i < numBlocks; ++i)
+		{
+			m_BlockDepth[i] = 0.0f;
+			m_BlockFlags[i] = BlockClearColor | BlockClearDepth;
+		}
+	}
+
+	void swapchain::SetDepthFormat(depth_format format)
+	{
+		if (m_DepthFormat == format) return;
+		m_DepthFormat = format;
+		m_DepthBytes = (format == a3::DepthUnorm16) ? (i32)sizeof(u16) : (i32)sizeof(u32);
+		if (m_FrameBuffer) AllocateDepth();
+
+		i32 numBlocks = m_NumOfBlocksX * m_NumOfBlocksY;
+		for (i32 i = 0; i < numBlocks; ++i)
+		{
+			m_BlockDepth[i] = 0.0f;
+			m_BlockFlags[i] = BlockClearColor | BlockClearDepth;
+		}
+	}
+
+	void swapchain::AllocateDepth()
+	{
+		m_DepthBuffer = a3Reallocate(m_DepthBuffer, (u64)m_DepthBytes * m_FrameBuffer->Width * m_FrameBuffer->Height, u8);
+		if (m_Multisample) AllocateSamples();
+	}
+
+	void swapchain::AllocateSamples()
+	{
+		u32 numSamples = (u32)(m_FrameBuffer->Width * m_FrameBuffer->Height) * A3_RASTER_SAMPLE_COUNT;
+		m_SampleColor = a3Reallocate(m_SampleColor, (sizeof(u32) + m_DepthBytes) * numSamples, u32);
+		m_SampleDepth = (u8*)(m_SampleColor + numSamples);
+	}
+
 	void swapchain::Clear(v3 color)
 	{
-		a3::FillImageBuffer(m_FrameBuffer, color);
-		for (i32 i = 0; i < m_FrameBuffer->Width*m_FrameBuffer->Height; ++i)
-			m_DepthBuffer[i] = 0.0f;
+		m_ClearColor = a3Normalv3ToRGBA(color, 0xff);
+		i32 numBlocks = m_NumOfBlocksX * m_NumOfBlocksY;
+		for (i32 i = 0; i < numBlocks; ++i)
+		{
+			m_BlockDepth[i] = 0.0f;
+			m_BlockFlags[i] = BlockClearColor | BlockClearDepth;
+		}
+	}
+
+	mesh_bounds ComputeMeshBounds(const mesh* meshObj)
+	{
+		mesh_bounds result = {};
+		if (!meshObj->NumOfVertices) return result;
+
+		const v3* vertices = meshObj->Vertices;
+		result.Min = vertices[0];
+		result.Max = vertices[0];
+		for (u32 i = 1; i < meshObj->NumOfVertices; ++i)
+		{
+			const v3& p = vertices[i];
+			if (p.x < result.Min.x) result.Min.x = p.x;
+			if (p.y < result.Min.y) result.Min.y = p.y;
+			if (p.z < result.Min.z) result.Min.z = p.z;
+			if (p.x > result.Max.x) result.Max.x = p.x;
+			if (p.y > result.Max.y) result.Max.y = p.y;
+			if (p.z > result.Max.z) result.Max.z = p.z;
+		}
+
+		result.Center = (result.Min + result.Max) * 0.5f;
+		f32 radius2 = 0.0f;
+		for (u32 i = 0; i < meshObj->NumOfVertices; ++i)
+		{
+			v3 d = vertices[i] - result.Center;
+			f32 length2 = Dot(d, d);
+			if (length2 > radius2) radius2 = length2;
+		}
+		result.Radius = Sqrtf(radius2);
+		return result;
+	}
+
+	void AddDrawInstance(draw_list* list, mesh* meshObj, const mesh_bounds& bounds, const m4x4& model, const v3& shade, const texture* tex)
+	{
+		if (list->NumOfInstances == list->Capacity)
+		{
+			list->Capacity = list->Capacity ? list->Capacity * 2 : 16;
+			list->Instances = a3Realloc(list->Instances, sizeof(draw_instance) * list->Capacity, draw_instance);
+		}
+		draw_instance* instance = list->Instances + list->NumOfInstances++;
+		instance->Mesh = meshObj;
+		instance->Texture = tex;
+		instance->Bounds = bounds;
+		instance->Model = model;
+		instance->Shade = shade;
+	}
+
+	shadow_map CreateShadowMap()
+	{
+		shadow_map result = {};
+		result.Bias = A3_RASTER_SHADOW_BIAS;
+		result.SlopeBias = A3_RASTER_SHADOW_SLOPE_BIAS;
+		return result;
+	}
+
+	void FreeShadowMap(shadow_map* map)
+	{
+		a3Free(map->Depth);
+		*map = {};
+	}
+
+	void ResetDrawList(draw_list* list)
+	{
+		list->NumOfInstances = 0;
+	}
+
+	void FreeDrawList(draw_list* list)
+	{
+		a3Free(list->Instances);
+		*list = {};
+	}
+
+	void FreeSwapchain(swapchain* chain)
+	{
+		for (u32 i = 0; i < chain->m_NumOfChunks; ++i)
+		{
+			a3Free(chain->m_Chunks[i].triangles);
+			a3Free(chain->m_Chunks[i].binOffsets);
+			a3Free(chain->m_Chunks[i].binIndices);
+		}
+		a3Free(chain->m_Chunks);
+		a3Free(chain->m_Draws);
+		a3Free(chain->m_Batches);
+		a3Free(chain->m_ClipX);
+		// NOTE(Zero): Buffers that follow the size of the frame buffer are persistent blocks
+		a3Release(chain->m_DepthBuffer);
+		a3Release(chain->m_BlockDepth);
+		a3Release(chain->m_SampleColor);
+
+		chain->m_FrameBuffer = A3NULL;
+		chain->m_DepthBuffer = A3NULL;
+		chain->m_SampleColor = A3NULL;
+		chain->m_SampleDepth = A3NULL;
+		chain->m_Chunks = A3NULL;
+		chain->m_NumOfChunks = 0;
+		chain->m_NumOfFrameChunks = 0;
+		chain->m_Draws = A3NULL;
+		chain->m_NumOfDraws = 0;
+		chain->m_DrawCapacity = 0;
+		chain->m_Batches = A3NULL;
+		chain->m_NumOfBatches = 0;
+		chain->m_BatchCapacity = 0;
+		chain->m_ClipX = chain->m_ClipY = chain->m_ClipZ = chain->m_ClipW = A3NULL;
+		chain->m_ClipCodes = A3NULL;
+		chain->m_ClipVertexCapacity = 0;
+		chain->m_BlockDepth = A3NULL;
+		chain->m_BlockFlags = A3NULL;
+		chain->m_NumOfBlocksX = 0;
+		chain->m_NumOfBlocksY = 0;
+	}
+
+	// NOTE(Zero):
+	// Frustum planes in the space of the mesh are combinations of the columns of `mvp`, e.g. left is w + x >= 0
+	// Box of the mesh is tested against 4 planes at a time, it is culled if it is entirely behind any of them
+	// `depth` is the smallest w on the bounding sphere, w changes by |column 3| per unit in the space of the mesh
+	static b32 a3_IsInstanceVisible(const m4x4& mvp, const a3::mesh_bounds& bounds, f32* depth)
+	{
+		const f32* m = mvp.elements;
+		v3 center = (bounds.Min + bounds.Max) * 0.5f;
+		v3 extent = (bounds.Max - bounds.Min) * 0.5f;
+		__m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		__m128 sign = _mm_setr_ps(1.0f, -1.0f, 1.0f, -1.0f);
+
+		// NOTE(Zero): Left, right, bottom, top and then near, far repeated
+		const i32 columns[2][2] = { { 0, 1 }, { 2, 2 } };
+		for (i32 g = 0; g < 2; ++g)
+		{
+			i32 a = columns[g][0];
+			i32 b = columns[g][1];
+			__m128 n[4];
+			for (i32 r = 0; r < 4; ++r)
+			{
+				__m128 column = _mm_setr_ps(m[r * 4 + a], m[r * 4 + a], m[r * 4 + b], m[r * 4 + b]);
+				n[r] = _mm_add_ps(_mm_set1_ps(m[r * 4 + 3]), _mm_mul_ps(sign, column));
+			}
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(n[0], _mm_set1_ps(center.x)), _mm_mul_ps(n[1], _mm_set1_ps(center.y))),
+				_mm_add_ps(_mm_mul_ps(n[2], _mm_set1_ps(center.z)), n[3]));
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_and_ps(n[0], absMask), _mm_set1_ps(extent.x)), _mm_mul_ps(_mm_and_ps(n[1], absMask), _mm_set1_ps(extent.y))),
+				_mm_mul_ps(_mm_and_ps(n[2], absMask), _mm_set1_ps(extent.z)));
+			if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), _mm_setzero_ps()))) return false;
+		}
+
+		const v3& c = bounds.Center;
+		f32 w = c.x * m[3] + c.y * m[7] + c.z * m[11] + m[15];
+		*depth = w - bounds.Radius * Sqrtf(m[3] * m[3] + m[7] * m[7] + m[11] * m[11]);
+		return true;
+	}
+
+	void swapchain::ReserveDraws(u32 count)
+	{
+		if (count > m_DrawCapacity)
+		{
+			m_Draws = a3Realloc(m_Draws, sizeof(raster_draw) * count, raster_draw);
+			m_DrawCapacity = count;
+		}
 	}
 
 	void swapchain::Render(const m4x4& model, render_type type, const v3& shade, const v3& outline)
+	{
+		m_NumOfDraws = 0;
+		if (m_Meshes)
+		{
+			ReserveDraws(1);
+			raster_draw* draw = m_Draws + m_NumOfDraws++;
+			draw->meshObj = m_Meshes;
+			draw->textureObj = m_Texture;
+			draw->model = model;
+			draw->mvp = model * m_View * m_Projection;
+			draw->shade = shade;
+			draw->depth = 0.0f;
+		}
+		RenderDraws(type, outline);
+	}
+
+	u32 swapchain::Render(const draw_list& list, render_type type, const v3& outline)
+	{
+		m4x4 viewProjection = m_View * m_Projection;
+		ReserveDraws(list.NumOfInstances);
+		m_NumOfDraws = 0;
+		for (u32 i = 0; i < list.NumOfInstances; ++i)
+		{
+			const draw_instance& instance = list.Instances[i];
+			if (!instance.Mesh) continue;
+			m4x4 mvp = instance.Model * viewProjection;
+			f32 depth;
+			if (!a3_IsInstanceVisible(mvp, instance.Bounds, &depth)) continue;
+
+			raster_draw* draw = m_Draws + m_NumOfDraws++;
+			draw->meshObj = instance.Mesh;
+			draw->textureObj = instance.Texture ? instance.Texture : m_Texture;
+			draw->model = instance.Model;
+			draw->mvp = mvp;
+			draw->shade = instance.Shade;
+			draw->depth = depth;
+		}
+
+		// NOTE(Zero): Nearest first so the depth hierarchy rejects more of what is drawn later
+		a3::Sort(m_Draws, m_NumOfDraws, [](const raster_draw& a, const raster_draw& b) {
+			return a.depth < b.depth;
+		});
+
+		RenderDraws(type, outline);
+		return m_NumOfDraws;
+	}
+
+	void swapchain::RenderDraws(render_type type, const v3& outline)
 	{
 		a3Assert(m_FrameBuffer);
 
-		if (!m_Meshes) return;
+		m_NumOfTilesX = (m_FrameBuffer->Width + A3_RASTER_TILE_SIZE - 1) / A3_RASTER_TILE_SIZE;
+		m_NumOfTilesY = (m_FrameBuffer->Height + A3_RASTER_TILE_SIZE - 1) / A3_RASTER_TILE_SIZE;
+		u32 numTiles = (u32)(m_NumOfTilesX * m_NumOfTilesY);
+		a3::job_counter counter = {};
 
-		m4x4 mvp = model * m_View * m_Projection;
+		m_RenderType = type;
 
-		u32 nTriangles = m_Meshes->NumOfTriangles;
-		v3* vertices = m_Meshes->Vertices;
-		u32* indices = m_Meshes->VertexIndices;
-		v2* textures = m_Meshes->TextureCoords;
-		u32* tindices = m_Meshes->TextureCoordsIndices;
+		// NOTE(Zero):
+		// Projection maps w in [near, far] to z/w in [-1, 1] as z/w = -P[2][2] + P[3][2] / w, depth is
+		// (1 - z/w) / 2 which is 1 at the near plane
+		// Orthographic projections (light views) keep w at 1, so there depth is computed from z/w itself
+		m_Orthographic = (m_Projection.elements[2 * 4 + 3] == 0.0f);
+		m_DepthScale = -0.5f * m_Projection.elements[3 * 4 + 2];
+		m_DepthBias = 0.5f * (1.0f + m_Projection.elements[2 * 4 + 2]);
 
-		if (!textures)
+		// NOTE(Zero): Position in the shadow map is interpolated from the clip space vertices, which may be clipped
+		const light* lightObj = (type == a3::RenderDepth) ? A3NULL : m_Light;
+		if (lightObj && m_ShadowMap)
 		{
-			if (type == a3::RenderMapTexture) type = a3::RenderShade;
+			m_ClipToLight = m4x4::Inverse(m_View * m_Projection) * m_ShadowMap->ViewProjection;
 		}
 
-		for (u32 nTri = 0; nTri < nTriangles; ++nTri)
+		// NOTE(Zero):
+		// Draws without texture coordinates or a texture are shaded instead
+		// Flat shaded draws are only lit per pixel for shadows, otherwise their color already has the light
+		u32 nVertices = 0;
+		u32 numBatches = 0;
+		m_NumOfFrameChunks = 0;
+		for (u32 d = 0; d < m_NumOfDraws; ++d)
 		{
-			const v3& p0 = vertices[indices[nTri * 3 + 0]];
-			const v3& p1 = vertices[indices[nTri * 3 + 1]];
-			const v3& p2 = vertices[indices[nTri * 3 + 2]];
+			raster_draw* draw = m_Draws + d;
+			if (type != a3::RenderMapTexture || !draw->meshObj->TextureCoords) draw->textureObj = A3NULL;
+			draw->lit = lightObj && (m_ShadowMap || draw->textureObj);
+			draw->firstVertex = nVertices;
+			nVertices += draw->meshObj->NumOfVertices;
+			numBatches += (draw->meshObj->NumOfVertices + A3_RASTER_VERTEX_BATCH - 1) / A3_RASTER_VERTEX_BATCH;
+			m_NumOfFrameChunks += (draw->meshObj->NumOfTriangles + A3_RASTER_CHUNK_SIZE - 1) / A3_RASTER_CHUNK_SIZE;
+		}
 
-			polygon triangle;
-			triangle.numVertices = 3;
-			triangle.vertices[0] = v4{ p0.x, p0.y, p0.z, 1.0f } *mvp;
-			triangle.vertices[1] = v4{ p1.x, p1.y, p1.z, 1.0f } *mvp;
-			triangle.vertices[2] = v4{ p2.x, p2.y, p2.z, 1.0f } *mvp;
+		// NOTE(Zero):
+		// Chunks are kept between frames and only grow, so a steady scene does not allocate
+		// Storage is reserved here for the common case, jobs only grow it when clipping adds triangles
+		if (m_NumOfFrameChunks > m_NumOfChunks)
+		{
+			m_Chunks = a3Realloc(m_Chunks, sizeof(raster_chunk) * m_NumOfFrameChunks, raster_chunk);
+			for (u32 i = m_NumOfChunks; i < m_NumOfFrameChunks; ++i)
+			{
+				m_Chunks[i] = {};
+			}
+			m_NumOfChunks = m_NumOfFrameChunks;
+		}
+		if (numBatches > m_BatchCapacity)
+		{
+			m_Batches = a3Realloc(m_Batches, sizeof(raster_batch) * numBatches, raster_batch);
+			m_BatchCapacity = numBatches;
+		}
 
-			if (textures)
+		u32 chunkIndex = 0;
+		m_NumOfBatches = 0;
+		for (u32 d = 0; d < m_NumOfDraws; ++d)
+		{
+			const mesh* meshObj = m_Draws[d].meshObj;
+			for (u32 first = 0; first < meshObj->NumOfVertices; first += A3_RASTER_VERTEX_BATCH)
 			{
-				if (tindices)
+				raster_batch* batch = m_Batches + m_NumOfBatches++;
+				batch->draw = d;
+				batch->first = first;
+				batch->last = (first + A3_RASTER_VERTEX_BATCH < meshObj->NumOfVertices) ? first + A3_RASTER_VERTEX_BATCH : meshObj->NumOfVertices;
+			}
+			for (u32 first = 0; first < meshObj->NumOfTriangles; first += A3_RASTER_CHUNK_SIZE)
+			{
+				raster_chunk* chunk = m_Chunks + chunkIndex++;
+				chunk->draw = d;
+				chunk->firstTriangle = first;
+				chunk->lastTriangle = (first + A3_RASTER_CHUNK_SIZE < meshObj->NumOfTriangles) ? first + A3_RASTER_CHUNK_SIZE : meshObj->NumOfTriangles;
+				if (chunk->triangleCapacity < A3_RASTER_CHUNK_SIZE)
 				{
-					triangle.textureCoords[0] = textures[tindices[nTri * 3] + 0];
-					triangle.textureCoords[1] = textures[tindices[nTri * 3] + 1];
-					triangle.textureCoords[2] = textures[tindices[nTri * 3] + 2];
+					chunk->triangles = a3Realloc(chunk->triangles, sizeof(raster_triangle) * A3_RASTER_CHUNK_SIZE, raster_triangle);
+					chunk->triangleCapacity = A3_RASTER_CHUNK_SIZE;
 				}
-				else
+				if (chunk->binOffsetCapacity < numTiles)
 				{
-					triangle.textureCoords[0] = textures[nTri * 3 + 0];
-					triangle.textureCoords[1] = textures[nTri * 3 + 1];
-					triangle.textureCoords[2] = textures[nTri * 3 + 2];
+					chunk->binOffsets = a3Realloc(chunk->binOffsets, sizeof(u32) * numTiles, u32);
+					chunk->binOffsetCapacity = numTiles;
 				}
 			}
+		}
 
-			// NOTE(Zero): 
-			// Since camera is at (0,0,0) and poi32ing towards z direction
-			// the z component from result of Cross product gives the dot product
-			v3 normal = Normalize(Cross(triangle.vertices[1].xyz - triangle.vertices[0].xyz, triangle.vertices[2].xyz - triangle.vertices[1].xyz));
-			f32 dot = normal.z;
+		if (nVertices > m_ClipVertexCapacity)
+		{
+			m_ClipX = a3Realloc(m_ClipX, (sizeof(f32) * 4 + sizeof(u8)) * nVertices, f32);
+			m_ClipVertexCapacity = nVertices;
+		}
+		m_ClipY = m_ClipX + m_ClipVertexCapacity;
+		m_ClipZ = m_ClipY + m_ClipVertexCapacity;
+		m_ClipW = m_ClipZ + m_ClipVertexCapacity;
+		m_ClipCodes = (u8*)(m_ClipW + m_ClipVertexCapacity);
+
+		// NOTE(Zero):
+		// Guard band in units of w, lines are clamped to the frame buffer when drawn so
+		// triangles that are outlined are clipped to the frustum
+		b32 drawLines = (type == a3::RenderTriangle || type == a3::RenderShadeWithOutline || (m_DrawNormals && type != a3::RenderDepth));
+		if (drawLines)
+		{
+			m_GuardBand = v2{ 1.0f, 1.0f };
+		}
+		else
+		{
+			m_GuardBand.x = 1.0f + 2.0f * A3_RASTER_GUARD_BAND / (f32)m_FrameBuffer->Width;
+			m_GuardBand.y = 1.0f + 2.0f * A3_RASTER_GUARD_BAND / (f32)m_FrameBuffer->Height;
+		}
 
-			if (dot >= 0.0f)
+		a3::Jobs.Dispatch(VertexJob, this, m_NumOfBatches, &counter);
+		a3::Jobs.Wait(&counter);
+
+		a3::Jobs.Dispatch(GeometryJob, this, m_NumOfFrameChunks, &counter);
+		a3::Jobs.Wait(&counter);
+
+		// NOTE(Zero): Tiles are visited even if nothing is drawn to write the pending clear color
+		a3::Jobs.Dispatch(TileJob, this, numTiles, &counter);
+		a3::Jobs.Wait(&counter);
+
+		// NOTE(Zero): Lines are drawn after all the tiles are filled, in the order of the triangles
+		if (drawLines)
+		{
+			b32 drawOutline = (type == a3::RenderTriangle || type == a3::RenderShadeWithOutline);
+			for (u32 c = 0; c < m_NumOfFrameChunks; ++c)
 			{
-				if (textures && type == a3::RenderMapTexture)
+				raster_chunk* chunk = m_Chunks + c;
+				for (u32 i = 0; i < chunk->numTriangles; ++i)
 				{
-					ClipPolygon(&triangle, true);
-				}
-				else
-				{
-					ClipPolygon(&triangle);
+					const raster_triangle& tri = chunk->triangles[i];
+					if (drawOutline)
+					{
+						a3::DrawTriangle(m_FrameBuffer, tri.vertices[0], tri.vertices[1], tri.vertices[2], outline);
+					}
+					if (m_DrawNormals)
+					{
+						v2 centroid{ (tri.vertices[0].x + tri.vertices[1].x + tri.vertices[2].x) / 3.0f, (tri.vertices[0].y + tri.vertices[1].y + tri.vertices[2].y) / 3.0f };
+						a3::DrawLine(m_FrameBuffer, centroid, centroid + 30.0f * tri.normal, a3::color::Yellow);
+					}
 				}
+			}
+		}
+	}
 
-				if (triangle.numVertices > 0)
-				{
-					v2 finalPoint0;
-					finalPoint0.x = triangle.vertices[0].x / triangle.vertices[0].w;
-					finalPoint0.y = triangle.vertices[0].y / triangle.vertices[0].w;
+	void swapchain::VertexJob(void* userData, u32 batchIndex, u32)
+	{
+		swapchain* chain = (swapchain*)userData;
+		chain->TransformVertices(batchIndex);
+	}
 
-					finalPoint0.x = 0.5f * (finalPoint0.x + 1.0f) * (m_FrameBuffer->Width - 1);
-					finalPoint0.y = ((finalPoint0.y + 1.0f) * 0.5f) * (m_FrameBuffer->Height - 1);
+	void swapchain::GeometryJob(void* userData, u32 chunkIndex, u32)
+	{
+		swapchain* chain = (swapchain*)userData;
+		raster_chunk* chunk = chain->m_Chunks + chunkIndex;
+		if (chain->m_Draws[chunk->draw].textureObj) chain->SetupChunk<true>(chunk);
+		else chain->SetupChunk<false>(chunk);
+		if (chain->m_RenderType != a3::RenderTriangle)
+		{
+			chain->BinChunk(chunk);
+		}
+	}
 
-					f32 w0 = 1.0f / triangle.vertices[0].w;
+	void swapchain::TileJob(void* userData, u32 tileIndex, u32)
+	{
+		swapchain* chain = (swapchain*)userData;
+		chain->RasterizeTile(tileIndex);
+	}
 
-					v2 finalUV0;
+	void swapchain::TransformVertices(u32 batchIndex)
+	{
+		const raster_batch& batch = m_Batches[batchIndex];
+		const raster_draw& draw = m_Draws[batch.draw];
+		const v3* vertices = draw.meshObj->Vertices;
+		const m4x4& mvp = draw.mvp;
+		u32 first = batch.first;
+		u32 last = batch.last;
+		f32* clipX = m_ClipX + draw.firstVertex;
+		f32* clipY = m_ClipY + draw.firstVertex;
+		f32* clipZ = m_ClipZ + draw.firstVertex;
+		f32* clipW = m_ClipW + draw.firstVertex;
+		u8* clipCodes = m_ClipCodes + draw.firstVertex;
+
+		// NOTE(Zero): Row vector times matrix, column `c` of the result is x*m[0][c] + y*m[1][c] + z*m[2][c] + m[3][c]
+		__m128 m[4][4];
+		for (i32 r = 0; r < 4; ++r)
+		{
+			for (i32 c = 0; c < 4; ++c)
+			{
+				m[r][c] = _mm_set1_ps(mvp.elements[r * 4 + c]);
+			}
+		}
+		__m128 wPlane = _mm_set1_ps(0.00001f);
+		__m128 guardX = _mm_set1_ps(m_GuardBand.x);
+		__m128 guardY = _mm_set1_ps(m_GuardBand.y);
+		__m128 bits[8];
+		for (i32 b = 0; b < 8; ++b)
+		{
+			bits[b] = _mm_castsi128_ps(_mm_set1_epi32(1 << b));
+		}
 
-					if (textures && type == a3::RenderMapTexture)
-					{
-						finalUV0 = triangle.textureCoords[0] * (1.0f / triangle.vertices[0].w);
-					}
+		u32 i = first;
+		for (; i + 4 <= last; i += 4)
+		{
+			const v3* v = vertices + i;
+			__m128 x = _mm_setr_ps(v[0].x, v[1].x, v[2].x, v[3].x);
+			__m128 y = _mm_setr_ps(v[0].y, v[1].y, v[2].y, v[3].y);
+			__m128 z = _mm_setr_ps(v[0].z, v[1].z, v[2].z, v[3].z);
+			__m128 clip[4];
+			for (i32 c = 0; c < 4; ++c)
+			{
+				clip[c] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m[0][c]), _mm_mul_ps(y, m[1][c])), _mm_add_ps(_mm_mul_ps(z, m[2][c]), m[3][c]));
+			}
+			_mm_storeu_ps(clipX + i, clip[0]);
+			_mm_storeu_ps(clipY + i, clip[1]);
+			_mm_storeu_ps(clipZ + i, clip[2]);
+			_mm_storeu_ps(clipW + i, clip[3]);
+
+			__m128 w = clip[3];
+			__m128 negW = _mm_sub_ps(_mm_setzero_ps(), w);
+			__m128 guardW = _mm_mul_ps(guardX, w);
+			__m128 guardH = _mm_mul_ps(guardY, w);
+			__m128 codes = _mm_and_ps(_mm_cmplt_ps(clip[0], negW), bits[0]);
+			codes = _mm_or_ps(codes, _mm_and_ps(_mm_cmpgt_ps(clip[0], w), bits[1]));
+			codes = _mm_or_ps(codes, _mm_and_ps(_mm_cmplt_ps(clip[1], negW), bits[2]));
+			codes = _mm_or_ps(codes, _mm_and_ps(_mm_cmpgt_ps(clip[1], w), bits[3]));
+			codes = _mm_or_ps(codes, _mm_and_ps(_mm_cmplt_ps(clip[2], negW), bits[4]));
+			codes = _mm_or_ps(codes, _mm_and_ps(_mm_cmpgt_ps(clip[2], w), bits[5]));
+			codes = _mm_or_ps(codes, _mm_and_ps(_mm_cmplt_ps(w, wPlane), bits[6]));
+			__m128 outside = _mm_or_ps(_mm_cmpgt_ps(clip[0], guardW), _mm_cmplt_ps(clip[0], _mm_sub_ps(_mm_setzero_ps(), guardW)));
+			outside = _mm_or_ps(outside, _mm_or_ps(_mm_cmpgt_ps(clip[1], guardH), _mm_cmplt_ps(clip[1], _mm_sub_ps(_mm_setzero_ps(), guardH))));
+			codes = _mm_or_ps(codes, _mm_and_ps(outside, bits[7]));
+
+			__m128i packed = _mm_packs_epi32(_mm_castps_si128(codes), _mm_setzero_si128());
+			packed = _mm_packus_epi16(packed, _mm_setzero_si128());
+			u32 code4 = (u32)_mm_cvtsi128_si32(packed);
+			a3::MemoryCopy(clipCodes + i, &code4, sizeof(code4));
+		}
+		for (; i < last; ++i)
+		{
+			const v3& p = vertices[i];
+			v4 clip = v4{ p.x, p.y, p.z, 1.0f } * mvp;
+			clipX[i] = clip.x;
+			clipY[i] = clip.y;
+			clipZ[i] = clip.z;
+			clipW[i] = clip.w;
+
+			u32 code = 0;
+			if (clip.x < -clip.w) code |= ClipLeft;
+			if (clip.x > clip.w) code |= ClipRight;
+			if (clip.y < -clip.w) code |= ClipBottom;
+			if (clip.y > clip.w) code |= ClipTop;
+			if (clip.z < -clip.w) code |= ClipNear;
+			if (clip.z > clip.w) code |= ClipFar;
+			if (clip.w < 0.00001f) code |= ClipBehind;
+			if (clip.x > m_GuardBand.x * clip.w || clip.x < -m_GuardBand.x * clip.w ||
+				clip.y > m_GuardBand.y * clip.w || clip.y < -m_GuardBand.y * clip.w) code |= ClipGuardBand;
+			clipCodes[i] = (u8)code;
+		}
+	}
 
-					for (i32 n = 1; n < triangle.numVertices - 1; ++n)
-					{
-						v2 finalPoint1;
-						v2 finalPoint2;
+	// NOTE(Zero):
+	// Lighting of a triangle from the world space positions of its vertices, without shadows
+	// Diffuse is the part of the shade that the light adds to `ambient`, spot lights are evaluated at the centroid
+	static void a3_LightTriangle(const a3::light& lightObj, const v3* world, f32* ambient, f32* diffuse)
+	{
+		v3 normal = Normalize(Cross(world[1] - world[0], world[2] - world[1]));
+		v3 direction = Normalize(lightObj.Direction);
+		f32 falloff = 1.0f;
+		v3 toLight = -direction;
+		if (lightObj.Type == a3::LightSpot)
+		{
+			v3 centroid = (world[0] + world[1] + world[2]) * (1.0f / 3.0f);
+			toLight = Normalize(lightObj.Position - centroid);
+			f32 cosOuter = Cosf(0.5f * lightObj.Angle);
+			f32 cosInner = Cosf(0.5f * A3_RASTER_SPOT_INNER * lightObj.Angle);
+			falloff = (Dot(-toLight, direction) - cosOuter) / (cosInner - cosOuter);
+			if (falloff < 0.0f) falloff = 0.0f;
+			if (falloff > 1.0f) falloff = 1.0f;
+		}
+		f32 dot = Dot(normal, toLight);
+		*ambient = lightObj.Ambient;
+		*diffuse = (dot > 0.0f) ? (1.0f - lightObj.Ambient) * dot * falloff : 0.0f;
+	}
 
-						finalPoint1.x = triangle.vertices[n + 0].x / triangle.vertices[n + 0].w;
-						finalPoint1.y = triangle.vertices[n + 0].y / triangle.vertices[n + 0].w;
+	// NOTE(Zero):
+	// Change of the depth of a triangle in the shadow map over a texel along x plus along y, from its vertices in the
+	// clip space of the light (divided by any common factor), mapped to texels the same way `a3_SampleShadow4` does
+	// Depth is affine in the position on the map for both projections so the plane through the vertices is exact,
+	// triangles that are seen edge on or cross the plane of the light get the whole depth range as their slope
+	static f32 a3_ShadowDepthSlope(const v4* lights, i32 width, i32 height)
+	{
+		f32 sx[3], sy[3], d[3];
+		for (i32 i = 0; i < 3; ++i)
+		{
+			if (!(lights[i].w > 0.0f)) return 1.0f;
+			f32 invW = 1.0f / lights[i].w;
+			sx[i] = lights[i].x * invW * 0.5f * (f32)(width - 1);
+			sy[i] = lights[i].y * invW * 0.5f * (f32)(height - 1);
+			d[i] = -0.5f * lights[i].z * invW;
+		}
+		f32 area = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sy[1] - sy[0]) * (sx[2] - sx[0]);
+		if (!(FAbsf(area) > 1e-6f)) return 1.0f;
+		f32 dx = ((d[1] - d[0]) * (sy[2] - sy[0]) - (d[2] - d[0]) * (sy[1] - sy[0])) / area;
+		f32 dy = ((d[2] - d[0]) * (sx[1] - sx[0]) - (d[1] - d[0]) * (sx[2] - sx[0])) / area;
+		return FAbsf(dx) + FAbsf(dy);
+	}
 
-						finalPoint2.x = triangle.vertices[n + 1].x / triangle.vertices[n + 1].w;
-						finalPoint2.y = triangle.vertices[n + 1].y / triangle.vertices[n + 1].w;
+	template <b32 textured>
+	void swapchain::SetupChunk(raster_chunk* chunk)
+	{
+		const raster_draw& draw = m_Draws[chunk->draw];
+		const v3* meshVertices = draw.meshObj->Vertices;
+		u32* indices = draw.meshObj->VertexIndices;
+		v2* textures = draw.meshObj->TextureCoords;
+		u32* tindices = draw.meshObj->TextureCoordsIndices;
+		const f32* clipX = m_ClipX + draw.firstVertex;
+		const f32* clipY = m_ClipY + draw.firstVertex;
+		const f32* clipZ = m_ClipZ + draw.firstVertex;
+		const f32* clipW = m_ClipW + draw.firstVertex;
+		const u8* clipCodes = m_ClipCodes + draw.firstVertex;
+
+		f32 width = (f32)(m_FrameBuffer->Width - 1);
+		f32 height = (f32)(m_FrameBuffer->Height - 1);
+
+		b32 depthOnly = (m_RenderType == a3::RenderDepth);
+		const light* lightObj = depthOnly ? A3NULL : m_Light;
+		b32 shadowed = draw.lit && m_ShadowMap;
+
+		chunk->numTriangles = 0;
+
+		for (u32 nTri = chunk->firstTriangle; nTri < chunk->lastTriangle; ++nTri)
+		{
+			u32 i0 = indices[nTri * 3 + 0];
+			u32 i1 = indices[nTri * 3 + 1];
+			u32 i2 = indices[nTri * 3 + 2];
 
-						finalPoint1.x = 0.5f * (finalPoint1.x + 1.0f) * (m_FrameBuffer->Width - 1);
-						finalPoint1.y = ((finalPoint1.y + 1.0f) * 0.5f) * (m_FrameBuffer->Height - 1);
+			// NOTE(Zero): Triangles with all the vertices outside of the same plane are not visible
+			u32 codeAnd = clipCodes[i0] & clipCodes[i1] & clipCodes[i2];
+			u32 codeOr = clipCodes[i0] | clipCodes[i1] | clipCodes[i2];
+			if (codeAnd & ClipFrustum) continue;
 
-						finalPoint2.x = 0.5f * (finalPoint2.x + 1.0f) * (m_FrameBuffer->Width - 1);
-						finalPoint2.y = ((finalPoint2.y + 1.0f) * 0.5f) * (m_FrameBuffer->Height - 1);
+			polygon triangle;
+			triangle.numVertices = 3;
+			triangle.vertices[0] = v4{ clipX[i0], clipY[i0], clipZ[i0], clipW[i0] };
+			triangle.vertices[1] = v4{ clipX[i1], clipY[i1], clipZ[i1], clipW[i1] };
+			triangle.vertices[2] = v4{ clipX[i2], clipY[i2], clipZ[i2], clipW[i2] };
+			if (textured)
+			{
+				for (i32 k = 0; k < 3; ++k)
+				{
+					triangle.textureCoords[k] = tindices ? textures[tindices[nTri * 3 + k]] : textures[nTri * 3 + k];
+				}
+			}
 
-						f32 w1 = 1.0f / triangle.vertices[n + 0].w;
-						f32 w2 = 1.0f / triangle.vertices[n + 1].w;
+			// NOTE(Zero): 
+			// Since camera is at (0,0,0) and poi32ing towards z direction
+			// the z component from result of Cross product gives the dot product
+			v3 normal = Normalize(Cross(triangle.vertices[1].xyz - triangle.vertices[0].xyz, triangle.vertices[2].xyz - triangle.vertices[1].xyz));
+			f32 dot = normal.z;
 
-						if (type == a3::RenderTriangle)
-						{
-							a3::DrawTriangle(m_FrameBuffer, finalPoint0, finalPoint1, finalPoint2, outline);
-						}
-						else if (type == a3::RenderShade)
-						{
-							ShadeTriangle((i32)finalPoint0.x, (i32)finalPoint0.y, w0, (i32)finalPoint1.x, (i32)finalPoint1.y, w1, (i32)finalPoint2.x, (i32)finalPoint2.y, w2, shade * dot);
-						}
-						else if (type == a3::RenderShadeWithOutline)
-						{
-							ShadeTriangle((i32)finalPoint0.x, (i32)finalPoint0.y, w0, (i32)finalPoint1.x, (i32)finalPoint1.y, w1, (i32)finalPoint2.x, (i32)finalPoint2.y, w2, shade * dot);
-							a3::DrawTriangle(m_FrameBuffer, finalPoint0, finalPoint1, finalPoint2, outline);
-						}
-						else
-						{
-							v2 finalUV1;
-							v2 finalUV2;
-							finalUV1 = triangle.textureCoords[1] * (1.0f / triangle.vertices[1].w);
-							finalUV2 = triangle.textureCoords[2] * (1.0f / triangle.vertices[2].w);
-							a3Assert(finalUV0.x >= 0.0f && finalUV0.x <= 1.0f);
-							a3Assert(finalUV0.y >= 0.0f && finalUV0.y <= 1.0f);
-							a3Assert(finalUV1.x >= 0.0f && finalUV1.x <= 1.0f);
-							a3Assert(finalUV1.y >= 0.0f && finalUV1.y <= 1.0f);
-							a3Assert(finalUV2.x >= 0.0f && finalUV2.x <= 1.0f);
-							a3Assert(finalUV2.y >= 0.0f && finalUV2.y <= 1.0f);
-							TextureTriangle((i32)finalPoint0.x, (i32)finalPoint0.y, finalUV0, w0, (i32)finalPoint1.x, (i32)finalPoint1.y, finalUV1, w1, (i32)finalPoint2.x, (i32)finalPoint2.y, finalUV2, w2);
-						}
+			if (dot < 0.0f) continue;
 
-						if (m_DrawNormals)
-						{
-							v2 centroid{ (finalPoint0.x + finalPoint1.x + finalPoint2.x) / 3.0f, (finalPoint0.y + finalPoint1.y + finalPoint2.y) / 3.0f };
-							a3::DrawLine(m_FrameBuffer, centroid, centroid + 30.0f * normal.xy, a3::color::Yellow);
-						}
-					}
-				}
+			if (codeOr & ClipRequired)
+			{
+				ClipPolygon<textured>(&triangle);
+				if (triangle.numVertices < 3) continue;
+			}
+
+			u32 color = 0;
+			f32 ambient = 1.0f;
+			f32 diffuse = 0.0f;
+			if (lightObj)
+			{
+				v3 world[3];
+				world[0] = (v4{ meshVertices[i0].x, meshVertices[i0].y, meshVertices[i0].z, 1.0f } * draw.model).xyz;
+				world[1] = (v4{ meshVertices[i1].x, meshVertices[i1].y, meshVertices[i1].z, 1.0f } * draw.model).xyz;
+				world[2] = (v4{ meshVertices[i2].x, meshVertices[i2].y, meshVertices[i2].z, 1.0f } * draw.model).xyz;
+				a3_LightTriangle(*lightObj, world, &ambient, &diffuse);
+				v3 lightShade = draw.lit ? draw.shade : draw.shade * (ambient + diffuse);
+				color = a3Normalv3ToRGBA(lightShade, 0xff);
+			}
+			else if (!depthOnly)
+			{
+				color = a3Normalv3ToRGBA((draw.shade * dot), 0xff);
+			}
 
+			v2 screen[10];
+			f32 invW[10];
+			f32 depths[10];
+			v4 lights[10];
+			for (i32 n = 0; n < triangle.numVertices; ++n)
+			{
+				invW[n] = 1.0f / triangle.vertices[n].w;
+				screen[n].x = 0.5f * (triangle.vertices[n].x * invW[n] + 1.0f) * width;
+				screen[n].y = ((triangle.vertices[n].y * invW[n] + 1.0f) * 0.5f) * height;
+				if (m_Orthographic) depths[n] = 0.5f - 0.5f * triangle.vertices[n].z * invW[n];
+				else depths[n] = m_DepthScale * invW[n] + m_DepthBias;
+				if (shadowed) lights[n] = (triangle.vertices[n] * m_ClipToLight) * invW[n];
+			}
+
+			u32 numFan = (u32)triangle.numVertices - 2;
+			if (chunk->numTriangles + numFan > chunk->triangleCapacity)
+			{
+				chunk->triangleCapacity *= 2;
+				chunk->triangles = a3Realloc(chunk->triangles, sizeof(raster_triangle) * chunk->triangleCapacity, raster_triangle);
+			}
+
+			for (i32 n = 1; n < triangle.numVertices - 1; ++n)
+			{
+				raster_triangle* tri = chunk->triangles + chunk->numTriangles++;
+				v2 points[3] = { screen[0], screen[n + 0], screen[n + 1] };
+				f32 fanInvW[3] = { invW[0], invW[n + 0], invW[n + 1] };
+				f32 fanDepths[3] = { depths[0], depths[n + 0], depths[n + 1] };
+				v2 uvs[3] = { triangle.textureCoords[0], triangle.textureCoords[n + 0], triangle.textureCoords[n + 1] };
+				v4 fanLights[3];
+				if (shadowed)
+				{
+					fanLights[0] = lights[0];
+					fanLights[1] = lights[n + 0];
+					fanLights[2] = lights[n + 1];
+				}
+				SetupTriangle(tri, points, fanInvW, fanDepths, textured ? uvs : A3NULL, shadowed ? fanLights : A3NULL);
+				tri->normal = normal.xy;
+				tri->color = color;
+				tri->ambient = ambient;
+				tri->diffuse = diffuse;
+				tri->shadowSlope = shadowed ? a3_ShadowDepthSlope(fanLights, m_ShadowMap->Width, m_ShadowMap->Height) : 0.0f;
 			}
 		}
 	}
 
-	void swapchain::TextureTriangle(i32 x1, i32 y1, v2 t1, f32 w1, i32 x2, i32 y2, v2 t2, f32 w2, i32 x3, i32 y3, v2 t3, f32 w3)
+	void swapchain::SetupTriangle(raster_triangle* tri, const v2* points, const f32* invW, const f32* depths, const v2* uvs, const v4* lights)
 	{
-		if (y2 < y1)
+		f32 da = depths[0], db = depths[1], dc = depths[2];
+		v2 ta = {}, tb = {}, tc = {};
+		if (uvs)
 		{
-			a3::Swap(&y1, &y2);
-			a3::Swap(&x1, &x2);
-			a3::Swap(&w1, &w2);
+			ta = uvs[0] * invW[0];
+			tb = uvs[1] * invW[1];
+			tc = uvs[2] * invW[2];
 		}
-
-		if (y3 < y1)
+		v4 la = {}, lb = {}, lc = {};
+		if (lights)
 		{
-			a3::Swap(&y1, &y3);
-			a3::Swap(&x1, &x3);
-			a3::Swap(&w1, &w3);
+			la = lights[0];
+			lb = lights[1];
+			lc = lights[2];
 		}
 
-		if (y3 < y2)
+		i32 fixedX[3], fixedY[3];
+		for (i32 i = 0; i < 3; ++i)
 		{
-			a3::Swap(&y2, &y3);
-			a3::Swap(&x2, &x3);
-			a3::Swap(&w2, &w3);
+			fixedX[i] = (i32)Floorf(points[i].x * (f32)A3_RASTER_SUBPIXEL_STEPS + 0.5f);
+			fixedY[i] = (i32)Floorf(points[i].y * (f32)A3_RASTER_SUBPIXEL_STEPS + 0.5f);
 		}
 
-		i32 dy1 = y2 - y1;
-		i32 dx1 = x2 - x1;
-		f32 dw1 = w2 - w1;
+		i64 area = (i64)(fixedX[1] - fixedX[0]) * (i64)(fixedY[2] - fixedY[0]) - (i64)(fixedY[1] - fixedY[0]) * (i64)(fixedX[2] - fixedX[0]);
+		if (area < 0)
+		{
+			a3::Swap(&fixedX[1], &fixedX[2]);
+			a3::Swap(&fixedY[1], &fixedY[2]);
+			a3::Swap(&db, &dc);
+			a3::Swap(&tb, &tc);
+			a3::Swap(&lb, &lc);
+			area = -area;
+		}
 
-		i32 dy2 = y3 - y1;
-		i32 dx2 = x3 - x1;
-		f32 dw2 = w3 - w1;
+		f32 invSteps = 1.0f / (f32)A3_RASTER_SUBPIXEL_STEPS;
+		for (i32 i = 0; i < 3; ++i)
+		{
+			tri->fixedX[i] = fixedX[i];
+			tri->fixedY[i] = fixedY[i];
+			tri->vertices[i] = v2{ (f32)fixedX[i] * invSteps, (f32)fixedY[i] * invSteps };
+		}
 
-		f32 tex_w;
+		tri->degenerate = (area == 0);
+		if (tri->degenerate) return;
 
-		f32 dax_step = 0.0f, dbx_step = 0.0f;
-		v2 dt1_step = {};
-		v2 dt2_step = {};
-		f32 dw1_step = 0.0f, dw2_step = 0.0f;
+		for (i32 i = 0; i < 3; ++i)
+		{
+			i32 p = (i + 1) % 3;
+			i32 q = (i + 2) % 3;
+			tri->edgeA[i] = fixedY[p] - fixedY[q];
+			tri->edgeB[i] = fixedX[q] - fixedX[p];
+			// NOTE(Zero): Top-left rule, pixel centers exactly on an edge belong to only one of the triangles sharing it
+			b32 inclusive = (tri->edgeA[i] > 0) || (tri->edgeA[i] == 0 && tri->edgeB[i] > 0);
+			tri->edgeBias[i] = inclusive ? 0 : -1;
+		}
 
-		if (dy1) dax_step = dx1 / (f32)Abs(dy1);
-		if (dy2) dbx_step = dx2 / (f32)Abs(dy2);
+		v2 v0 = tri->vertices[0], v1 = tri->vertices[1], v2p = tri->vertices[2];
+		f32 invArea = 1.0f / ((v1.x - v0.x) * (v2p.y - v0.y) - (v1.y - v0.y) * (v2p.x - v0.x));
+		tri->depth = da;
+		tri->depthMax = (da > db) ? da : db;
+		if (dc > tri->depthMax) tri->depthMax = dc;
+		tri->depthDx = ((db - da) * (v2p.y - v0.y) - (dc - da) * (v1.y - v0.y)) * invArea;
+		tri->depthDy = ((dc - da) * (v1.x - v0.x) - (db - da) * (v2p.x - v0.x)) * invArea;
+		tri->uv = ta;
+		tri->uvDx = ((tb - ta) * (v2p.y - v0.y) - (tc - ta) * (v1.y - v0.y)) * invArea;
+		tri->uvDy = ((tc - ta) * (v1.x - v0.x) - (tb - ta) * (v2p.x - v0.x)) * invArea;
+		tri->light = la;
+		tri->lightDx = ((lb - la) * (v2p.y - v0.y) - (lc - la) * (v1.y - v0.y)) * invArea;
+		tri->lightDy = ((lc - la) * (v1.x - v0.x) - (lb - la) * (v2p.x - v0.x)) * invArea;
+	}
 
-		if (dy1) dw1_step = dw1 / (f32)Abs(dy1);
+	// NOTE(Zero):
+	// Returns the range of pixels whose centers can be inside of the triangle, clamped to the frame buffer
+	// `margin` widens the test for samples that are away from the pixel centers
+	// Range is empty if the triangle does not cover any pixel center
+	static b32 a3_TrianglePixelBounds(const v2* vertices, i32 width, i32 height, f32 margin, i32* x0, i32* y0, i32* x1, i32* y1)
+	{
+		f32 minX = vertices[0].x, maxX = vertices[0].x;
+		f32 minY = vertices[0].y, maxY = vertices[0].y;
+		for (i32 i = 1; i < 3; ++i)
+		{
+			if (vertices[i].x < minX) minX = vertices[i].x;
+			if (vertices[i].x > maxX) maxX = vertices[i].x;
+			if (vertices[i].y < minY) minY = vertices[i].y;
+			if (vertices[i].y > maxY) maxY = vertices[i].y;
+		}
+		*x0 = (i32)Ceilf(minX - 0.5f - margin);
+		*y0 = (i32)Ceilf(minY - 0.5f - margin);
+		*x1 = (i32)Floorf(maxX - 0.5f + margin);
+		*y1 = (i32)Floorf(maxY - 0.5f + margin);
+		if (*x0 < 0) *x0 = 0;
+		if (*y0 < 0) *y0 = 0;
+		if (*x1 > width - 1) *x1 = width - 1;
+		if (*y1 > height - 1) *y1 = height - 1;
+		return (*x0 <= *x1) && (*y0 <= *y1);
+	}
 
-		if (dy2) dw2_step = dw2 / (f32)Abs(dy2);
+	void swapchain::BinChunk(raster_chunk* chunk)
+	{
+		u32 numTiles = (u32)(m_NumOfTilesX * m_NumOfTilesY);
+		u32* binOffsets = chunk->binOffsets;
+		f32 margin = m_Multisample ? (f32)A3_RASTER_SAMPLE_SPREAD / (f32)A3_RASTER_SUBPIXEL_STEPS : 0.0f;
+		for (u32 t = 0; t < numTiles; ++t)
+		{
+			binOffsets[t] = 0;
+		}
 
-		if (dy1)
+		// NOTE(Zero): Counts the triangles of each tile, then turns the counts into the start of each bin
+		u32 numIndices = 0;
+		for (u32 i = 0; i < chunk->numTriangles; ++i)
 		{
-			for (i32 i = y1; i <= y2; i++)
+			i32 x0, y0, x1, y1;
+			if (chunk->triangles[i].degenerate) continue;
+			if (!a3_TrianglePixelBounds(chunk->triangles[i].vertices, m_FrameBuffer->Width, m_FrameBuffer->Height, margin, &x0, &y0, &x1, &y1)) continue;
+			for (i32 ty = y0 / A3_RASTER_TILE_SIZE; ty <= y1 / A3_RASTER_TILE_SIZE; ++ty)
 			{
-				i32 ax = (i32)(x1 + (f32)(i - y1) * dax_step);
-				i32 bx = (i32)(x1 + (f32)(i - y1) * dbx_step);
-
-				f32 tex_sw = w1 + (f32)(i - y1) * dw1_step;
-
-				f32 tex_ew = w1 + (f32)(i - y1) * dw2_step;
-
-				if (ax > bx)
+				for (i32 tx = x0 / A3_RASTER_TILE_SIZE; tx <= x1 / A3_RASTER_TILE_SIZE; ++tx)
 				{
-					a3::Swap(&ax, &bx);
-					a3::Swap(&tex_sw, &tex_ew);
+					binOffsets[ty * m_NumOfTilesX + tx]++;
+					numIndices++;
 				}
+			}
+		}
+		u32 offset = 0;
+		for (u32 t = 0; t < numTiles; ++t)
+		{
+			u32 count = binOffsets[t];
+			binOffsets[t] = offset;
+			offset += count;
+		}
 
-				tex_w = tex_sw;
+		if (numIndices > chunk->binIndexCapacity)
+		{
+			chunk->binIndices = a3Realloc(chunk->binIndices, sizeof(u32) * numIndices, u32);
+			chunk->binIndexCapacity = numIndices;
+		}
 
-				f32 tstep = 1.0f / ((f32)(bx - ax));
-				f32 t = 0.0f;
+		// NOTE(Zero): Filling advances the start of each bin to its end, which is the start of the next bin
+		for (u32 i = 0; i < chunk->numTriangles; ++i)
+		{
+			i32 x0, y0, x1, y1;
+			if (chunk->triangles[i].degenerate) continue;
+			if (!a3_TrianglePixelBounds(chunk->triangles[i].vertices, m_FrameBuffer->Width, m_FrameBuffer->Height, margin, &x0, &y0, &x1, &y1)) continue;
+			for (i32 ty = y0 / A3_RASTER_TILE_SIZE; ty <= y1 / A3_RASTER_TILE_SIZE; ++ty)
+			{
+				for (i32 tx = x0 / A3_RASTER_TILE_SIZE; tx <= x1 / A3_RASTER_TILE_SIZE; ++tx)
+				{
+					chunk->binIndices[binOffsets[ty * m_NumOfTilesX + tx]++] = i;
+				}
+			}
+		}
+	}
 
-				for (i32 j = ax; j < bx; j++)
+	void swapchain::RasterizeTile(u32 tileIndex)
+	{
+		i32 x0 = ((i32)tileIndex % m_NumOfTilesX) * A3_RASTER_TILE_SIZE;
+		i32 y0 = ((i32)tileIndex / m_NumOfTilesX) * A3_RASTER_TILE_SIZE;
+		i32 x1 = x0 + A3_RASTER_TILE_SIZE - 1;
+		i32 y1 = y0 + A3_RASTER_TILE_SIZE - 1;
+		if (x1 > m_FrameBuffer->Width - 1) x1 = m_FrameBuffer->Width - 1;
+		if (y1 > m_FrameBuffer->Height - 1) y1 = m_FrameBuffer->Height - 1;
+
+		// NOTE(Zero): Bins are not filled when only outlines are drawn
+		if (m_RenderType != a3::RenderTriangle)
+		{
+			f32 tileDepth = QueryTileDepth(x0, y0, x1, y1);
+			for (u32 c = 0; c < m_NumOfFrameChunks; ++c)
+			{
+				raster_chunk* chunk = m_Chunks + c;
+				const raster_draw& draw = m_Draws[chunk->draw];
+				const texture* tex = draw.textureObj;
+				raster_shading shading = (m_RenderType == a3::RenderDepth) ? a3::ShadingDepth : (tex ? a3::ShadingTexture : a3::ShadingFlat);
+				rasterize_triangle_proc rasterize = s_RasterizeTriangle[shading][draw.lit ? 1 : 0][m_Multisample ? 1 : 0][m_DepthFormat];
+				u32 first = tileIndex ? chunk->binOffsets[tileIndex - 1] : 0;
+				u32 last = chunk->binOffsets[tileIndex];
+				for (u32 i = first; i < last; ++i)
 				{
-					tex_w = (1.0f - t) * tex_sw + t * tex_ew;
-					if (tex_w > m_DepthBuffer[i*m_FrameBuffer->Width + j])
+					if ((this->*rasterize)(chunk->triangles[chunk->binIndices[i]], tex, x0, y0, x1, y1, tileDepth))
 					{
-						a3::SetPixelColor(m_FrameBuffer, (f32)j + 0.5f, (f32)i + 0.5f, a3::color::White);
-						m_DepthBuffer[i*m_FrameBuffer->Width + j] = tex_w;
+						tileDepth = QueryTileDepth(x0, y0, x1, y1);
 					}
-					t += tstep;
 				}
-
 			}
 		}
 
-		dy1 = y3 - y2;
-		dx1 = x3 - x2;
-		dw1 = w3 - w2;
+		// NOTE(Zero): Depth only leaves the colors as they are, blocks that are still pending get cleared by the next color render
+		if (m_RenderType == a3::RenderDepth) return;
 
-		if (dy1) dax_step = dx1 / (f32)Abs(dy1);
-		if (dy2) dbx_step = dx2 / (f32)Abs(dy2);
-
-		v2 dut_step = {};
-		if (dy1) dw1_step = dw1 / (f32)Abs(dy1);
-
-		if (dy1)
+		for (i32 blockY = y0 / A3_RASTER_BLOCK_SIZE; blockY <= y1 / A3_RASTER_BLOCK_SIZE; ++blockY)
 		{
-			for (i32 i = y2; i <= y3; i++)
+			for (i32 blockX = x0 / A3_RASTER_BLOCK_SIZE; blockX <= x1 / A3_RASTER_BLOCK_SIZE; ++blockX)
 			{
-				i32 ax = (i32)(x2 + (f32)(i - y2) * dax_step);
-				i32 bx = (i32)(x1 + (f32)(i - y1) * dbx_step);
-
-				f32 tex_sw = w2 + (f32)(i - y2) * dw1_step;
-
-				f32 tex_ew = w1 + (f32)(i - y1) * dw2_step;
-
-				if (ax > bx)
+				if (m_Multisample)
 				{
-					a3::Swap(&ax, &bx);
-					a3::Swap(&tex_sw, &tex_ew);
+					ResolveBlock(blockX, blockY);
 				}
+				else if (m_BlockFlags[blockY * m_NumOfBlocksX + blockX] & BlockClearColor)
+				{
+					ClearBlock(blockX, blockY, BlockClearColor);
+				}
+			}
+		}
+	}
 
-				tex_w = tex_sw;
-
-				f32 tstep = 1.0f / ((f32)(bx - ax));
-				f32 t = 0.0f;
+	f32 swapchain::QueryTileDepth(i32 tileX0, i32 tileY0, i32 tileX1, i32 tileY1)
+	{
+		f32 result = m_BlockDepth[(tileY0 / A3_RASTER_BLOCK_SIZE) * m_NumOfBlocksX + tileX0 / A3_RASTER_BLOCK_SIZE];
+		for (i32 blockY = tileY0 / A3_RASTER_BLOCK_SIZE; blockY <= tileY1 / A3_RASTER_BLOCK_SIZE; ++blockY)
+		{
+			for (i32 blockX = tileX0 / A3_RASTER_BLOCK_SIZE; blockX <= tileX1 / A3_RASTER_BLOCK_SIZE; ++blockX)
+			{
+				f32 depth = m_BlockDepth[blockY * m_NumOfBlocksX + blockX];
+				if (depth < result) result = depth;
+			}
+		}
+		return result;
+	}
 
-				for (i32 j = ax; j < bx; j++)
+	void swapchain::ClearBlock(i32 blockX, i32 blockY, u32 flags)
+	{
+		i32 x0 = blockX * A3_RASTER_BLOCK_SIZE;
+		i32 y0 = blockY * A3_RASTER_BLOCK_SIZE;
+		i32 x1 = (x0 + A3_RASTER_BLOCK_SIZE < m_FrameBuffer->Width) ? x0 + A3_RASTER_BLOCK_SIZE : m_FrameBuffer->Width;
+		i32 y1 = (y0 + A3_RASTER_BLOCK_SIZE < m_FrameBuffer->Height) ? y0 + A3_RASTER_BLOCK_SIZE : m_FrameBuffer->Height;
+		i32 stride = m_FrameBuffer->Width;
+		if (m_Multisample)
+		{
+			const i32 samples = A3_RASTER_SAMPLE_COUNT;
+			for (i32 y = y0; y < y1; ++y)
+			{
+				u32* color = m_SampleColor + (y * stride + x0) * samples;
+				if (flags & BlockClearColor)
 				{
-					tex_w = (1.0f - t) * tex_sw + t * tex_ew;
-
-					if (tex_w > m_DepthBuffer[i*m_FrameBuffer->Width + j])
+					for (i32 i = 0; i < (x1 - x0) * samples; ++i)
+					{
+						color[i] = m_ClearColor;
+					}
+				}
+				if (flags & BlockClearDepth)
+				{
+					a3::MemorySet(m_SampleDepth + (y * stride + x0) * samples * m_DepthBytes, 0, (u64)((x1 - x0) * samples * m_DepthBytes));
+				}
+			}
+		}
+		else
+		{
+			if (flags & BlockClearColor)
+			{
+				u32* pixels = (u32*)m_FrameBuffer->Pixels;
+				for (i32 y = y0; y < y1; ++y)
+				{
+					for (i32 x = x0; x < x1; ++x)
 					{
-						a3::SetPixelColor(m_FrameBuffer, (f32)j + 0.5f, (f32)i + 0.5f, a3::color::White);
-						m_DepthBuffer[i*m_FrameBuffer->Width + j] = tex_w;
+						pixels[y * stride + x] = m_ClearColor;
 					}
-					t += tstep;
+				}
+			}
+			if (flags & BlockClearDepth)
+			{
+				for (i32 y = y0; y < y1; ++y)
+				{
+					a3::MemorySet(m_DepthBuffer + (y * stride + x0) * m_DepthBytes, 0, (u64)((x1 - x0) * m_DepthBytes));
 				}
 			}
 		}
+		m_BlockFlags[blockY * m_NumOfBlocksX + blockX] &= (u8)~flags;
 	}
 
-	void swapchain::ShadeTriangle(i32 x1, i32 y1, f32 w1, i32 x2, i32 y2, f32 w2, i32 x3, i32 y3, f32 w3, const v3& shade)
+	// NOTE(Zero):
+	// Averages the samples of each pixel of the block into the frame buffer, 2 pixels at a time in 16 bit lanes
+	// Blocks whose samples are still waiting to be cleared get the clear color and stay pending
+	void swapchain::ResolveBlock(i32 blockX, i32 blockY)
 	{
-		if (y2 < y1)
+		i32 x0 = blockX * A3_RASTER_BLOCK_SIZE;
+		i32 y0 = blockY * A3_RASTER_BLOCK_SIZE;
+		i32 x1 = (x0 + A3_RASTER_BLOCK_SIZE < m_FrameBuffer->Width) ? x0 + A3_RASTER_BLOCK_SIZE : m_FrameBuffer->Width;
+		i32 y1 = (y0 + A3_RASTER_BLOCK_SIZE < m_FrameBuffer->Height) ? y0 + A3_RASTER_BLOCK_SIZE : m_FrameBuffer->Height;
+		i32 stride = m_FrameBuffer->Width;
+		u32* pixels = (u32*)m_FrameBuffer->Pixels;
+
+		if (m_BlockFlags[blockY * m_NumOfBlocksX + blockX] & BlockClearColor)
 		{
-			a3::Swap(&y1, &y2);
-			a3::Swap(&x1, &x2);
-			a3::Swap(&w1, &w2);
+			for (i32 y = y0; y < y1; ++y)
+			{
+				for (i32 x = x0; x < x1; ++x)
+				{
+					pixels[y * stride + x] = m_ClearColor;
+				}
+			}
+			return;
 		}
 
-		if (y3 < y1)
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i round = _mm_set1_epi16(A3_RASTER_SAMPLE_COUNT / 2);
+		for (i32 y = y0; y < y1; ++y)
 		{
-			a3::Swap(&y1, &y3);
-			a3::Swap(&x1, &x3);
-			a3::Swap(&w1, &w3);
+			const u32* samples = m_SampleColor + (y * stride + x0) * A3_RASTER_SAMPLE_COUNT;
+			u32* row = pixels + y * stride;
+			i32 x = x0;
+			for (; x + 1 < x1; x += 2)
+			{
+				__m128i p0 = _mm_loadu_si128((const __m128i*)samples);
+				__m128i p1 = _mm_loadu_si128((const __m128i*)(samples + A3_RASTER_SAMPLE_COUNT));
+				__m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(p0, zero), _mm_unpackhi_epi8(p0, zero));
+				__m128i s1 = _mm_add_epi16(_mm_unpacklo_epi8(p1, zero), _mm_unpackhi_epi8(p1, zero));
+				__m128i sum = _mm_add_epi16(_mm_unpacklo_epi64(s0, s1), _mm_unpackhi_epi64(s0, s1));
+				sum = _mm_srli_epi16(_mm_add_epi16(sum, round), 2);
+				_mm_storel_epi64((__m128i*)(row + x), _mm_packus_epi16(sum, sum));
+				samples += 2 * A3_RASTER_SAMPLE_COUNT;
+			}
+			if (x < x1)
+			{
+				__m128i p0 = _mm_loadu_si128((const __m128i*)samples);
+				__m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(p0, zero), _mm_unpackhi_epi8(p0, zero));
+				__m128i sum = _mm_add_epi16(s0, _mm_srli_si128(s0, 8));
+				sum = _mm_srli_epi16(_mm_add_epi16(sum, round), 2);
+				row[x] = (u32)_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+			}
 		}
+	}
 
-		if (y3 < y2)
+	// NOTE(Zero):
+	// Texture of the triangle being drawn and screen space gradients of u/w, v/w and 1/w, the gradients of
+	// u and v themselves follow from the quotient rule, e.g. du/dx = (d(u/w)/dx - u * d(1/w)/dx) * w
+	struct a3_raster_texture
+	{
+		const a3::texture* Texture;
+		__m128 UDx, UDy;
+		__m128 VDx, VDy;
+		__m128 WDx, WDy;
+		__m128 Width, Height;
+		__m128 InvDepthScale, DepthBias, WBias;
+	};
+
+	// NOTE(Zero):
+	// Trilinear samples of 4 pixels, `u` and `v` are divided by w and 1/w comes from `depth` so the coordinates are perspective correct
+	// Level of each pixel comes from its own derivatives
+	static inline __m128i a3_SampleTexture4(const a3_raster_texture* raster, __m128 depth, __m128 u, __m128 v)
+	{
+		__m128 invW = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(depth, raster->DepthBias), raster->InvDepthScale), raster->WBias);
+		__m128 w = _mm_div_ps(_mm_set1_ps(1.0f), invW);
+		u = _mm_mul_ps(u, w);
+		v = _mm_mul_ps(v, w);
+
+		__m128 dudx = _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(raster->UDx, _mm_mul_ps(u, raster->WDx)), w), raster->Width);
+		__m128 dvdx = _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(raster->VDx, _mm_mul_ps(v, raster->WDx)), w), raster->Height);
+		__m128 dudy = _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(raster->UDy, _mm_mul_ps(u, raster->WDy)), w), raster->Width);
+		__m128 dvdy = _mm_mul_ps(_mm_mul_ps(_mm_sub_ps(raster->VDy, _mm_mul_ps(v, raster->WDy)), w), raster->Height);
+		__m128 rho = _mm_max_ps(_mm_add_ps(_mm_mul_ps(dudx, dudx), _mm_mul_ps(dvdx, dvdx)), _mm_add_ps(_mm_mul_ps(dudy, dudy), _mm_mul_ps(dvdy, dvdy)));
+		// NOTE(Zero): Same approximation of log2 as `QueryTextureLevel`, `max` also turns NaN into level 0
+		rho = _mm_max_ps(rho, _mm_set1_ps(1.0f));
+		__m128 level = _mm_mul_ps(_mm_set1_ps(0.5f), _mm_sub_ps(_mm_mul_ps(_mm_cvtepi32_ps(_mm_castps_si128(rho)), _mm_set1_ps(1.0f / 8388608.0f)), _mm_set1_ps(127.0f)));
+		return a3::SampleTextureTrilinear4(raster->Texture, u, v, level);
+	}
+
+	// NOTE(Zero): Values of 4 pixels of a row, texture coordinates and the position in the clip space of the light are divided by w
+	struct a3_raster_quad
+	{
+		__m128 Depth;
+		__m128 U, V;
+		__m128 LightX, LightY, LightZ, LightW;
+	};
+
+	// NOTE(Zero): Shadow map and lighting of the triangle being drawn, `Map` is null when there are no shadows
+	struct a3_raster_light
+	{
+		const f32* Map;
+		i32 Width;
+		i32 Height;
+		f32 Bias;
+		__m128 Ambient;
+		__m128 Diffuse;
+	};
+
+	// NOTE(Zero):
+	// Fraction of the light that reaches 4 pixels, percentage closer filtering of the 2x2 texels around their
+	// position in the shadow map which are weighted bilinearly, the map is mapped to pixels like the frame buffer
+	// Pixels outside of the map are lit, the taps are gathered one pixel at a time
+	static inline __m128 a3_SampleShadow4(const a3_raster_light* light, const a3_raster_quad& quad)
+	{
+		if (!light->Map) return _mm_set1_ps(1.0f);
+
+		__m128 invW = _mm_div_ps(_mm_set1_ps(1.0f), quad.LightW);
+		__m128 half = _mm_set1_ps(0.5f);
+		__m128 x = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(quad.LightX, invW), _mm_set1_ps(1.0f)), _mm_set1_ps(0.5f * (f32)(light->Width - 1))), half);
+		__m128 y = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(_mm_mul_ps(quad.LightY, invW), _mm_set1_ps(1.0f)), _mm_set1_ps(0.5f * (f32)(light->Height - 1))), half);
+		__m128 depth = _mm_sub_ps(_mm_set1_ps(0.5f + light->Bias), _mm_mul_ps(_mm_mul_ps(quad.LightZ, invW), half));
+
+		alignas(16) f32 xs[4];
+		alignas(16) f32 ys[4];
+		alignas(16) f32 depths[4];
+		alignas(16) f32 result[4];
+		_mm_store_ps(xs, x);
+		_mm_store_ps(ys, y);
+		_mm_store_ps(depths, depth);
+		for (i32 i = 0; i < 4; ++i)
 		{
-			a3::Swap(&y2, &y3);
-			a3::Swap(&x2, &x3);
-			a3::Swap(&w2, &w3);
+			// NOTE(Zero): Written so NaN is outside too
+			if (!(xs[i] > -1.0f && xs[i] < (f32)light->Width && ys[i] > -1.0f && ys[i] < (f32)light->Height))
+			{
+				result[i] = 1.0f;
+				continue;
+			}
+			f32 fx = Floorf(xs[i]);
+			f32 fy = Floorf(ys[i]);
+			i32 tx = (i32)fx;
+			i32 ty = (i32)fy;
+			f32 taps[4];
+			for (i32 t = 0; t < 4; ++t)
+			{
+				i32 px = tx + (t & 1);
+				i32 py = ty + (t >> 1);
+				b32 inside = (px >= 0 && px < light->Width && py >= 0 && py < light->Height);
+				f32 occluder = inside ? light->Map[py * light->Width + px] : 0.0f;
+				taps[t] = (depths[i] >= occluder) ? 1.0f : 0.0f;
+			}
+			f32 ax = xs[i] - fx;
+			f32 ay = ys[i] - fy;
+			f32 top = taps[0] + (taps[1] - taps[0]) * ax;
+			f32 bottom = taps[2] + (taps[3] - taps[2]) * ax;
+			result[i] = top + (bottom - top) * ay;
 		}
+		return _mm_load_ps(result);
+	}
+
+	// NOTE(Zero): Scales the color channels of 4 pixels by `intensity` in [0, 1] in 8.8 fixed point, alpha is kept
+	static inline __m128i a3_ModulateColor4(__m128i colors, __m128 intensity)
+	{
+		__m128i factor = _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(intensity, _mm_set1_ps(1.0f)), _mm_set1_ps(256.0f)));
+		factor = _mm_packs_epi32(factor, factor);
+		factor = _mm_unpacklo_epi16(factor, factor);
+		__m128i alphaMask = _mm_setr_epi16(0, 0, 0, -1, 0, 0, 0, -1);
+		__m128i alpha = _mm_and_si128(alphaMask, _mm_set1_epi16(256));
+		__m128i factorLo = _mm_or_si128(_mm_andnot_si128(alphaMask, _mm_unpacklo_epi32(factor, factor)), alpha);
+		__m128i factorHi = _mm_or_si128(_mm_andnot_si128(alphaMask, _mm_unpackhi_epi32(factor, factor)), alpha);
+		__m128i zero = _mm_setzero_si128();
+		__m128i lo = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(colors, zero), factorLo), 8);
+		__m128i hi = _mm_srli_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(colors, zero), factorHi), 8);
+		return _mm_packus_epi16(lo, hi);
+	}
+
+	// NOTE(Zero): Colors of 4 pixels that pass the depth test, never called for depth only
+	template <a3::raster_shading shading, b32 lit>
+	static inline __m128i a3_ShadeQuad(__m128i shade, const a3_raster_texture* texture, const a3_raster_light* light, const a3_raster_quad& quad)
+	{
+		__m128i colors = (shading == a3::ShadingTexture) ? a3_SampleTexture4(texture, quad.Depth, quad.U, quad.V) : shade;
+		if (lit)
+		{
+			__m128 intensity = _mm_add_ps(light->Ambient, _mm_mul_ps(light->Diffuse, a3_SampleShadow4(light, quad)));
+			colors = a3_ModulateColor4(colors, intensity);
+		}
+		return colors;
+	}
+
+	// NOTE(Zero):
+	// Depth values are tested as 32 bit integers, floats are never negative in the buffer so their bits
+	// are in the same order as the values, unorm values are rounded and 16 bit ones are widened
+	template <a3::depth_format format>
+	static inline __m128i a3_QuantizeDepth4(__m128 depth)
+	{
+		if (format == a3::DepthUnorm24) return _mm_cvtps_epi32(_mm_mul_ps(depth, _mm_set1_ps(16777215.0f)));
+		if (format == a3::DepthUnorm16) return _mm_cvtps_epi32(_mm_mul_ps(depth, _mm_set1_ps(65535.0f)));
+		return _mm_castps_si128(depth);
+	}
+
+	template <a3::depth_format format>
+	static inline f32 a3_DepthToFloat(i32 value)
+	{
+		if (format == a3::DepthUnorm24) return (f32)value * (1.0f / 16777215.0f);
+		if (format == a3::DepthUnorm16) return (f32)value * (1.0f / 65535.0f);
+		f32 result;
+		a3::MemoryCopy(&result, &value, sizeof(result));
+		return result;
+	}
+
+	template <a3::depth_format format>
+	static inline __m128i a3_LoadDepth4(const u8* depth)
+	{
+		if (format == a3::DepthUnorm16) return _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i*)depth), _mm_setzero_si128());
+		return _mm_loadu_si128((const __m128i*)depth);
+	}
+
+	// NOTE(Zero): SSE2 only packs to signed 16 bits, so values are moved to the signed range and back
+	template <a3::depth_format format>
+	static inline void a3_StoreDepth4(u8* depth, __m128i values)
+	{
+		if (format == a3::DepthUnorm16)
+		{
+			__m128i biased = _mm_sub_epi32(values, _mm_set1_epi32(32768));
+			__m128i packed = _mm_xor_si128(_mm_packs_epi32(biased, biased), _mm_set1_epi16(-32768));
+			_mm_storel_epi64((__m128i*)depth, packed);
+			return;
+		}
+		_mm_storeu_si128((__m128i*)depth, values);
+	}
+
+	template <a3::depth_format format>
+	static inline i32 a3_LoadDepth(const u8* depth, i32 index)
+	{
+		if (format == a3::DepthUnorm16) return ((const u16*)depth)[index];
+		return ((const i32*)depth)[index];
+	}
 
-		i32 dy1 = y2 - y1;
-		i32 dx1 = x2 - x1;
-		f32 dw1 = w2 - w1;
+	template <a3::depth_format format>
+	static inline void a3_StoreDepth(u8* depth, i32 index, i32 value)
+	{
+		if (format == a3::DepthUnorm16) ((u16*)depth)[index] = (u16)((value < 65535) ? value : 65535);
+		else ((i32*)depth)[index] = value;
+	}
 
-		i32 dy2 = y3 - y1;
-		i32 dx2 = x3 - x1;
-		f32 dw2 = w3 - w1;
+	// NOTE(Zero): SSE2 has no 32 bit integer minimum
+	static inline __m128i a3_MinDepth4(__m128i a, __m128i b)
+	{
+		__m128i greater = _mm_cmpgt_epi32(a, b);
+		return _mm_or_si128(_mm_and_si128(greater, b), _mm_andnot_si128(greater, a));
+	}
 
-		f32 tex_w;
+	// NOTE(Zero):
+	// Depth tests 4 pixels of a row and writes color and depth of the ones in `coverage` that pass,
+	// `count` is less than 4 only at the right edge of frame buffer, those pixels are written one by one
+	// `farthest` accumulates the stored depth values of the pixels after the test, for the block depth
+	// Colors are only computed if any of the pixels pass, depth only does not touch them at all
+	template <a3::raster_shading shading, b32 lit, a3::depth_format format>
+	static inline void a3_RasterShadeQuad(u32* color, u8* depth, __m128i coverage, const a3_raster_quad& quad, __m128i shade, const a3_raster_texture* texture, const a3_raster_light* light, i32 count, __m128i* farthest)
+	{
+		__m128i values = a3_QuantizeDepth4<format>(quad.Depth);
+		if (count < 4)
+		{
+			alignas(16) u32 mask[4];
+			alignas(16) i32 newDepth[4];
+			alignas(16) u32 colors[4];
+			_mm_store_si128((__m128i*)mask, coverage);
+			_mm_store_si128((__m128i*)newDepth, values);
+			if (shading != a3::ShadingDepth) _mm_store_si128((__m128i*)colors, a3_ShadeQuad<shading, lit>(shade, texture, light, quad));
+			for (i32 i = 0; i < count; ++i)
+			{
+				i32 oldDepth = a3_LoadDepth<format>(depth, i);
+				if (mask[i] && newDepth[i] > oldDepth)
+				{
+					oldDepth = newDepth[i];
+					a3_StoreDepth<format>(depth, i, oldDepth);
+					if (shading != a3::ShadingDepth) color[i] = colors[i];
+				}
+				*farthest = a3_MinDepth4(*farthest, _mm_set1_epi32(oldDepth));
+			}
+			return;
+		}
 
-		f32 dax_step = 0.0f, dbx_step = 0.0f;
-		v2 dt1_step = {};
-		v2 dt2_step = {};
-		f32 dw1_step = 0.0f, dw2_step = 0.0f;
+		__m128i oldDepth = a3_LoadDepth4<format>(depth);
+		__m128i passBits = _mm_and_si128(_mm_cmpgt_epi32(values, oldDepth), coverage);
+		i32 passMask = _mm_movemask_ps(_mm_castsi128_ps(passBits));
+		if (!passMask)
+		{
+			*farthest = a3_MinDepth4(*farthest, oldDepth);
+			return;
+		}
+		if (passMask == 0xf)
+		{
+			a3_StoreDepth4<format>(depth, values);
+			if (shading != a3::ShadingDepth) _mm_storeu_si128((__m128i*)color, a3_ShadeQuad<shading, lit>(shade, texture, light, quad));
+			*farthest = a3_MinDepth4(*farthest, values);
+			return;
+		}
+		__m128i newDepth = _mm_or_si128(_mm_and_si128(passBits, values), _mm_andnot_si128(passBits, oldDepth));
+		a3_StoreDepth4<format>(depth, newDepth);
+		if (shading != a3::ShadingDepth)
+		{
+			shade = a3_ShadeQuad<shading, lit>(shade, texture, light, quad);
+			__m128i oldColor = _mm_loadu_si128((__m128i*)color);
+			_mm_storeu_si128((__m128i*)color, _mm_or_si128(_mm_and_si128(passBits, shade), _mm_andnot_si128(passBits, oldColor)));
+		}
+		*farthest = a3_MinDepth4(*farthest, newDepth);
+	}
 
-		if (dy1) dax_step = dx1 / (f32)Abs(dy1);
-		if (dy2) dbx_step = dx2 / (f32)Abs(dy2);
+	// NOTE(Zero): Rotated grid positions of the samples in subpixels from the pixel center
+	static const i32 a3_SamplePositions[A3_RASTER_SAMPLE_COUNT][2] = { { -2, -6 }, { 6, -2 }, { -6, 2 }, { 2, 6 } };
 
-		if (dy1) dw1_step = dw1 / (f32)Abs(dy1);
+	// NOTE(Zero):
+	// Multisampled version of `a3_RasterShadeQuad`, `coverage` has the samples of each pixel and the depth of `quad`
+	// is at the pixel centers which is moved to the samples by `sampleDepth`
+	// Colors are computed once for the 4 pixels and only if any of their samples pass the depth test
+	template <a3::raster_shading shading, b32 lit, a3::depth_format format>
+	static inline void a3_RasterShadeQuadSamples(u32* color, u8* depth, const __m128i* coverage, const a3_raster_quad& quad, __m128 sampleDepth, __m128i shade, const a3_raster_texture* texture, const a3_raster_light* light, i32 count, __m128i* farthest)
+	{
+		const i32 samples = A3_RASTER_SAMPLE_COUNT;
+		const i32 depthBytes = (format == a3::DepthUnorm16) ? (i32)sizeof(u16) : (i32)sizeof(u32);
+		alignas(16) f32 centers[4];
+		_mm_store_ps(centers, quad.Depth);
+
+		__m128i values[4], oldDepth[4], pass[4];
+		i32 passMask = 0;
+		for (i32 i = 0; i < count; ++i)
+		{
+			values[i] = a3_QuantizeDepth4<format>(_mm_add_ps(_mm_set1_ps(centers[i]), sampleDepth));
+			oldDepth[i] = a3_LoadDepth4<format>(depth + i * samples * depthBytes);
+			pass[i] = _mm_and_si128(_mm_cmpgt_epi32(values[i], oldDepth[i]), coverage[i]);
+			passMask |= _mm_movemask_ps(_mm_castsi128_ps(pass[i]));
+		}
+		if (!passMask)
+		{
+			for (i32 i = 0; i < count; ++i)
+			{
+				*farthest = a3_MinDepth4(*farthest, oldDepth[i]);
+			}
+			return;
+		}
 
-		if (dy2) dw2_step = dw2 / (f32)Abs(dy2);
+		alignas(16) u32 colors[4];
+		if (shading != a3::ShadingDepth) _mm_store_si128((__m128i*)colors, a3_ShadeQuad<shading, lit>(shade, texture, light, quad));
+		for (i32 i = 0; i < count; ++i)
+		{
+			__m128i newDepth = _mm_or_si128(_mm_and_si128(pass[i], values[i]), _mm_andnot_si128(pass[i], oldDepth[i]));
+			a3_StoreDepth4<format>(depth + i * samples * depthBytes, newDepth);
+			if (shading != a3::ShadingDepth)
+			{
+				__m128i oldColor = _mm_loadu_si128((__m128i*)(color + i * samples));
+				_mm_storeu_si128((__m128i*)(color + i * samples), _mm_or_si128(_mm_and_si128(pass[i], _mm_set1_epi32((i32)colors[i])), _mm_andnot_si128(pass[i], oldColor)));
+			}
+			*farthest = a3_MinDepth4(*farthest, newDepth);
+		}
+	}
 
-		if (dy1)
+	// NOTE(Zero):
+	// Half-space rasterization, a pixel is covered if its center is inside all three edges
+	// Edge values are exact integers, they are computed in 64 bits at the corner of each block and
+	// stepped in 32 bits inside of the block, values are clamped since only the sign matters there
+	// Depth is reversed, larger value is nearer, triangles and blocks nearest depth of which is not nearer than
+	// the farthest depth of the tile or block are skipped
+	// With multisampling the edges and depth are evaluated at the samples, blocks are tested with their
+	// bounds widened by the sample spread
+	// Depth only only clears the depth of the blocks it touches and never reads or writes a color
+	// Returns true if the farthest depth of any block is changed
+	template <raster_shading shading, b32 lit, b32 multisample, depth_format format>
+	b32 swapchain::RasterizeTriangle(const raster_triangle& tri, const texture* tex, i32 tileX0, i32 tileY0, i32 tileX1, i32 tileY1, f32 tileDepth)
+	{
+		if (tri.depthMax <= tileDepth) return false;
+
+		const b32 textured = (shading == a3::ShadingTexture);
+		const b32 depthOnly = (shading == a3::ShadingDepth);
+		const u8 clearFlags = depthOnly ? (u8)BlockClearDepth : (u8)(BlockClearColor | BlockClearDepth);
+
+		const i32 spread = A3_RASTER_SAMPLE_SPREAD;
+		const f32 margin = multisample ? (f32)spread / (f32)A3_RASTER_SUBPIXEL_STEPS : 0.0f;
+		i32 x0, y0, x1, y1;
+		if (!a3_TrianglePixelBounds(tri.vertices, m_FrameBuffer->Width, m_FrameBuffer->Height, margin, &x0, &y0, &x1, &y1)) return false;
+		if (x0 < tileX0) x0 = tileX0;
+		if (y0 < tileY0) y0 = tileY0;
+		if (x1 > tileX1) x1 = tileX1;
+		if (y1 > tileY1) y1 = tileY1;
+		if (x0 > x1 || y0 > y1) return false;
+
+		b32 depthChanged = false;
+
+		const i32 block = A3_RASTER_BLOCK_SIZE;
+		const i32 steps = A3_RASTER_SUBPIXEL_STEPS;
+		const i64 clampValue = (i64)1 << 30;
+
+		i32 stride = m_FrameBuffer->Width;
+		u32* pixels = (u32*)m_FrameBuffer->Pixels;
+		__m128i shade = _mm_set1_epi32((i32)tri.color);
+		__m128 laneIndexF = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+		__m128 depthStep = _mm_set1_ps(4.0f * tri.depthDx);
+		a3_raster_texture raster;
+		const a3_raster_texture* texture = A3NULL;
+		const i32 depthBytes = (format == a3::DepthUnorm16) ? (i32)sizeof(u16) : (i32)sizeof(u32);
+		if (textured)
 		{
-			for (i32 i = y1; i <= y2; i++)
+			raster.Texture = tex;
+			raster.UDx = _mm_set1_ps(tri.uvDx.u);
+			raster.UDy = _mm_set1_ps(tri.uvDy.u);
+			raster.VDx = _mm_set1_ps(tri.uvDx.v);
+			raster.VDy = _mm_set1_ps(tri.uvDy.v);
+			if (m_Orthographic)
+			{
+				// NOTE(Zero): 1/w is 1 everywhere, depth does not carry it
+				raster.WDx = raster.WDy = _mm_setzero_ps();
+				raster.InvDepthScale = raster.DepthBias = _mm_setzero_ps();
+				raster.WBias = _mm_set1_ps(1.0f);
+			}
+			else
 			{
-				i32 ax = (i32)(x1 + (f32)(i - y1) * dax_step);
-				i32 bx = (i32)(x1 + (f32)(i - y1) * dbx_step);
+				raster.WDx = _mm_set1_ps(tri.depthDx / m_DepthScale);
+				raster.WDy = _mm_set1_ps(tri.depthDy / m_DepthScale);
+				raster.InvDepthScale = _mm_set1_ps(1.0f / m_DepthScale);
+				raster.DepthBias = _mm_set1_ps(m_DepthBias);
+				raster.WBias = _mm_setzero_ps();
+			}
+			raster.Width = _mm_set1_ps((f32)tex->Width);
+			raster.Height = _mm_set1_ps((f32)tex->Height);
+			texture = &raster;
+		}
+		__m128 uStep = _mm_set1_ps(4.0f * tri.uvDx.u);
+		__m128 vStep = _mm_set1_ps(4.0f * tri.uvDx.v);
 
-				f32 tex_sw = w1 + (f32)(i - y1) * dw1_step;
+		a3_raster_light lightState;
+		const a3_raster_light* light = A3NULL;
+		__m128 lightStep[4];
+		if (lit)
+		{
+			lightState.Map = m_ShadowMap ? m_ShadowMap->Depth : A3NULL;
+			lightState.Width = m_ShadowMap ? m_ShadowMap->Width : 0;
+			lightState.Height = m_ShadowMap ? m_ShadowMap->Height : 0;
+			f32 slopeBias = m_ShadowMap ? m_ShadowMap->SlopeBias * tri.shadowSlope : 0.0f;
+			if (slopeBias > A3_RASTER_SHADOW_MAX_SLOPE_BIAS) slopeBias = A3_RASTER_SHADOW_MAX_SLOPE_BIAS;
+			lightState.Bias = m_ShadowMap ? m_ShadowMap->Bias + slopeBias : 0.0f;
+			lightState.Ambient = _mm_set1_ps(tri.ambient);
+			lightState.Diffuse = _mm_set1_ps(tri.diffuse);
+			light = &lightState;
+			for (i32 k = 0; k < 4; ++k)
+			{
+				lightStep[k] = _mm_set1_ps(4.0f * tri.lightDx.values[k]);
+			}
+		}
 
-				f32 tex_ew = w1 + (f32)(i - y1) * dw2_step;
+		// NOTE(Zero): Offsets from the first pixel center of a block to the corners that maximize and minimize each edge
+		i64 maxOffset[3], minOffset[3];
+		for (i32 e = 0; e < 3; ++e)
+		{
+			i64 a = (i64)tri.edgeA[e] * steps * (block - 1);
+			i64 b = (i64)tri.edgeB[e] * steps * (block - 1);
+			maxOffset[e] = ((a > 0) ? a : 0) + ((b > 0) ? b : 0);
+			minOffset[e] = ((a < 0) ? a : 0) + ((b < 0) ? b : 0);
+			if (multisample)
+			{
+				i64 sampleOffset = ((i64)((tri.edgeA[e] > 0) ? tri.edgeA[e] : -tri.edgeA[e]) + (i64)((tri.edgeB[e] > 0) ? tri.edgeB[e] : -tri.edgeB[e])) * spread;
+				maxOffset[e] += sampleOffset;
+				minOffset[e] -= sampleOffset;
+			}
+		}
 
-				if (ax > bx)
+		// NOTE(Zero): Edge and depth values of the samples relative to the pixel center
+		__m128i sampleEdge[3];
+		__m128 sampleDepth = _mm_setzero_ps();
+		if (multisample)
+		{
+			alignas(16) i32 offsets[A3_RASTER_SAMPLE_COUNT];
+			alignas(16) f32 depths[A3_RASTER_SAMPLE_COUNT];
+			for (i32 e = 0; e < 3; ++e)
+			{
+				for (i32 i = 0; i < A3_RASTER_SAMPLE_COUNT; ++i)
 				{
-					a3::Swap(&ax, &bx);
-					a3::Swap(&tex_sw, &tex_ew);
+					offsets[i] = tri.edgeA[e] * a3_SamplePositions[i][0] + tri.edgeB[e] * a3_SamplePositions[i][1];
 				}
+				sampleEdge[e] = _mm_load_si128((const __m128i*)offsets);
+			}
+			for (i32 i = 0; i < A3_RASTER_SAMPLE_COUNT; ++i)
+			{
+				depths[i] = (tri.depthDx * (f32)a3_SamplePositions[i][0] + tri.depthDy * (f32)a3_SamplePositions[i][1]) / (f32)steps;
+			}
+			sampleDepth = _mm_load_ps(depths);
+		}
 
-				tex_w = tex_sw;
+		for (i32 by = y0 & ~(block - 1); by <= y1; by += block)
+		{
+			for (i32 bx = x0 & ~(block - 1); bx <= x1; bx += block)
+			{
+				i64 corner[3];
+				b32 rejected = false;
+				b32 accepted = true;
+				for (i32 e = 0; e < 3; ++e)
+				{
+					i32 p = (e + 1) % 3;
+					i64 px = (i64)bx * steps + steps / 2 - tri.fixedX[p];
+					i64 py = (i64)by * steps + steps / 2 - tri.fixedY[p];
+					corner[e] = (i64)tri.edgeA[e] * px + (i64)tri.edgeB[e] * py + tri.edgeBias[e];
+					if (corner[e] + maxOffset[e] < 0) rejected = true;
+					if (corner[e] + minOffset[e] < 0) accepted = false;
+				}
+				if (rejected) continue;
+
+				i32 rowEnd = (by + block - 1 < m_FrameBuffer->Height - 1) ? by + block - 1 : m_FrameBuffer->Height - 1;
+				i32 rowCount = rowEnd - by + 1;
+				i32 columnCount = (bx + block <= stride) ? block : stride - bx;
+
+				f32 offsetX = (f32)bx + 0.5f - tri.vertices[0].x;
+				f32 offsetY = (f32)by + 0.5f - tri.vertices[0].y;
+				f32 depthRow = tri.depth + tri.depthDx * offsetX + tri.depthDy * offsetY;
+				v2 uvRow = {};
+				if (textured) uvRow = tri.uv + tri.uvDx * offsetX + tri.uvDy * offsetY;
+				v4 lightRow = {};
+				if (lit) lightRow = tri.light + tri.lightDx * offsetX + tri.lightDy * offsetY;
+
+				i32 blockIndex = (by / block) * m_NumOfBlocksX + bx / block;
+				f32 blockDepthMax = depthRow;
+				if (tri.depthDx > 0.0f) blockDepthMax += tri.depthDx * (f32)(columnCount - 1);
+				if (tri.depthDy > 0.0f) blockDepthMax += tri.depthDy * (f32)(rowCount - 1);
+				if (multisample) blockDepthMax += (FAbsf(tri.depthDx) + FAbsf(tri.depthDy)) * margin;
+				if (blockDepthMax > tri.depthMax) blockDepthMax = tri.depthMax;
+				if (blockDepthMax <= m_BlockDepth[blockIndex]) continue;
+
+				u32 flags = m_BlockFlags[blockIndex] & clearFlags;
+				if (flags)
+				{
+					ClearBlock(bx / block, by / block, flags);
+				}
+				// NOTE(Zero): Every pixel of the block is visited below so the farthest depth comes for free
+				__m128i farthest = _mm_set1_epi32(0x7fffffff);
 
-				f32 tstep = 1.0f / ((f32)(bx - ax));
-				f32 t = 0.0f;
+				__m128i edgeRow[3], edgeStepX[3], edgeStepY[3];
+				for (i32 e = 0; e < 3; ++e)
+				{
+					i64 value = corner[e];
+					if (value > clampValue) value = clampValue;
+					if (value < -clampValue) value = -clampValue;
+					i32 stepX = tri.edgeA[e] * steps;
+					edgeRow[e] = _mm_add_epi32(_mm_set1_epi32((i32)value), _mm_set_epi32(3 * stepX, 2 * stepX, stepX, 0));
+					edgeStepX[e] = _mm_set1_epi32(4 * stepX);
+					edgeStepY[e] = _mm_set1_epi32(tri.edgeB[e] * steps);
+				}
 
-				for (i32 j = ax; j < bx; j++)
+				for (i32 row = 0; row < rowCount; ++row)
 				{
-					tex_w = (1.0f - t) * tex_sw + t * tex_ew;
-					if (tex_w > m_DepthBuffer[i*m_FrameBuffer->Width + j])
+					i32 rowIndex = (by + row) * stride + bx;
+					u32* colorRow = A3NULL;
+					if (!depthOnly) colorRow = multisample ? m_SampleColor + rowIndex * A3_RASTER_SAMPLE_COUNT : pixels + rowIndex;
+					u8* depthBuffer = multisample ? m_SampleDepth + rowIndex * A3_RASTER_SAMPLE_COUNT * depthBytes : m_DepthBuffer + rowIndex * depthBytes;
+					a3_raster_quad quad;
+					quad.Depth = _mm_add_ps(_mm_set1_ps(depthRow), _mm_mul_ps(_mm_set1_ps(tri.depthDx), laneIndexF));
+					quad.U = _mm_add_ps(_mm_set1_ps(uvRow.u), _mm_mul_ps(_mm_set1_ps(tri.uvDx.u), laneIndexF));
+					quad.V = _mm_add_ps(_mm_set1_ps(uvRow.v), _mm_mul_ps(_mm_set1_ps(tri.uvDx.v), laneIndexF));
+					if (lit)
+					{
+						quad.LightX = _mm_add_ps(_mm_set1_ps(lightRow.x), _mm_mul_ps(_mm_set1_ps(tri.lightDx.x), laneIndexF));
+						quad.LightY = _mm_add_ps(_mm_set1_ps(lightRow.y), _mm_mul_ps(_mm_set1_ps(tri.lightDx.y), laneIndexF));
+						quad.LightZ = _mm_add_ps(_mm_set1_ps(lightRow.z), _mm_mul_ps(_mm_set1_ps(tri.lightDx.z), laneIndexF));
+						quad.LightW = _mm_add_ps(_mm_set1_ps(lightRow.w), _mm_mul_ps(_mm_set1_ps(tri.lightDx.w), laneIndexF));
+					}
+					__m128i e0 = edgeRow[0], e1 = edgeRow[1], e2 = edgeRow[2];
+					for (i32 column = 0; column < columnCount; column += 4)
 					{
-						a3::SetPixelColor(m_FrameBuffer, (f32)j + 0.5f, (f32)i + 0.5f, shade);
-						m_DepthBuffer[i*m_FrameBuffer->Width + j] = tex_w;
+						i32 count = (columnCount - column < 4) ? columnCount - column : 4;
+						if (multisample)
+						{
+							__m128i coverage[4];
+							if (accepted)
+							{
+								coverage[0] = coverage[1] = coverage[2] = coverage[3] = _mm_set1_epi32(-1);
+							}
+							else
+							{
+								alignas(16) i32 edges[3][4];
+								_mm_store_si128((__m128i*)edges[0], e0);
+								_mm_store_si128((__m128i*)edges[1], e1);
+								_mm_store_si128((__m128i*)edges[2], e2);
+								for (i32 i = 0; i < count; ++i)
+								{
+									__m128i sampleEdges = _mm_or_si128(_mm_or_si128(_mm_add_epi32(_mm_set1_epi32(edges[0][i]), sampleEdge[0]),
+										_mm_add_epi32(_mm_set1_epi32(edges[1][i]), sampleEdge[1])), _mm_add_epi32(_mm_set1_epi32(edges[2][i]), sampleEdge[2]));
+									coverage[i] = _mm_cmpgt_epi32(sampleEdges, _mm_set1_epi32(-1));
+								}
+							}
+							i32 offset = column * A3_RASTER_SAMPLE_COUNT;
+							a3_RasterShadeQuadSamples<shading, lit, format>(depthOnly ? colorRow : colorRow + offset, depthBuffer + offset * depthBytes, coverage, quad, sampleDepth, shade, texture, light, count, &farthest);
+						}
+						else
+						{
+							__m128i coverage;
+							if (accepted)
+							{
+								coverage = _mm_set1_epi32(-1);
+							}
+							else
+							{
+								__m128i edges = _mm_or_si128(_mm_or_si128(e0, e1), e2);
+								coverage = _mm_cmpgt_epi32(edges, _mm_set1_epi32(-1));
+							}
+							a3_RasterShadeQuad<shading, lit, format>(depthOnly ? colorRow : colorRow + column, depthBuffer + column * depthBytes, coverage, quad, shade, texture, light, count, &farthest);
+						}
+						e0 = _mm_add_epi32(e0, edgeStepX[0]);
+						e1 = _mm_add_epi32(e1, edgeStepX[1]);
+						e2 = _mm_add_epi32(e2, edgeStepX[2]);
+						quad.Depth = _mm_add_ps(quad.Depth, depthStep);
+						quad.U = _mm_add_ps(quad.U, uStep);
+						quad.V = _mm_add_ps(quad.V, vStep);
+						if (lit)
+						{
+							quad.LightX = _mm_add_ps(quad.LightX, lightStep[0]);
+							quad.LightY = _mm_add_ps(quad.LightY, lightStep[1]);
+							quad.LightZ = _mm_add_ps(quad.LightZ, lightStep[2]);
+							quad.LightW = _mm_add_ps(quad.LightW, lightStep[3]);
+						}
 					}
-					t += tstep;
+					for (i32 e = 0; e < 3; ++e)
+					{
+						edgeRow[e] = _mm_add_epi32(edgeRow[e], edgeStepY[e]);
+					}
+					depthRow += tri.depthDy;
+					uvRow += tri.uvDy;
+					if (lit) lightRow += tri.lightDy;
 				}
 
+				farthest = a3_MinDepth4(farthest, _mm_shuffle_epi32(farthest, _MM_SHUFFLE(1, 0, 3, 2)));
+				farthest = a3_MinDepth4(farthest, _mm_shuffle_epi32(farthest, _MM_SHUFFLE(2, 3, 0, 1)));
+				f32 depth = a3_DepthToFloat<format>(_mm_cvtsi128_si32(farthest));
+				if (depth > m_BlockDepth[blockIndex])
+				{
+					m_BlockDepth[blockIndex] = depth;
+					depthChanged = true;
+				}
 			}
 		}
+		return depthChanged;
+	}
 
-		dy1 = y3 - y2;
-		dx1 = x3 - x2;
-		dw1 = w3 - w2;
+	// NOTE(Zero): Depth only is never lit, its lit entries are the same as the unlit ones
+#define A3_RASTERIZE_TRIANGLE_FORMATS(shading, lit, multisample) \
+	{ &swapchain::RasterizeTriangle<shading, lit, multisample, a3::DepthFloat32>, \
+	  &swapchain::RasterizeTriangle<shading, lit, multisample, a3::DepthUnorm24>, \
+	  &swapchain::RasterizeTriangle<shading, lit, multisample, a3::DepthUnorm16> }
+#define A3_RASTERIZE_TRIANGLE_SHADING(shading, lit) \
+	{ { A3_RASTERIZE_TRIANGLE_FORMATS(shading, false, false), A3_RASTERIZE_TRIANGLE_FORMATS(shading, false, true) }, \
+	  { A3_RASTERIZE_TRIANGLE_FORMATS(shading, lit, false), A3_RASTERIZE_TRIANGLE_FORMATS(shading, lit, true) } }
 
-		if (dy1) dax_step = dx1 / (f32)Abs(dy1);
-		if (dy2) dbx_step = dx2 / (f32)Abs(dy2);
+	const swapchain::rasterize_triangle_proc swapchain::s_RasterizeTriangle[3][2][2][3] =
+	{
+		A3_RASTERIZE_TRIANGLE_SHADING(a3::ShadingDepth, false),
+		A3_RASTERIZE_TRIANGLE_SHADING(a3::ShadingFlat, true),
+		A3_RASTERIZE_TRIANGLE_SHADING(a3::ShadingTexture, true)
+	};
 
-		v2 dut_step = {};
-		if (dy1) dw1_step = dw1 / (f32)Abs(dy1);
+#undef A3_RASTERIZE_TRIANGLE_SHADING
+#undef A3_RASTERIZE_TRIANGLE_FORMATS
 
-		if (dy1)
+	// NOTE(Zero):
+	// Blocks whose depth is still pending are cleared in the map, with multisampling the first sample of each pixel is used
+	void swapchain::CopyShadowMap(shadow_map* map)
+	{
+		a3Assert(m_FrameBuffer);
+		i32 width = m_FrameBuffer->Width;
+		i32 height = m_FrameBuffer->Height;
+		if (!map->Depth || map->Width != width || map->Height != height)
 		{
-			for (i32 i = y2; i <= y3; i++)
-			{
-				i32 ax = (i32)(x2 + (f32)(i - y2) * dax_step);
-				i32 bx = (i32)(x1 + (f32)(i - y1) * dbx_step);
-
-				f32 tex_sw = w2 + (f32)(i - y2) * dw1_step;
-
-				f32 tex_ew = w1 + (f32)(i - y1) * dw2_step;
+			map->Depth = a3Realloc(map->Depth, sizeof(f32) * width * height, f32);
+			map->Width = width;
+			map->Height = height;
+		}
+		map->ViewProjection = m_View * m_Projection;
 
-				if (ax > bx)
+		const u8* depth = m_Multisample ? m_SampleDepth : m_DepthBuffer;
+		i32 pixelStride = m_Multisample ? A3_RASTER_SAMPLE_COUNT : 1;
+		for (i32 y = 0; y < height; ++y)
+		{
+			f32* row = map->Depth + y * width;
+			for (i32 x = 0; x < width; ++x)
+			{
+				i32 blockIndex = (y / A3_RASTER_BLOCK_SIZE) * m_NumOfBlocksX + x / A3_RASTER_BLOCK_SIZE;
+				if (m_BlockFlags[blockIndex] & BlockClearDepth)
 				{
-					a3::Swap(&ax, &bx);
-					a3::Swap(&tex_sw, &tex_ew);
+					row[x] = 0.0f;
+					continue;
 				}
-
-				tex_w = tex_sw;
-
-				f32 tstep = 1.0f / ((f32)(bx - ax));
-				f32 t = 0.0f;
-
-				for (i32 j = ax; j < bx; j++)
+				i32 index = (y * width + x) * pixelStride;
+				switch (m_DepthFormat)
 				{
-					tex_w = (1.0f - t) * tex_sw + t * tex_ew;
-
-					if (tex_w > m_DepthBuffer[i*m_FrameBuffer->Width + j])
-					{
-						a3::SetPixelColor(m_FrameBuffer, (f32)j + 0.5f, (f32)i + 0.5f, shade);
-						m_DepthBuffer[i*m_FrameBuffer->Width + j] = tex_w;
-					}
-					t += tstep;
+				case a3::DepthFloat32: row[x] = a3_DepthToFloat<a3::DepthFloat32>(a3_LoadDepth<a3::DepthFloat32>(depth, index)); break;
+				case a3::DepthUnorm24: row[x] = a3_DepthToFloat<a3::DepthUnorm24>(a3_LoadDepth<a3::DepthUnorm24>(depth, index)); break;
+				case a3::DepthUnorm16: row[x] = a3_DepthToFloat<a3::DepthUnorm16>(a3_LoadDepth<a3::DepthUnorm16>(depth, index)); break;
 				}
 			}
 		}
@@ -0,0 +1,673 @@
+#pragma once
+#include "Common/Core.h"
+#include "Platform/Platform.h"
+#include "Utility/AssetData.h"
+#include "Graphics/BVH.h"
+#include "Graphics/BVH4.h"
+
+//
+// DECLARATIONS
+//
+
+// NOTE(Zero):
+// Number of rays in a packet, packets are traced as a single 8 wide AVX2 packet,
+// two 4 wide SSE packets or 8 single rays depending on the processor
+#define A3RAYPACKETSIZE 8
+
+namespace a3 {
+
+	// NOTE(Zero):
+	// Rays are stored as structure of arrays so that each member can be loaded directly into a register
+	// `TNear` should be initialized with the maximum distance of each ray and
+	// contains distance to the closest hit after tracing, `InstanceIndex` is only written by `RayIntersectTLASPacket`
+	struct alignas(32) ray_packet
+	{
+		f32 OrigX[A3RAYPACKETSIZE];
+		f32 OrigY[A3RAYPACKETSIZE];
+		f32 OrigZ[A3RAYPACKETSIZE];
+		f32 DirX[A3RAYPACKETSIZE];
+		f32 DirY[A3RAYPACKETSIZE];
+		f32 DirZ[A3RAYPACKETSIZE];
+		f32 TNear[A3RAYPACKETSIZE];
+		f32 U[A3RAYPACKETSIZE];
+		f32 V[A3RAYPACKETSIZE];
+		u32 TriIndex[A3RAYPACKETSIZE];
+		u32 InstanceIndex[A3RAYPACKETSIZE];
+	};
+
+	// NOTE(Zero):
+	// Bit `i` of `activeMask` enables ray `i` of the packet, inactive rays are not modified
+	// Returns the mask of rays that hit a triangle closer than their initial `TNear`
+	typedef u32(*ray_packet_function)(const bvh* accel, ray_packet* packet, u32 activeMask);
+	// NOTE(Zero): Same as above for the 4 wide hierarchy
+	typedef u32(*ray_packet4_function)(const bvh4* accel, ray_packet* packet, u32 activeMask);
+
+	// NOTE(Zero): Defined in RayTracer.h
+	b32 RayIntersectBVH(const bvh* accel, const v3 &orig, const v3 &dir, f32 *tNear, u32 *triIndex, v2 *uv);
+
+	// NOTE(Zero): Traces every ray separately using `RayIntersectBVH`, reference for the wide versions
+	u32 RayIntersectBVHPacketScalar(const bvh* accel, ray_packet* packet, u32 activeMask);
+	u32 RayIntersectBVHPacketSSE(const bvh* accel, ray_packet* packet, u32 activeMask);
+	// NOTE(Zero): Only call if `QuerySIMDLevel` returns `SIMDLevelAVX2`
+	u32 RayIntersectBVHPacketAVX2(const bvh* accel, ray_packet* packet, u32 activeMask);
+
+	// NOTE(Zero): Returns the widest packet function available for the given level
+	ray_packet_function QueryRayPacketFunction(simd_level level);
+
+	// NOTE(Zero): Defined in RayTracer.h
+	b32 RayIntersectBVH4(const bvh4* accel, const v3 &orig, const v3 &dir, f32 *tNear, u32 *triIndex, v2 *uv);
+
+	u32 RayIntersectBVH4PacketScalar(const bvh4* accel, ray_packet* packet, u32 activeMask);
+	u32 RayIntersectBVH4PacketSSE(const bvh4* accel, ray_packet* packet, u32 activeMask);
+	// NOTE(Zero): Only call if `QuerySIMDLevel` returns `SIMDLevelAVX2`
+	u32 RayIntersectBVH4PacketAVX2(const bvh4* accel, ray_packet* packet, u32 activeMask);
+	ray_packet4_function QueryRayPacket4Function(simd_level level);
+
+	// NOTE(Zero):
+	// Traces the packet through the instances of `scene`, `blas` traces it through the hierarchy of each instance
+	// Lanes that reach an instance are moved to its space in a copy of the packet, so its hierarchy sees a regular
+	// packet, and their hits are copied back along with the index of the instance
+	u32 RayIntersectTLASPacket(const tlas* scene, ray_packet* packet, u32 activeMask, ray_packet_function blas);
+
+}
+
+//
+// IMPLEMENTATION
+//
+
+// NOTE(Zero):
+// Lanes wrap the registers of each instruction set with the same interface,
+// so that the packet traversal is written only once as a template
+// Masks are stored in float registers with all bits set for true lanes
+struct a3_lane4
+{
+	__m128 m;
+
+	enum { Width = 4 };
+
+	static inline a3_lane4 Load(const f32* p) { return { _mm_load_ps(p) }; }
+	static inline void Store(f32* p, a3_lane4 a) { _mm_store_ps(p, a.m); }
+	static inline a3_lane4 Set(f32 x) { return { _mm_set1_ps(x) }; }
+	static inline a3_lane4 SetBits(u32 x) { return { _mm_castsi128_ps(_mm_set1_epi32((i32)x)) }; }
+	static inline a3_lane4 FromMask(u32 bits)
+	{
+		__m128i lanes = _mm_set_epi32(8, 4, 2, 1);
+		__m128i mask = _mm_and_si128(_mm_set1_epi32((i32)bits), lanes);
+		return { _mm_castsi128_ps(_mm_cmpeq_epi32(mask, lanes)) };
+	}
+	static inline u32 ToMask(a3_lane4 a) { return (u32)_mm_movemask_ps(a.m); }
+
+	static inline a3_lane4 Add(a3_lane4 a, a3_lane4 b) { return { _mm_add_ps(a.m, b.m) }; }
+	static inline a3_lane4 Sub(a3_lane4 a, a3_lane4 b) { return { _mm_sub_ps(a.m, b.m) }; }
+	static inline a3_lane4 Mul(a3_lane4 a, a3_lane4 b) { return { _mm_mul_ps(a.m, b.m) }; }
+	static inline a3_lane4 Div(a3_lane4 a, a3_lane4 b) { return { _mm_div_ps(a.m, b.m) }; }
+	static inline a3_lane4 Min(a3_lane4 a, a3_lane4 b) { return { _mm_min_ps(a.m, b.m) }; }
+	static inline a3_lane4 Max(a3_lane4 a, a3_lane4 b) { return { _mm_max_ps(a.m, b.m) }; }
+	static inline a3_lane4 Abs(a3_lane4 a) { return { _mm_andnot_ps(_mm_set1_ps(-0.0f), a.m) }; }
+
+	static inline a3_lane4 Less(a3_lane4 a, a3_lane4 b) { return { _mm_cmplt_ps(a.m, b.m) }; }
+	static inline a3_lane4 LessEqual(a3_lane4 a, a3_lane4 b) { return { _mm_cmple_ps(a.m, b.m) }; }
+	static inline a3_lane4 GreaterEqual(a3_lane4 a, a3_lane4 b) { return { _mm_cmpge_ps(a.m, b.m) }; }
+	static inline a3_lane4 And(a3_lane4 a, a3_lane4 b) { return { _mm_and_ps(a.m, b.m) }; }
+	// NOTE(Zero): Returns `b` where mask is set otherwise `a`
+	static inline a3_lane4 Select(a3_lane4 mask, a3_lane4 a, a3_lane4 b)
+	{
+		return { _mm_or_ps(_mm_and_ps(mask.m, b.m), _mm_andnot_ps(mask.m, a.m)) };
+	}
+
+	static inline f32 ReduceMin(a3_lane4 a)
+	{
+		__m128 m = _mm_min_ps(a.m, _mm_shuffle_ps(a.m, a.m, _MM_SHUFFLE(1, 0, 3, 2)));
+		m = _mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtss_f32(m);
+	}
+	static inline f32 ReduceMax(a3_lane4 a)
+	{
+		__m128 m = _mm_max_ps(a.m, _mm_shuffle_ps(a.m, a.m, _MM_SHUFFLE(1, 0, 3, 2)));
+		m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtss_f32(m);
+	}
+};
+
+struct a3_lane8
+{
+	__m256 m;
+
+	enum { Width = 8 };
+
+	a3TargetAVX2 static inline a3_lane8 Load(const f32* p) { return { _mm256_load_ps(p) }; }
+	a3TargetAVX2 static inline void Store(f32* p, a3_lane8 a) { _mm256_store_ps(p, a.m); }
+	a3TargetAVX2 static inline a3_lane8 Set(f32 x) { return { _mm256_set1_ps(x) }; }
+	a3TargetAVX2 static inline a3_lane8 SetBits(u32 x) { return { _mm256_castsi256_ps(_mm256_set1_epi32((i32)x)) }; }
+	a3TargetAVX2 static inline a3_lane8 FromMask(u32 bits)
+	{
+		__m256i lanes = _mm256_set_epi32(128, 64, 32, 16, 8, 4, 2, 1);
+		__m256i mask = _mm256_and_si256(_mm256_set1_epi32((i32)bits), lanes);
+		return { _mm256_castsi256_ps(_mm256_cmpeq_epi32(mask, lanes)) };
+	}
+	a3TargetAVX2 static inline u32 ToMask(a3_lane8 a) { return (u32)_mm256_movemask_ps(a.m); }
+
+	a3TargetAVX2 static inline a3_lane8 Add(a3_lane8 a, a3_lane8 b) { return { _mm256_add_ps(a.m, b.m) }; }
+	a3TargetAVX2 static inline a3_lane8 Sub(a3_lane8 a, a3_lane8 b) { return { _mm256_sub_ps(a.m, b.m) }; }
+	a3TargetAVX2 static inline a3_lane8 Mul(a3_lane8 a, a3_lane8 b) { return { _mm256_mul_ps(a.m, b.m) }; }
+	a3TargetAVX2 static inline a3_lane8 Div(a3_lane8 a, a3_lane8 b) { return { _mm256_div_ps(a.m, b.m) }; }
+	a3TargetAVX2 static inline a3_lane8 Min(a3_lane8 a, a3_lane8 b) { return { _mm256_min_ps(a.m, b.m) }; }
+	a3TargetAVX2 static inline a3_lane8 Max(a3_lane8 a, a3_lane8 b) { return { _mm256_max_ps(a.m, b.m) }; }
+	a3TargetAVX2 static inline a3_lane8 Abs(a3_lane8 a) { return { _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.m) }; }
+
+	a3TargetAVX2 static inline a3_lane8 Less(a3_lane8 a, a3_lane8 b) { return { _mm256_cmp_ps(a.m, b.m, _CMP_LT_OQ) }; }
+	a3TargetAVX2 static inline a3_lane8 LessEqual(a3_lane8 a, a3_lane8 b) { return { _mm256_cmp_ps(a.m, b.m, _CMP_LE_OQ) }; }
+	a3TargetAVX2 static inline a3_lane8 GreaterEqual(a3_lane8 a, a3_lane8 b) { return { _mm256_cmp_ps(a.m, b.m, _CMP_GE_OQ) }; }
+	a3TargetAVX2 static inline a3_lane8 And(a3_lane8 a, a3_lane8 b) { return { _mm256_and_ps(a.m, b.m) }; }
+	a3TargetAVX2 static inline a3_lane8 Select(a3_lane8 mask, a3_lane8 a, a3_lane8 b) { return { _mm256_blendv_ps(a.m, b.m, mask.m) }; }
+
+	a3TargetAVX2 static inline f32 ReduceMin(a3_lane8 a)
+	{
+		__m128 m = _mm_min_ps(_mm256_castps256_ps128(a.m), _mm256_extractf128_ps(a.m, 1));
+		m = _mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+		m = _mm_min_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtss_f32(m);
+	}
+	a3TargetAVX2 static inline f32 ReduceMax(a3_lane8 a)
+	{
+		__m128 m = _mm_max_ps(_mm256_castps256_ps128(a.m), _mm256_extractf128_ps(a.m, 1));
+		m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 0, 3, 2)));
+		m = _mm_max_ps(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(2, 3, 0, 1)));
+		return _mm_cvtss_f32(m);
+	}
+};
+
+template <typename lane>
+struct a3_lane_v3
+{
+	lane x, y, z;
+};
+
+template <typename lane>
+static inline lane a3_LaneDot(const a3_lane_v3<lane>& a, const a3_lane_v3<lane>& b)
+{
+	return lane::Add(lane::Add(lane::Mul(a.x, b.x), lane::Mul(a.y, b.y)), lane::Mul(a.z, b.z));
+}
+
+// NOTE(Zero): Same order of operations as `Cross` so that results match the scalar path exactly
+template <typename lane>
+static inline a3_lane_v3<lane> a3_LaneCross(const a3_lane_v3<lane>& a, const a3_lane_v3<lane>& b)
+{
+	a3_lane_v3<lane> r;
+	r.x = lane::Sub(lane::Mul(a.y, b.z), lane::Mul(a.z, b.y));
+	r.y = lane::Sub(lane::Mul(a.z, b.x), lane::Mul(a.x, b.z));
+	r.z = lane::Sub(lane::Mul(a.x, b.y), lane::Mul(a.y, b.x));
+	return r;
+}
+
+// NOTE(Zero): Returns mask of lanes that hit the box before their `tMax`, `tEntry` is the smallest entry distance among them
+template <typename lane>
+static inline lane a3_LaneIntersectAABB(const v3& min, const v3& max, const a3_lane_v3<lane>& orig, const a3_lane_v3<lane>& invDir, lane tMax, lane active, f32* tEntry)
+{
+	lane t0 = lane::Mul(lane::Sub(lane::Set(min.x), orig.x), invDir.x);
+	lane t1 = lane::Mul(lane::Sub(lane::Set(max.x), orig.x), invDir.x);
+	lane tNear = lane::Min(t0, t1);
+	lane tFar = lane::Max(t0, t1);
+
+	t0 = lane::Mul(lane::Sub(lane::Set(min.y), orig.y), invDir.y);
+	t1 = lane::Mul(lane::Sub(lane::Set(max.y), orig.y), invDir.y);
+	tNear = lane::Max(tNear, lane::Min(t0, t1));
+	tFar = lane::Min(tFar, lane::Max(t0, t1));
+
+	t0 = lane::Mul(lane::Sub(lane::Set(min.z), orig.z), invDir.z);
+	t1 = lane::Mul(lane::Sub(lane::Set(max.z), orig.z), invDir.z);
+	tNear = lane::Max(tNear, lane::Min(t0, t1));
+	tFar = lane::Min(tFar, lane::Max(t0, t1));
+
+	lane hit = lane::And(active, lane::GreaterEqual(tFar, tNear));
+	hit = lane::And(hit, lane::GreaterEqual(tFar, lane::Set(0.0f)));
+	hit = lane::And(hit, lane::LessEqual(tNear, tMax));
+	*tEntry = lane::ReduceMin(lane::Select(hit, lane::Set(max_f32), tNear));
+	return hit;
+}
+
+template <typename lane>
+static inline lane a3_LaneIntersectAABB(const a3::bvh_node& node, const a3_lane_v3<lane>& orig, const a3_lane_v3<lane>& invDir, lane tMax, lane active, f32* tEntry)
+{
+	return a3_LaneIntersectAABB(node.Min, node.Max, orig, invDir, tMax, active, tEntry);
+}
+
+// NOTE(Zero):
+// Triangles [first, first + count) of the block against the active lanes with the same Moller-Trumbore test as `RayTriangleIntersect`
+// Closest hits so far are kept in `tNear`, `u`, `v` and `triIndex`, `hitMask` gets the lanes that hit
+template <typename lane>
+static inline void a3_LaneIntersectTriangles(const a3::triangle_block& tris, const u32* triangleIndices, u32 first, u32 count,
+	const a3_lane_v3<lane>& orig, const a3_lane_v3<lane>& dir, lane active, lane* tNear, lane* u, lane* v, lane* triIndex, lane* hitMask)
+{
+	lane one = lane::Set(1.0f);
+	lane zero = lane::Set(0.0f);
+	for (u32 i = first; i < first + count; ++i)
+	{
+		a3_lane_v3<lane> v0v1 = { lane::Set(tris.E1X[i]), lane::Set(tris.E1Y[i]), lane::Set(tris.E1Z[i]) };
+		a3_lane_v3<lane> v0v2 = { lane::Set(tris.E2X[i]), lane::Set(tris.E2Y[i]), lane::Set(tris.E2Z[i]) };
+		a3_lane_v3<lane> lv0 = { lane::Set(tris.V0X[i]), lane::Set(tris.V0Y[i]), lane::Set(tris.V0Z[i]) };
+
+		a3_lane_v3<lane> pvec = a3_LaneCross(dir, v0v2);
+		lane det = a3_LaneDot(v0v1, pvec);
+		lane mask = lane::And(active, lane::GreaterEqual(lane::Abs(det), lane::Set(epsilon_f32)));
+		if (!lane::ToMask(mask)) continue;
+		lane invDet = lane::Div(one, det);
+
+		a3_lane_v3<lane> tvec = { lane::Sub(orig.x, lv0.x), lane::Sub(orig.y, lv0.y), lane::Sub(orig.z, lv0.z) };
+		lane hu = lane::Mul(a3_LaneDot(tvec, pvec), invDet);
+		mask = lane::And(mask, lane::And(lane::GreaterEqual(hu, zero), lane::LessEqual(hu, one)));
+		if (!lane::ToMask(mask)) continue;
+
+		a3_lane_v3<lane> qvec = a3_LaneCross(tvec, v0v1);
+		lane hv = lane::Mul(a3_LaneDot(dir, qvec), invDet);
+		mask = lane::And(mask, lane::And(lane::GreaterEqual(hv, zero), lane::LessEqual(lane::Add(hu, hv), one)));
+
+		lane t = lane::Mul(a3_LaneDot(v0v2, qvec), invDet);
+		mask = lane::And(mask, lane::And(lane::Less(zero, t), lane::Less(t, *tNear)));
+		if (!lane::ToMask(mask)) continue;
+
+		*tNear = lane::Select(mask, *tNear, t);
+		*u = lane::Select(mask, *u, hu);
+		*v = lane::Select(mask, *v, hv);
+		*triIndex = lane::Select(mask, *triIndex, lane::SetBits(triangleIndices[i]));
+		*hitMask = lane::Select(mask, *hitMask, mask);
+	}
+}
+
+// NOTE(Zero):
+// Whole packet traverses the hierarchy together, a node is visited if any of the active lanes hit it
+// Triangles are intersected with the same Moller-Trumbore test as `RayTriangleIntersect`
+// Handles lanes [offset, offset + lane::Width) of the packet, returns the hit mask of those lanes
+template <typename lane>
+static inline u32 a3_RayIntersectBVHPacket(const a3::bvh* accel, a3::ray_packet* packet, u32 offset, u32 activeMask)
+{
+	activeMask = (activeMask >> offset) & ((1u << lane::Width) - 1);
+	if (!accel->NumOfNodes || !activeMask) return 0;
+
+	const a3::triangle_block& tris = accel->Triangles;
+	const a3::bvh_node* nodes = accel->Nodes;
+
+	a3_lane_v3<lane> orig = { lane::Load(packet->OrigX + offset), lane::Load(packet->OrigY + offset), lane::Load(packet->OrigZ + offset) };
+	a3_lane_v3<lane> dir = { lane::Load(packet->DirX + offset), lane::Load(packet->DirY + offset), lane::Load(packet->DirZ + offset) };
+	lane one = lane::Set(1.0f);
+	lane zero = lane::Set(0.0f);
+	a3_lane_v3<lane> invDir = { lane::Div(one, dir.x), lane::Div(one, dir.y), lane::Div(one, dir.z) };
+
+	lane active = lane::FromMask(activeMask);
+	lane tNear = lane::Load(packet->TNear + offset);
+	lane u = lane::Load(packet->U + offset);
+	lane v = lane::Load(packet->V + offset);
+	lane triIndex = lane::Load((f32*)packet->TriIndex + offset);
+	lane hitMask = zero;
+
+	u32 stackNodes[A3BVHMAXDEPTH + 1];
+	f32 stackEntries[A3BVHMAXDEPTH + 1];
+	i32 stackSize = 0;
+
+	f32 tEntry;
+	if (!lane::ToMask(a3_LaneIntersectAABB(nodes[0], orig, invDir, tNear, active, &tEntry))) return 0;
+	stackNodes[stackSize] = 0;
+	stackEntries[stackSize] = tEntry;
+	stackSize++;
+
+	while (stackSize)
+	{
+		stackSize--;
+		// NOTE(Zero): Node is skipped only when it is behind the closest hit of every active lane
+		f32 tFarthest = lane::ReduceMax(lane::Select(active, lane::Set(-max_f32), tNear));
+		if (stackEntries[stackSize] > tFarthest) continue;
+		const a3::bvh_node* node = nodes + stackNodes[stackSize];
+
+		if (node->Count)
+		{
+			a3_LaneIntersectTriangles(tris, accel->TriangleIndices, node->LeftFirst, node->Count, orig, dir, active, &tNear, &u, &v, &triIndex, &hitMask);
+		}
+		else
+		{
+			u32 left = node->LeftFirst;
+			u32 right = left + 1;
+			f32 tLeft, tRight;
+			b32 hitLeft = lane::ToMask(a3_LaneIntersectAABB(nodes[left], orig, invDir, tNear, active, &tLeft)) != 0;
+			b32 hitRight = lane::ToMask(a3_LaneIntersectAABB(nodes[right], orig, invDir, tNear, active, &tRight)) != 0;
+
+			if (hitLeft && hitRight && tLeft < tRight)
+			{
+				a3::Swap(&left, &right);
+				a3::Swap(&tLeft, &tRight);
+			}
+			if (hitLeft)
+			{
+				a3Assert(stackSize <= A3BVHMAXDEPTH);
+				stackNodes[stackSize] = left;
+				stackEntries[stackSize] = tLeft;
+				stackSize++;
+			}
+			if (hitRight)
+			{
+				a3Assert(stackSize <= A3BVHMAXDEPTH);
+				stackNodes[stackSize] = right;
+				stackEntries[stackSize] = tRight;
+				stackSize++;
+			}
+		}
+	}
+
+	lane::Store(packet->TNear + offset, tNear);
+	lane::Store(packet->U + offset, u);
+	lane::Store(packet->V + offset, v);
+	lane::Store((f32*)packet->TriIndex + offset, triIndex);
+	return lane::ToMask(hitMask) << offset;
+}
+
+// NOTE(Zero):
+// Same as above for the 4 wide hierarchy, children are decoded once per node and tested against all the lanes
+// Leaf children are intersected right away nearest first, interior ones are pushed so the nearest is visited first
+template <typename lane>
+static inline u32 a3_RayIntersectBVH4Packet(const a3::bvh4* accel, a3::ray_packet* packet, u32 offset, u32 activeMask)
+{
+	activeMask = (activeMask >> offset) & ((1u << lane::Width) - 1);
+	if (!accel->NumOfNodes || !activeMask) return 0;
+
+	const a3::triangle_block& tris = accel->Triangles;
+	const a3::bvh4_node* nodes = accel->Nodes;
+
+	a3_lane_v3<lane> orig = { lane::Load(packet->OrigX + offset), lane::Load(packet->OrigY + offset), lane::Load(packet->OrigZ + offset) };
+	a3_lane_v3<lane> dir = { lane::Load(packet->DirX + offset), lane::Load(packet->DirY + offset), lane::Load(packet->DirZ + offset) };
+	lane one = lane::Set(1.0f);
+	lane zero = lane::Set(0.0f);
+	a3_lane_v3<lane> invDir = { lane::Div(one, dir.x), lane::Div(one, dir.y), lane::Div(one, dir.z) };
+
+	lane active = lane::FromMask(activeMask);
+	lane tNear = lane::Load(packet->TNear + offset);
+	lane u = lane::Load(packet->U + offset);
+	lane v = lane::Load(packet->V + offset);
+	lane triIndex = lane::Load((f32*)packet->TriIndex + offset);
+	lane hitMask = zero;
+
+	// NOTE(Zero): Root has no box of its own, its children are tested when it is visited
+	u32 stackNodes[A3BVH4STACKSIZE];
+	f32 stackEntries[A3BVH4STACKSIZE];
+	i32 stackSize = 0;
+	stackNodes[stackSize] = 0;
+	stackEntries[stackSize] = -max_f32;
+	stackSize++;
+
+	while (stackSize)
+	{
+		stackSize--;
+		f32 tFarthest = lane::ReduceMax(lane::Select(active, lane::Set(-max_f32), tNear));
+		if (stackEntries[stackSize] > tFarthest) continue;
+		const a3::bvh4_node* node = nodes + stackNodes[stackSize];
+
+		// NOTE(Zero): Hit children sorted by entry distance, nearest first
+		f32 childMin[3][4];
+		f32 childMax[3][4];
+		a3::DecodeChildBounds(*node, childMin, childMax);
+		u32 order[4];
+		f32 entries[4];
+		u32 numOfHits = 0;
+		for (u32 c = 0; c < node->NumOfChildren; ++c)
+		{
+			v3 boxMin = v3{ childMin[0][c], childMin[1][c], childMin[2][c] };
+			v3 boxMax = v3{ childMax[0][c], childMax[1][c], childMax[2][c] };
+			f32 tEntry;
+			if (!lane::ToMask(a3_LaneIntersectAABB(boxMin, boxMax, orig, invDir, tNear, active, &tEntry))) continue;
+			u32 slot = numOfHits++;
+			while (slot > 0 && entries[slot - 1] > tEntry)
+			{
+				order[slot] = order[slot - 1];
+				entries[slot] = entries[slot - 1];
+				slot--;
+			}
+			order[slot] = c;
+			entries[slot] = tEntry;
+		}
+
+		for (u32 h = 0; h < numOfHits; ++h)
+		{
+			u32 c = order[h];
+			if (node->Count[c])
+			{
+				a3_LaneIntersectTriangles(tris, accel->TriangleIndices, node->Child[c], node->Count[c], orig, dir, active, &tNear, &u, &v, &triIndex, &hitMask);
+			}
+		}
+		for (u32 h = numOfHits; h-- > 0;)
+		{
+			u32 c = order[h];
+			if (node->Count[c]) continue;
+			a3Assert(stackSize < A3BVH4STACKSIZE);
+			stackNodes[stackSize] = node->Child[c];
+			stackEntries[stackSize] = entries[h];
+			stackSize++;
+		}
+	}
+
+	lane::Store(packet->TNear + offset, tNear);
+	lane::Store(packet->U + offset, u);
+	lane::Store(packet->V + offset, v);
+	lane::Store((f32*)packet->TriIndex + offset, triIndex);
+	return lane::ToMask(hitMask) << offset;
+}
+
+// NOTE(Zero):
+// Top level boxes are tested one lane at a time, there are few of them compared to the triangles
+// Returns mask of the lanes that hit the box before their `TNear`, `tEntry` is the smallest entry distance among them
+static u32 a3_PacketIntersectAABB(const a3::bvh_node& node, const a3::ray_packet* packet, const v3* orig, const v3* invDir, u32 activeMask, f32* tEntry)
+{
+	u32 hitMask = 0;
+	*tEntry = max_f32;
+	for (u32 r = 0; r < A3RAYPACKETSIZE; ++r)
+	{
+		if (!(activeMask & (1u << r))) continue;
+		f32 t;
+		if (a3::RayIntersectAABB(node.Min, node.Max, orig[r], invDir[r], packet->TNear[r], &t))
+		{
+			hitMask |= (1u << r);
+			if (t < *tEntry) *tEntry = t;
+		}
+	}
+	return hitMask;
+}
+
+namespace a3 {
+
+	u32 RayIntersectBVHPacketScalar(const bvh* accel, ray_packet* packet, u32 activeMask)
+	{
+		u32 hitMask = 0;
+		for (u32 i = 0; i < A3RAYPACKETSIZE; ++i)
+		{
+			if (!(activeMask & (1u << i))) continue;
+			v3 orig = v3{ packet->OrigX[i], packet->OrigY[i], packet->OrigZ[i] };
+			v3 dir = v3{ packet->DirX[i], packet->DirY[i], packet->DirZ[i] };
+			v2 uv;
+			if (RayIntersectBVH(accel, orig, dir, &packet->TNear[i], &packet->TriIndex[i], &uv))
+			{
+				packet->U[i] = uv.x;
+				packet->V[i] = uv.y;
+				hitMask |= (1u << i);
+			}
+		}
+		return hitMask;
+	}
+
+	u32 RayIntersectBVHPacketSSE(const bvh* accel, ray_packet* packet, u32 activeMask)
+	{
+		u32 hitMask = 0;
+		for (u32 offset = 0; offset < A3RAYPACKETSIZE; offset += a3_lane4::Width)
+		{
+			hitMask |= a3_RayIntersectBVHPacket<a3_lane4>(accel, packet, offset, activeMask);
+		}
+		return hitMask;
+	}
+
+	a3TargetAVX2 u32 RayIntersectBVHPacketAVX2(const bvh* accel, ray_packet* packet, u32 activeMask)
+	{
+		return a3_RayIntersectBVHPacket<a3_lane8>(accel, packet, 0, activeMask);
+	}
+
+	ray_packet_function QueryRayPacketFunction(simd_level level)
+	{
+		switch (level)
+		{
+		case SIMDLevelAVX2: return RayIntersectBVHPacketAVX2;
+		case SIMDLevelSSE: return RayIntersectBVHPacketSSE;
+		default: return RayIntersectBVHPacketScalar;
+		}
+	}
+
+	u32 RayIntersectBVH4PacketScalar(const bvh4* accel, ray_packet* packet, u32 activeMask)
+	{
+		u32 hitMask = 0;
+		for (u32 i = 0; i < A3RAYPACKETSIZE; ++i)
+		{
+			if (!(activeMask & (1u << i))) continue;
+			v3 orig = v3{ packet->OrigX[i], packet->OrigY[i], packet->OrigZ[i] };
+			v3 dir = v3{ packet->DirX[i], packet->DirY[i], packet->DirZ[i] };
+			v2 uv;
+			if (RayIntersectBVH4(accel, orig, dir, &packet->TNear[i], &packet->TriIndex[i], &uv))
+			{
+				packet->U[i] = uv.x;
+				packet->V[i] = uv.y;
+				hitMask |= (1u << i);
+			}
+		}
+		return hitMask;
+	}
+
+	u32 RayIntersectBVH4PacketSSE(const bvh4* accel, ray_packet* packet, u32 activeMask)
+	{
+		u32 hitMask = 0;
+		for (u32 offset = 0; offset < A3RAYPACKETSIZE; offset += a3_lane4::Width)
+		{
+			hitMask |= a3_RayIntersectBVH4Packet<a3_lane4>(accel, packet, offset, activeMask);
+		}
+		return hitMask;
+	}
+
+	a3TargetAVX2 u32 RayIntersectBVH4PacketAVX2(const bvh4* accel, ray_packet* packet, u32 activeMask)
+	{
+		return a3_RayIntersectBVH4Packet<a3_lane8>(accel, packet, 0, activeMask);
+	}
+
+	ray_packet4_function QueryRayPacket4Function(simd_level level)
+	{
+		switch (level)
+		{
+		case SIMDLevelAVX2: return RayIntersectBVH4PacketAVX2;
+		case SIMDLevelSSE: return RayIntersectBVH4PacketSSE;
+		default: return RayIntersectBVH4PacketScalar;
+		}
+	}
+
+	u32 RayIntersectTLASPacket(const tlas* scene, ray_packet* packet, u32 activeMask, ray_packet_function blas)
+	{
+		activeMask &= (1u << A3RAYPACKETSIZE) - 1;
+		if (!scene->NumOfNodes || !activeMask) return 0;
+
+		const bvh_node* nodes = scene->Nodes;
+		v3 orig[A3RAYPACKETSIZE];
+		v3 invDir[A3RAYPACKETSIZE];
+		for (u32 r = 0; r < A3RAYPACKETSIZE; ++r)
+		{
+			orig[r] = v3{ packet->OrigX[r], packet->OrigY[r], packet->OrigZ[r] };
+			invDir[r] = v3{ 1.0f / packet->DirX[r], 1.0f / packet->DirY[r], 1.0f / packet->DirZ[r] };
+		}
+
+		// NOTE(Zero): Same traversal as `a3_RayIntersectBVHPacket`, the lanes that hit a node are kept with it
+		u32 stackNodes[A3BVHMAXDEPTH + 1];
+		f32 stackEntries[A3BVHMAXDEPTH + 1];
+		u32 stackMasks[A3BVHMAXDEPTH + 1];
+		i32 stackSize = 0;
+
+		f32 tEntry;
+		u32 rootMask = a3_PacketIntersectAABB(nodes[0], packet, orig, invDir, activeMask, &tEntry);
+		if (!rootMask) return 0;
+		stackNodes[stackSize] = 0;
+		stackEntries[stackSize] = tEntry;
+		stackMasks[stackSize] = rootMask;
+		stackSize++;
+
+		u32 hitMask = 0;
+		ray_packet local;
+		while (stackSize)
+		{
+			stackSize--;
+			u32 nodeMask = stackMasks[stackSize];
+			f32 tFarthest = -max_f32;
+			for (u32 r = 0; r < A3RAYPACKETSIZE; ++r)
+			{
+				if ((nodeMask & (1u << r)) && packet->TNear[r] > tFarthest) tFarthest = packet->TNear[r];
+			}
+			if (stackEntries[stackSize] > tFarthest) continue;
+			const bvh_node* node = nodes + stackNodes[stackSize];
+
+			if (node->Count)
+			{
+				for (u32 i = node->LeftFirst; i < node->LeftFirst + node->Count; ++i)
+				{
+					u32 index = scene->InstanceIndices[i];
+					const bvh_instance& instance = scene->Instances[index];
+					if (!instance.Accel) continue;
+					for (u32 r = 0; r < A3RAYPACKETSIZE; ++r)
+					{
+						if (!(nodeMask & (1u << r))) continue;
+						v3 dir = v3{ packet->DirX[r], packet->DirY[r], packet->DirZ[r] };
+						v3 localOrig, localDir;
+						TransformRay(instance.InverseTransform, orig[r], dir, &localOrig, &localDir);
+						local.OrigX[r] = localOrig.x;
+						local.OrigY[r] = localOrig.y;
+						local.OrigZ[r] = localOrig.z;
+						local.DirX[r] = localDir.x;
+						local.DirY[r] = localDir.y;
+						local.DirZ[r] = localDir.z;
+						local.TNear[r] = packet->TNear[r];
+					}
+					u32 instanceMask = blas(instance.Accel, &local, nodeMask);
+					for (u32 r = 0; r < A3RAYPACKETSIZE; ++r)
+					{
+						if (!(instanceMask & (1u << r))) continue;
+						packet->TNear[r] = local.TNear[r];
+						packet->U[r] = local.U[r];
+						packet->V[r] = local.V[r];
+						packet->TriIndex[r] = local.TriIndex[r];
+						packet->InstanceIndex[r] = index;
+					}
+					hitMask |= instanceMask;
+				}
+			}
+			else
+			{
+				u32 left = node->LeftFirst;
+				u32 right = left + 1;
+				f32 tLeft, tRight;
+				u32 leftMask = a3_PacketIntersectAABB(nodes[left], packet, orig, invDir, nodeMask, &tLeft);
+				u32 rightMask = a3_PacketIntersectAABB(nodes[right], packet, orig, invDir, nodeMask, &tRight);
+
+				if (leftMask && rightMask && tLeft < tRight)
+				{
+					a3::Swap(&left, &right);
+					a3::Swap(&tLeft, &tRight);
+					a3::Swap(&leftMask, &rightMask);
+				}
+				if (leftMask)
+				{
+					a3Assert(stackSize <= A3BVHMAXDEPTH);
+					stackNodes[stackSize] = left;
+					stackEntries[stackSize] = tLeft;
+					stackMasks[stackSize] = leftMask;
+					stackSize++;
+				}
+				if (rightMask)
+				{
+					a3Assert(stackSize <= A3BVHMAXDEPTH);
+					stackNodes[stackSize] = right;
+					stackEntries[stackSize] = tRight;
+					stackMasks[stackSize] = rightMask;
+					stackSize++;
+				}
+			}
+		}
+		return hitMask;
+	}
+
+}
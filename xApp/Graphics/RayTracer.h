@@ -3,6 +3,12 @@
 #include "Math/Math.h"
 #include "Utility/AssetData.h"
 #include "Graphics/Rasterizer2D.h"
+#include "Graphics/Texture.h"
+#include "Graphics/Material.h"
+#include "Graphics/BVH.h"
+#include "Graphics/BVH4.h"
+#include "Graphics/RayPacket.h"
+#include "Utility/JobSystem.h"
 #include "Math/Color.h"
 
 namespace a3 {
@@ -20,14 +26,12 @@ namespace a3 {
 		return b;
 	}
 
-	b32 RayTriangleIntersect(
+	// NOTE(Zero): `v0v1` and `v0v2` are the precomputed edges `v1 - v0` and `v2 - v0`
+	b32 RayTriangleIntersectEdges(
 		const v3 &orig, const v3 &dir,
-		const v3 &v0, const v3 &v1, const v3 &v2,
+		const v3 &v0, const v3 &v0v1, const v3 &v0v2,
 		f32 *nearDistance, f32 *u, f32 *v)
 	{
-		v3 v0v1 = v1 - v0;
-		v3 v0v2 = v2 - v0;
-
 		v3 pvec = Cross(dir, v0v2);
 		f32 det = Dot(v0v1, pvec);
 
@@ -48,6 +52,14 @@ namespace a3 {
 		return true;
 	}
 
+	b32 RayTriangleIntersect(
+		const v3 &orig, const v3 &dir,
+		const v3 &v0, const v3 &v1, const v3 &v2,
+		f32 *nearDistance, f32 *u, f32 *v)
+	{
+		return RayTriangleIntersectEdges(orig, dir, v0, v1 - v0, v2 - v0, nearDistance, u, v);
+	}
+
 
 	b32 RayIntersectMesh(mesh* meshObj, const v3 &orig, const v3 &dir, f32 *tNear, u32 *triIndex, v2 *uv)
 	{
@@ -60,7 +72,7 @@ namespace a3 {
 			const v3 &v1 = vertices[trisIndex[i * 3 + 1]];
 			const v3 &v2 = vertices[trisIndex[i * 3 + 2]];
 			f32 t = max_f32, u, v;
-			if (RayTriangleIntersect(orig, dir, v0, v1, v2, &t, &u, &v) && t < *tNear) {
+			if (RayTriangleIntersect(orig, dir, v0, v1, v2, &t, &u, &v) && t > 0.0f && t < *tNear) {
 				*tNear = t;
 				uv->x = u;
 				uv->y = v;
@@ -72,6 +84,235 @@ namespace a3 {
 		return isect;
 	}
 
+	b32 RayIntersectBVH(const bvh* accel, const v3 &orig, const v3 &dir, f32 *tNear, u32 *triIndex, v2 *uv)
+	{
+		if (!accel->NumOfNodes) return false;
+
+		b32 isect = false;
+		const triangle_block& tris = accel->Triangles;
+		const bvh_node* nodes = accel->Nodes;
+		v3 invDir = v3{ 1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z };
+
+		// NOTE(Zero):
+		// Nodes are pushed along with their entry distance, so that the nodes
+		// farther than the closest hit found so far are skipped when popped
+		u32 stackNodes[A3BVHMAXDEPTH + 1];
+		f32 stackEntries[A3BVHMAXDEPTH + 1];
+		i32 stackSize = 0;
+
+		f32 tEntry;
+		if (!RayIntersectAABB(nodes[0].Min, nodes[0].Max, orig, invDir, *tNear, &tEntry)) return false;
+		stackNodes[stackSize] = 0;
+		stackEntries[stackSize] = tEntry;
+		stackSize++;
+
+		while (stackSize)
+		{
+			stackSize--;
+			if (stackEntries[stackSize] > *tNear) continue;
+			const bvh_node* node = nodes + stackNodes[stackSize];
+
+			if (node->Count)
+			{
+				for (u32 i = node->LeftFirst; i < node->LeftFirst + node->Count; ++i)
+				{
+					v3 v0 = v3{ tris.V0X[i], tris.V0Y[i], tris.V0Z[i] };
+					v3 e1 = v3{ tris.E1X[i], tris.E1Y[i], tris.E1Z[i] };
+					v3 e2 = v3{ tris.E2X[i], tris.E2Y[i], tris.E2Z[i] };
+					f32 t = max_f32, u, v;
+					if (RayTriangleIntersectEdges(orig, dir, v0, e1, e2, &t, &u, &v) && t > 0.0f && t < *tNear) {
+						*tNear = t;
+						uv->x = u;
+						uv->y = v;
+						*triIndex = accel->TriangleIndices[i];
+						isect = true;
+					}
+				}
+			}
+			else
+			{
+				u32 left = node->LeftFirst;
+				u32 right = left + 1;
+				f32 tLeft, tRight;
+				b32 hitLeft = RayIntersectAABB(nodes[left].Min, nodes[left].Max, orig, invDir, *tNear, &tLeft);
+				b32 hitRight = RayIntersectAABB(nodes[right].Min, nodes[right].Max, orig, invDir, *tNear, &tRight);
+
+				// NOTE(Zero): Farther child is pushed first so that the nearer one is visited first
+				if (hitLeft && hitRight && tLeft < tRight)
+				{
+					a3::Swap(&left, &right);
+					a3::Swap(&tLeft, &tRight);
+				}
+				if (hitLeft)
+				{
+					a3Assert(stackSize <= A3BVHMAXDEPTH);
+					stackNodes[stackSize] = left;
+					stackEntries[stackSize] = tLeft;
+					stackSize++;
+				}
+				if (hitRight)
+				{
+					a3Assert(stackSize <= A3BVHMAXDEPTH);
+					stackNodes[stackSize] = right;
+					stackEntries[stackSize] = tRight;
+					stackSize++;
+				}
+			}
+		}
+
+		return isect;
+	}
+
+	// NOTE(Zero):
+	// Same as `RayIntersectBVH` for the 4 wide hierarchy, boxes of all the children of a node are tested at once
+	// Leaf children are intersected right away nearest first, interior ones are pushed so the nearest is visited first
+	b32 RayIntersectBVH4(const bvh4* accel, const v3 &orig, const v3 &dir, f32 *tNear, u32 *triIndex, v2 *uv)
+	{
+		if (!accel->NumOfNodes) return false;
+
+		b32 isect = false;
+		const triangle_block& tris = accel->Triangles;
+		const bvh4_node* nodes = accel->Nodes;
+		v3 invDir = v3{ 1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z };
+
+		u32 stackNodes[A3BVH4STACKSIZE];
+		f32 stackEntries[A3BVH4STACKSIZE];
+		i32 stackSize = 0;
+		stackNodes[stackSize] = 0;
+		stackEntries[stackSize] = -max_f32;
+		stackSize++;
+
+		while (stackSize)
+		{
+			stackSize--;
+			if (stackEntries[stackSize] > *tNear) continue;
+			const bvh4_node* node = nodes + stackNodes[stackSize];
+
+			f32 entries[4];
+			u32 hits = RayIntersectChildren(*node, orig, invDir, *tNear, entries);
+			u32 order[4];
+			u32 numOfHits = 0;
+			for (u32 c = 0; c < 4; ++c)
+			{
+				if (!(hits & (1u << c))) continue;
+				u32 slot = numOfHits++;
+				while (slot > 0 && entries[order[slot - 1]] > entries[c])
+				{
+					order[slot] = order[slot - 1];
+					slot--;
+				}
+				order[slot] = c;
+			}
+
+			for (u32 h = 0; h < numOfHits; ++h)
+			{
+				u32 c = order[h];
+				if (!node->Count[c]) continue;
+				for (u32 i = node->Child[c]; i < node->Child[c] + node->Count[c]; ++i)
+				{
+					v3 v0 = v3{ tris.V0X[i], tris.V0Y[i], tris.V0Z[i] };
+					v3 e1 = v3{ tris.E1X[i], tris.E1Y[i], tris.E1Z[i] };
+					v3 e2 = v3{ tris.E2X[i], tris.E2Y[i], tris.E2Z[i] };
+					f32 t = max_f32, u, v;
+					if (RayTriangleIntersectEdges(orig, dir, v0, e1, e2, &t, &u, &v) && t > 0.0f && t < *tNear) {
+						*tNear = t;
+						uv->x = u;
+						uv->y = v;
+						*triIndex = accel->TriangleIndices[i];
+						isect = true;
+					}
+				}
+			}
+			for (u32 h = numOfHits; h-- > 0;)
+			{
+				u32 c = order[h];
+				if (node->Count[c]) continue;
+				a3Assert(stackSize < A3BVH4STACKSIZE);
+				stackNodes[stackSize] = node->Child[c];
+				stackEntries[stackSize] = entries[c];
+				stackSize++;
+			}
+		}
+
+		return isect;
+	}
+
+	// NOTE(Zero):
+	// Closest hit among the instances of `scene`, `instanceIndex` is the index in `tlas::Instances`
+	// Rays are moved to the space of an instance when they reach its leaf, distances stay the same
+	b32 RayIntersectTLAS(const tlas* scene, const v3 &orig, const v3 &dir, f32 *tNear, u32 *instanceIndex, u32 *triIndex, v2 *uv)
+	{
+		if (!scene->NumOfNodes) return false;
+
+		b32 isect = false;
+		const bvh_node* nodes = scene->Nodes;
+		v3 invDir = v3{ 1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z };
+
+		u32 stackNodes[A3BVHMAXDEPTH + 1];
+		f32 stackEntries[A3BVHMAXDEPTH + 1];
+		i32 stackSize = 0;
+
+		f32 tEntry;
+		if (!RayIntersectAABB(nodes[0].Min, nodes[0].Max, orig, invDir, *tNear, &tEntry)) return false;
+		stackNodes[stackSize] = 0;
+		stackEntries[stackSize] = tEntry;
+		stackSize++;
+
+		while (stackSize)
+		{
+			stackSize--;
+			if (stackEntries[stackSize] > *tNear) continue;
+			const bvh_node* node = nodes + stackNodes[stackSize];
+
+			if (node->Count)
+			{
+				for (u32 i = node->LeftFirst; i < node->LeftFirst + node->Count; ++i)
+				{
+					u32 index = scene->InstanceIndices[i];
+					const bvh_instance& instance = scene->Instances[index];
+					if (!instance.Accel) continue;
+					v3 localOrig, localDir;
+					TransformRay(instance.InverseTransform, orig, dir, &localOrig, &localDir);
+					if (RayIntersectBVH(instance.Accel, localOrig, localDir, tNear, triIndex, uv))
+					{
+						*instanceIndex = index;
+						isect = true;
+					}
+				}
+			}
+			else
+			{
+				u32 left = node->LeftFirst;
+				u32 right = left + 1;
+				f32 tLeft, tRight;
+				b32 hitLeft = RayIntersectAABB(nodes[left].Min, nodes[left].Max, orig, invDir, *tNear, &tLeft);
+				b32 hitRight = RayIntersectAABB(nodes[right].Min, nodes[right].Max, orig, invDir, *tNear, &tRight);
+
+				if (hitLeft && hitRight && tLeft < tRight)
+				{
+					a3::Swap(&left, &right);
+					a3::Swap(&tLeft, &tRight);
+				}
+				if (hitLeft)
+				{
+					a3Assert(stackSize <= A3BVHMAXDEPTH);
+					stackNodes[stackSize] = left;
+					stackEntries[stackSize] = tLeft;
+					stackSize++;
+				}
+				if (hitRight)
+				{
+					a3Assert(stackSize <= A3BVHMAXDEPTH);
+					stackNodes[stackSize] = right;
+					stackEntries[stackSize] = tRight;
+					stackSize++;
+				}
+			}
+		}
+
+		return isect;
+	}
+
 	b32 Trace(mesh* meshObj,
 		const v3 &orig, const v3 &dir,
 		f32 *tNear, u32 *index, v2 *uv)
@@ -90,32 +331,217 @@ namespace a3 {
 		return trace;
 	}
 
+	// NOTE(Zero): Same as above but uses the hierarchy instead of testing every triangle
+	b32 Trace(const bvh* accel,
+		const v3 &orig, const v3 &dir,
+		f32 *tNear, u32 *index, v2 *uv)
+	{
+		f32 tNearTriangle = *tNear;
+		u32 indexTriangle;
+		v2 uvTriangle;
+		b32 trace = false;
+		if (RayIntersectBVH(accel, orig, dir, &tNearTriangle, &indexTriangle, &uvTriangle))
+		{
+			*tNear = tNearTriangle;
+			*index = indexTriangle;
+			*uv = uvTriangle;
+			trace = true;
+		}
+		return trace;
+	}
+
+	b32 Trace(const bvh4* accel,
+		const v3 &orig, const v3 &dir,
+		f32 *tNear, u32 *index, v2 *uv)
+	{
+		f32 tNearTriangle = *tNear;
+		u32 indexTriangle;
+		v2 uvTriangle;
+		b32 trace = false;
+		if (RayIntersectBVH4(accel, orig, dir, &tNearTriangle, &indexTriangle, &uvTriangle))
+		{
+			*tNear = tNearTriangle;
+			*index = indexTriangle;
+			*uv = uvTriangle;
+			trace = true;
+		}
+		return trace;
+	}
+
+	// NOTE(Zero):
+	// Any hit queries for shadow and occlusion rays
+	// Returns true as soon as any triangle is hit in range (0, tMax), the hit need not be the closest
+	b32 Occluded(mesh* meshObj, const v3 &orig, const v3 &dir, f32 tMax)
+	{
+		u32 numTris = meshObj->NumOfTriangles;
+		v3* vertices = meshObj->Vertices;
+		u32* trisIndex = meshObj->VertexIndices;
+		for (u32 i = 0; i < numTris; ++i)
+		{
+			const v3 &v0 = vertices[trisIndex[i * 3 + 0]];
+			const v3 &v1 = vertices[trisIndex[i * 3 + 1]];
+			const v3 &v2 = vertices[trisIndex[i * 3 + 2]];
+			f32 t, u, v;
+			if (RayTriangleIntersect(orig, dir, v0, v1, v2, &t, &u, &v) && t > 0.0f && t < tMax) return true;
+		}
+		return false;
+	}
+
+	b32 Occluded(const bvh* accel, const v3 &orig, const v3 &dir, f32 tMax)
+	{
+		if (!accel->NumOfNodes) return false;
+
+		const triangle_block& tris = accel->Triangles;
+		const bvh_node* nodes = accel->Nodes;
+		v3 invDir = v3{ 1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z };
+
+		// NOTE(Zero): Children are not ordered, any hit ends the traversal
+		u32 stack[A3BVHMAXDEPTH + 1];
+		i32 stackSize = 0;
+		stack[stackSize++] = 0;
+
+		while (stackSize)
+		{
+			const bvh_node* node = nodes + stack[--stackSize];
+			f32 tEntry;
+			if (!RayIntersectAABB(node->Min, node->Max, orig, invDir, tMax, &tEntry)) continue;
+
+			if (node->Count)
+			{
+				for (u32 i = node->LeftFirst; i < node->LeftFirst + node->Count; ++i)
+				{
+					v3 v0 = v3{ tris.V0X[i], tris.V0Y[i], tris.V0Z[i] };
+					v3 e1 = v3{ tris.E1X[i], tris.E1Y[i], tris.E1Z[i] };
+					v3 e2 = v3{ tris.E2X[i], tris.E2Y[i], tris.E2Z[i] };
+					f32 t, u, v;
+					if (RayTriangleIntersectEdges(orig, dir, v0, e1, e2, &t, &u, &v) && t > 0.0f && t < tMax) return true;
+				}
+			}
+			else
+			{
+				a3Assert(stackSize + 2 <= A3BVHMAXDEPTH + 1);
+				stack[stackSize++] = node->LeftFirst + 1;
+				stack[stackSize++] = node->LeftFirst;
+			}
+		}
+
+		return false;
+	}
+
+	b32 Occluded(const bvh4* accel, const v3 &orig, const v3 &dir, f32 tMax)
+	{
+		if (!accel->NumOfNodes) return false;
+
+		const triangle_block& tris = accel->Triangles;
+		const bvh4_node* nodes = accel->Nodes;
+		v3 invDir = v3{ 1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z };
+
+		u32 stack[A3BVH4STACKSIZE];
+		i32 stackSize = 0;
+		stack[stackSize++] = 0;
+
+		while (stackSize)
+		{
+			const bvh4_node* node = nodes + stack[--stackSize];
+			f32 entries[4];
+			u32 hits = RayIntersectChildren(*node, orig, invDir, tMax, entries);
+			for (u32 c = 0; c < 4; ++c)
+			{
+				if (!(hits & (1u << c))) continue;
+				if (node->Count[c])
+				{
+					for (u32 i = node->Child[c]; i < node->Child[c] + node->Count[c]; ++i)
+					{
+						v3 v0 = v3{ tris.V0X[i], tris.V0Y[i], tris.V0Z[i] };
+						v3 e1 = v3{ tris.E1X[i], tris.E1Y[i], tris.E1Z[i] };
+						v3 e2 = v3{ tris.E2X[i], tris.E2Y[i], tris.E2Z[i] };
+						f32 t, u, v;
+						if (RayTriangleIntersectEdges(orig, dir, v0, e1, e2, &t, &u, &v) && t > 0.0f && t < tMax) return true;
+					}
+				}
+				else
+				{
+					a3Assert(stackSize < A3BVH4STACKSIZE);
+					stack[stackSize++] = node->Child[c];
+				}
+			}
+		}
+
+		return false;
+	}
+
+	b32 Occluded(const tlas* scene, const v3 &orig, const v3 &dir, f32 tMax)
+	{
+		if (!scene->NumOfNodes) return false;
 
+		const bvh_node* nodes = scene->Nodes;
+		v3 invDir = v3{ 1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z };
+
+		u32 stack[A3BVHMAXDEPTH + 1];
+		i32 stackSize = 0;
+		stack[stackSize++] = 0;
+
+		while (stackSize)
+		{
+			const bvh_node* node = nodes + stack[--stackSize];
+			f32 tEntry;
+			if (!RayIntersectAABB(node->Min, node->Max, orig, invDir, tMax, &tEntry)) continue;
+
+			if (node->Count)
+			{
+				for (u32 i = node->LeftFirst; i < node->LeftFirst + node->Count; ++i)
+				{
+					const bvh_instance& instance = scene->Instances[scene->InstanceIndices[i]];
+					if (!instance.Accel) continue;
+					v3 localOrig, localDir;
+					TransformRay(instance.InverseTransform, orig, dir, &localOrig, &localDir);
+					if (Occluded(instance.Accel, localOrig, localDir, tMax)) return true;
+				}
+			}
+			else
+			{
+				a3Assert(stackSize + 2 <= A3BVHMAXDEPTH + 1);
+				stack[stackSize++] = node->LeftFirst + 1;
+				stack[stackSize++] = node->LeftFirst;
+			}
+		}
+
+		return false;
+	}
+
+
+	// NOTE(Zero):
+	// `texelDensity` is the ratio of the triangle area in texture space to the area in world space,
+	// the texture coordinates change by about `Sqrtf(texelDensity)` per world unit on the surface
 	void GetSurfaceProperties(mesh* meshObj,
 		const v3 &hitPoi32,
 		const v3 &viewDirection,
 		const u32 &triIndex,
 		const v2 &uv,
 		v3 *hitNormal,
-		v2 *hitTextureCoordinates, b32* texIsPresent)
+		v2 *hitTextureCoordinates, f32* texelDensity, b32* texIsPresent)
 	{
 		v3* vertices = meshObj->Vertices;
 		u32* trisIndex = meshObj->VertexIndices;
 		v2* texCoordinates = meshObj->TextureCoords;
+		u32* texIndex = meshObj->TextureCoordsIndices;
 		// face normal
 		const v3 &p0 = vertices[trisIndex[triIndex * 3 + 0]];
 		const v3 &p1 = vertices[trisIndex[triIndex * 3 + 1]];
 		const v3 &p2 = vertices[trisIndex[triIndex * 3 + 2]];
-		*hitNormal = Cross(p1 - p0, p2 - p0);
-		*hitNormal = Normalize(*hitNormal);
+		v3 faceCross = Cross(p1 - p0, p2 - p0);
+		*hitNormal = Normalize(faceCross);
 
 		// texture coordinates
 		if (texCoordinates)
 		{
-			const v2 &st0 = texCoordinates[triIndex * 3 + 0];
-			const v2 &st1 = texCoordinates[triIndex * 3 + 1];
-			const v2 &st2 = texCoordinates[triIndex * 3 + 2];
+			const v2 &st0 = texIndex ? texCoordinates[texIndex[triIndex * 3 + 0]] : texCoordinates[triIndex * 3 + 0];
+			const v2 &st1 = texIndex ? texCoordinates[texIndex[triIndex * 3 + 1]] : texCoordinates[triIndex * 3 + 1];
+			const v2 &st2 = texIndex ? texCoordinates[texIndex[triIndex * 3 + 2]] : texCoordinates[triIndex * 3 + 2];
 			*hitTextureCoordinates = (1 - uv.x - uv.y) * st0 + uv.x * st1 + uv.y * st2;
+			f32 worldArea = Length(faceCross);
+			f32 texelArea = FAbsf(Cross(st1 - st0, st2 - st0).z);
+			*texelDensity = (worldArea > 0.0f) ? texelArea / worldArea : 0.0f;
 			*texIsPresent = true;
 		}
 		else
@@ -125,64 +551,629 @@ namespace a3 {
 	}
 
 
-	u32 CastRay(v3 origin, v3 dir, mesh* meshObj, a3::image* frameBuffer, a3::image* texture)
+	// NOTE(Zero):
+	// Color of the surface of `meshObj` hit by the ray at distance `tnear`
+	// `normalTransform` takes the normals of the mesh to world space, null when the mesh is already in world space
+	// `spread` is the angle covered by a pixel, the footprint of the pixel on the surface selects the texture level
+	v3 ShadeMeshHit(v3 origin, v3 dir, mesh* meshObj, const m4x4* normalTransform, f32 tnear, u32 index, v2 uv, const a3::texture* texture, f32 spread)
+	{
+		v3 hitPoint = origin + dir * tnear;
+		v3 hitNormal;
+		v2 hitTexCoordinates;
+		f32 texelDensity = 0.0f;
+		b32 texPresent;
+		GetSurfaceProperties(meshObj, hitPoint, dir, index, uv, &hitNormal, &hitTexCoordinates, &texelDensity, &texPresent);
+		if (normalTransform)
+		{
+			hitNormal = Normalize((v4{ hitNormal.x, hitNormal.y, hitNormal.z, 0.0f } * (*normalTransform)).xyz);
+		}
+		f32 normDotView = Max(0.f, Dot(hitNormal, -dir));
+		const f32 mat = 10.0f;
+		v3 hitColor = a3::color::Blurple; // default color
+		if (texPresent)
+		{
+			if (texture)
+			{
+				// NOTE(Zero): Footprint grows with the distance and stretches as the surface turns away from the ray
+				f32 footprint = spread * tnear / Max(normDotView, 0.01f) * Sqrtf(texelDensity);
+				f32 level = a3::QueryTextureLevel(texture, v2{ footprint, 0.0f }, v2{ 0.0f, footprint });
+				hitColor = a3MakeRGBAv4(a3::SampleTextureTrilinear(texture, hitTexCoordinates, level)).rgb;
+			}
+			else
+			{
+				f32 checker = (f32)((FModf(hitTexCoordinates.x * mat, 1.0f) > 0.5f) ^ (FModf(hitTexCoordinates.y * mat, 1.0f) < 0.5f));
+				f32 cs = 0.3f * (1.0f - checker) + 0.7f * checker;
+				hitColor = v3{ cs,cs,cs };
+			}
+		}
+		hitColor *= normDotView;
+		return hitColor;
+	}
+
+	v3 ShadeHit(v3 origin, v3 dir, const bvh* accel, f32 tnear, u32 index, v2 uv, const a3::texture* texture, f32 spread)
+	{
+		return ShadeMeshHit(origin, dir, accel->Mesh, A3NULL, tnear, index, uv, texture, spread);
+	}
+
+	v3 ShadeHit(v3 origin, v3 dir, const bvh4* accel, f32 tnear, u32 index, v2 uv, const a3::texture* texture, f32 spread)
+	{
+		return ShadeMeshHit(origin, dir, accel->Mesh, A3NULL, tnear, index, uv, texture, spread);
+	}
+
+	// NOTE(Zero):
+	// Normals are moved to world space with the inverse transpose of the instance transform
+	// Texel density is the one of the mesh, so the texture level ignores the scale of the instance
+	v3 ShadeHit(v3 origin, v3 dir, const tlas* scene, u32 instanceIndex, f32 tnear, u32 index, v2 uv, const a3::texture* texture, f32 spread)
 	{
-		v3 hitColor;
-		hitColor = a3::color::Black;
+		const bvh_instance& instance = scene->Instances[instanceIndex];
+		m4x4 normalTransform = m4x4::Transpose(instance.InverseTransform);
+		return ShadeMeshHit(origin, dir, instance.Accel->Mesh, &normalTransform, tnear, index, uv, texture, spread);
+	}
 
+	u32 CastRay(v3 origin, v3 dir, const bvh* accel, a3::image* frameBuffer, const a3::texture* texture, f32 spread)
+	{
 		f32 tnear = max_f32;
 		v2 uv;
 		u32 index = 0;
-		if (Trace(meshObj, origin, dir, &tnear, &index, &uv))
+		if (Trace(accel, origin, dir, &tnear, &index, &uv))
+		{
+			return a3Normalv3ToRGBA(ShadeHit(origin, dir, accel, tnear, index, uv, texture, spread), 0xffffff);
+		}
+		return a3Normalv3ToRGBA(a3::color::Black, 0xffffff);
+	}
+
+	// NOTE(Zero):
+	// Shared between the thread calling `RayTrace` and the rest of the application
+	// Tiles completed are counted over all the passes, all members are updated atomically
+	// Setting `Cancel` to non zero (`CancelRayTrace`) stops the render after the tiles in flight
+	struct ray_trace_progress
+	{
+		volatile i32 TilesCompleted;
+		volatile i32 TotalTiles;
+		volatile i32 PassesCompleted;
+		volatile i32 Cancel;
+	};
+
+	void CancelRayTrace(ray_trace_progress* progress)
+	{
+		AtomicExchange(&progress->Cancel, true);
+	}
+
+	// NOTE(Zero): Percentage of tiles completed, `major` is the integer part and `minor` the 2 decimal digits
+	void QueryRayTraceProgress(ray_trace_progress* progress, i32* major, i32* minor)
+	{
+		i32 total = AtomicLoad(&progress->TotalTiles);
+		i32 completed = AtomicLoad(&progress->TilesCompleted);
+		i32 percent = total ? (i32)(((i64)completed * 10000) / total) : 0;
+		*major = percent / 100;
+		*minor = percent % 100;
+	}
+
+}
+
+// NOTE(Zero): Paths shorter than this are never terminated by Russian roulette
+#define A3_PATH_ROULETTE_DEPTH 2
+
+// NOTE(Zero): Weight of a sample of density `f` against another strategy of density `g` for the same direction
+static inline f32 a3_PowerHeuristic(f32 f, f32 g)
+{
+	f32 f2 = f * f;
+	f32 g2 = g * g;
+	return (f2 + g2 > 0.0f) ? f2 / (f2 + g2) : 0.0f;
+}
+
+static inline f32 a3_MaxComponent(v3 v)
+{
+	return a3::Max(v.x, a3::Max(v.y, v.z));
+}
+
+// NOTE(Zero): Radiance is clamped to [0, 1] and gamma corrected with an exponent of 1/2 before display
+static inline v3 a3_PathToDisplay(v3 radiance)
+{
+	return v3{
+		Sqrtf(a3::Min(a3::Max(radiance.r, 0.0f), 1.0f)),
+		Sqrtf(a3::Min(a3::Max(radiance.g, 0.0f), 1.0f)),
+		Sqrtf(a3::Min(a3::Max(radiance.b, 0.0f), 1.0f)) };
+}
+
+namespace a3 {
+
+	// NOTE(Zero):
+	// Scene of the path tracer, `MaterialIndices` gives the index in `Materials` of every triangle of `Mesh`,
+	// all the triangles use `Materials[0]` if it is null
+	// Rays leaving the scene see the constant radiance `Sky`, paths have at most `MaxDepth` bounces
+	// Emissive triangles are sampled in proportion to their power, `LightCdf` is the running sum of the power
+	// of the triangles in `Lights`, so every light triangle is picked with probability Luminance(emission) * area / `LightPower`
+	// Hierarchy is not part of the scene, the same scene is traced with either a bvh or a bvh4 of `Mesh`
+	struct path_scene
+	{
+		mesh* Mesh;
+		const material* Materials;
+		const u32* MaterialIndices;
+		v3 Sky;
+		u32 MaxDepth;
+		// NOTE(Zero): Distance by which secondary rays are moved off the surface, relative to the size of the mesh
+		f32 Epsilon;
+		u32* Lights;
+		f32* LightCdf;
+		u32 NumOfLights;
+		f32 LightPower;
+	};
+
+	inline const material& QueryMaterial(const path_scene* scene, u32 triIndex)
+	{
+		return scene->Materials[scene->MaterialIndices ? scene->MaterialIndices[triIndex] : 0];
+	}
+
+	// NOTE(Zero):
+	// `materials` and `materialIndices` are not copied and must stay alive as long as the scene
+	// Returned scene should be freed using `FreePathScene`
+	path_scene CreatePathScene(mesh* meshObj, const material* materials, const u32* materialIndices, v3 sky, u32 maxDepth)
+	{
+		path_scene result = {};
+		result.Mesh = meshObj;
+		result.Materials = materials;
+		result.MaterialIndices = materialIndices;
+		result.Sky = sky;
+		result.MaxDepth = maxDepth;
+
+		f32 extent = 0.0f;
+		for (u32 i = 0; i < meshObj->NumOfVertices; ++i)
+		{
+			v3 p = meshObj->Vertices[i];
+			extent = Max(extent, Max(FAbsf(p.x), Max(FAbsf(p.y), FAbsf(p.z))));
+		}
+		result.Epsilon = 1e-4f * Max(extent, 1.0f);
+
+		u32 numOfLights = 0;
+		for (u32 i = 0; i < meshObj->NumOfTriangles; ++i)
+		{
+			if (Luminance(QueryMaterial(&result, i).Emission) > 0.0f) numOfLights++;
+		}
+		if (!numOfLights) return result;
+
+		result.Lights = a3Malloc(sizeof(u32) * numOfLights, u32);
+		result.LightCdf = a3Malloc(sizeof(f32) * numOfLights, f32);
+		v3* vertices = meshObj->Vertices;
+		u32* trisIndex = meshObj->VertexIndices;
+		for (u32 i = 0; i < meshObj->NumOfTriangles; ++i)
+		{
+			f32 radiance = Luminance(QueryMaterial(&result, i).Emission);
+			if (radiance <= 0.0f) continue;
+			const v3 &v0 = vertices[trisIndex[i * 3 + 0]];
+			const v3 &v1 = vertices[trisIndex[i * 3 + 1]];
+			const v3 &v2 = vertices[trisIndex[i * 3 + 2]];
+			f32 area = 0.5f * Length(Cross(v1 - v0, v2 - v0));
+			if (area <= 0.0f) continue;
+			result.LightPower += radiance * area;
+			result.Lights[result.NumOfLights] = i;
+			result.LightCdf[result.NumOfLights] = result.LightPower;
+			result.NumOfLights++;
+		}
+		return result;
+	}
+
+	void FreePathScene(path_scene* scene)
+	{
+		if (scene->Lights) a3Free(scene->Lights);
+		if (scene->LightCdf) a3Free(scene->LightCdf);
+		scene->Lights = A3NULL;
+		scene->LightCdf = A3NULL;
+		scene->NumOfLights = 0;
+	}
+
+	// NOTE(Zero):
+	// Radiance along one path starting with a camera ray whose closest hit has already been found (`hit` is false for a miss)
+	// At every bounce the lights are sampled directly (next event estimation) with an `Occluded` shadow ray, one for a light triangle
+	// and one for a cosine distributed sky direction, and the path continues in a direction sampled from the BSDF
+	// Emission found by the BSDF direction is weighted against the light samples with the power heuristic so neither counts twice
+	// Each bounce traces one closest hit and at most two shadow rays, after `A3_PATH_ROULETTE_DEPTH` bounces paths are
+	// terminated with a probability based on their throughput, so dim paths stop early without biasing the result
+	template <typename accel_type>
+	v3 TracePath(const path_scene* scene, const accel_type* accel, v3 orig, v3 dir, b32 hit, f32 tnear, u32 index, v2 uv, const a3::texture* texture, path_sampler* sampler)
+	{
+		v3 radiance = v3{ 0.0f, 0.0f, 0.0f };
+		v3 throughput = v3{ 1.0f, 1.0f, 1.0f };
+		// NOTE(Zero): Density of the direction sampled at the previous bounce, 0 for camera rays whose emission is never weighted
+		f32 bsdfPdf = 0.0f;
+		v3 prevNormal = v3{ 0.0f, 0.0f, 0.0f };
+		v3* vertices = scene->Mesh->Vertices;
+		u32* trisIndex = scene->Mesh->VertexIndices;
+
+		for (u32 depth = 0;; ++depth)
 		{
-			v3 hitPoint = origin + dir * tnear;
-			v3 hitNormal;
-			v2 hitTexCoordinates;
+			if (!hit)
+			{
+				f32 weight = 1.0f;
+				if (bsdfPdf > 0.0f) weight = a3_PowerHeuristic(bsdfPdf, Max(Dot(prevNormal, dir), 0.0f) / a3Pi32);
+				radiance += throughput * scene->Sky * weight;
+				break;
+			}
+
+			v3 hitPoint = orig + dir * tnear;
+			v3 normal;
+			v2 texCoordinates;
+			f32 texelDensity = 0.0f;
 			b32 texPresent;
-			GetSurfaceProperties(meshObj, hitPoint, dir, index, uv, &hitNormal, &hitTexCoordinates, &texPresent);
-			f32 normDotView = Max(0.f, Dot(hitNormal, -dir));
-			const f32 mat = 10.0f;
-			hitColor = a3::color::Blurple; // default color
-			if (texPresent)
+			GetSurfaceProperties(scene->Mesh, hitPoint, dir, index, uv, &normal, &texCoordinates, &texelDensity, &texPresent);
+			material surface = QueryMaterial(scene, index);
+
+			// NOTE(Zero): Only front faces emit, surfaces are two sided for scattering so the normal is turned towards the ray
+			f32 cosLight = -Dot(normal, dir);
+			if (cosLight > 0.0f && Luminance(surface.Emission) > 0.0f)
 			{
-				if (texture)
+				f32 weight = 1.0f;
+				if (bsdfPdf > 0.0f)
 				{
-					hitColor = a3::SamplePixelColor(texture, hitTexCoordinates).rgb;
+					f32 lightPdf = Luminance(surface.Emission) / scene->LightPower * tnear * tnear / cosLight;
+					weight = a3_PowerHeuristic(bsdfPdf, lightPdf);
 				}
-				else
+				radiance += throughput * surface.Emission * weight;
+			}
+			if (cosLight < 0.0f) normal = -normal;
+
+			if (depth >= scene->MaxDepth) break;
+			if (texture && texPresent) surface.Albedo = surface.Albedo * a3MakeRGBAv4(a3::SampleTextureBilinear(texture, texCoordinates, 0)).rgb;
+
+			v3 wo = -dir;
+			v3 surfacePoint = hitPoint + normal * scene->Epsilon;
+
+			if (scene->NumOfLights && Luminance(surface.Albedo) + Luminance(surface.Specular) > 0.0f)
+			{
+				// NOTE(Zero): Light triangle is found by binary search of the power, point on it is uniform over its area
+				f32 target = NextSample(sampler) * scene->LightPower;
+				u32 first = 0;
+				u32 last = scene->NumOfLights - 1;
+				while (first < last)
+				{
+					u32 mid = (first + last) / 2;
+					if (scene->LightCdf[mid] <= target) first = mid + 1;
+					else last = mid;
+				}
+				u32 light = scene->Lights[first];
+				f32 su = Sqrtf(NextSample(sampler));
+				f32 sv = NextSample(sampler);
+				const v3 &v0 = vertices[trisIndex[light * 3 + 0]];
+				const v3 &v1 = vertices[trisIndex[light * 3 + 1]];
+				const v3 &v2 = vertices[trisIndex[light * 3 + 2]];
+				v3 lightPoint = v0 * (1.0f - su) + v1 * (su * (1.0f - sv)) + v2 * (su * sv);
+				v3 lightNormal = Normalize(Cross(v1 - v0, v2 - v0));
+
+				v3 toLight = lightPoint - surfacePoint;
+				f32 distance = Length(toLight);
+				v3 wi = toLight * (1.0f / distance);
+				f32 cosSurface = Dot(normal, wi);
+				f32 cosEmitter = -Dot(lightNormal, wi);
+				if (cosSurface > 0.0f && cosEmitter > 0.0f)
+				{
+					f32 pdf;
+					v3 value = EvaluateMaterial(surface, normal, wo, wi, &pdf);
+					if (pdf > 0.0f && !Occluded(accel, surfacePoint, wi, distance - 2.0f * scene->Epsilon))
+					{
+						const v3& emission = QueryMaterial(scene, light).Emission;
+						f32 lightPdf = Luminance(emission) / scene->LightPower * distance * distance / cosEmitter;
+						radiance += throughput * value * emission * (cosSurface * a3_PowerHeuristic(lightPdf, pdf) / lightPdf);
+					}
+				}
+			}
+
+			if (Luminance(scene->Sky) > 0.0f && Luminance(surface.Albedo) + Luminance(surface.Specular) > 0.0f)
+			{
+				f32 u1 = NextSample(sampler);
+				f32 u2 = NextSample(sampler);
+				v3 wi = SampleCosineHemisphere(normal, u1, u2);
+				f32 cosSurface = Dot(normal, wi);
+				f32 skyPdf = cosSurface / a3Pi32;
+				f32 pdf;
+				v3 value = EvaluateMaterial(surface, normal, wo, wi, &pdf);
+				if (skyPdf > 0.0f && pdf > 0.0f && !Occluded(accel, surfacePoint, wi, max_f32))
 				{
-					f32 checker = (f32)((FModf(hitTexCoordinates.x * mat, 1.0f) > 0.5f) ^ (FModf(hitTexCoordinates.y * mat, 1.0f) < 0.5f));
-					f32 cs = 0.3f * (1.0f - checker) + 0.7f * checker;
-					hitColor = v3{ cs,cs,cs };
+					radiance += throughput * value * scene->Sky * (cosSurface * a3_PowerHeuristic(skyPdf, pdf) / skyPdf);
 				}
 			}
-			hitColor *= normDotView;
+
+			v3 wi, weight;
+			if (!SampleMaterial(surface, normal, wo, sampler, &wi, &weight, &bsdfPdf)) break;
+			throughput = throughput * weight;
+
+			if (depth >= A3_PATH_ROULETTE_DEPTH)
+			{
+				f32 survival = Min(a3_MaxComponent(throughput), 0.95f);
+				if (NextSample(sampler) >= survival) break;
+				throughput = throughput * (1.0f / survival);
+			}
+
+			prevNormal = normal;
+			orig = surfacePoint;
+			dir = wi;
+			tnear = max_f32;
+			hit = Trace(accel, orig, dir, &tnear, &index, &uv);
 		}
 
-		u32 hitHexColor = a3Normalv3ToRGBA(hitColor, 0xffffff);
-		return hitHexColor;
+		return radiance;
 	}
 
-	void RayTrace(image* frameBuffer, mesh* meshObj, const m4x4& view, a3::image* texture, i32* major, i32* minor)
+}
+
+#define A3_RAY_TRACE_TILE_SIZE 16
+#define A3_RAY_PACKET_WIDTH 4
+#define A3_RAY_PACKET_HEIGHT (A3RAYPACKETSIZE / A3_RAY_PACKET_WIDTH)
+
+// NOTE(Zero): Van der Corput radical inverse of `index` in `base`, in range [0, 1)
+static f32 a3_RadicalInverse(u32 index, u32 base)
+{
+	f32 invBase = 1.0f / (f32)base;
+	f32 fraction = invBase;
+	f32 result = 0.0f;
+	while (index)
 	{
-		f32 aspectRatio = (f32)frameBuffer->Height / (f32)frameBuffer->Width;
-		v3 origin = v3{ 0,0,0 } *view;
+		result += (f32)(index % base) * fraction;
+		index /= base;
+		fraction *= invBase;
+	}
+	return result;
+}
+
+struct a3_ray_trace_tiles
+{
+	a3::image* FrameBuffer;
+	const a3::texture* Texture;
+	// NOTE(Zero): Only one of `Accel`, `Accel4` and `Scene` is set
+	const a3::bvh* Accel;
+	const a3::bvh4* Accel4;
+	const a3::tlas* Scene;
+	a3::ray_packet_function TracePacket;
+	a3::ray_packet4_function TracePacket4;
+	// NOTE(Zero): Set by `PathTrace`, camera rays are then continued as paths instead of shaded directly
+	const a3::path_scene* Paths;
+	a3::ray_trace_progress* Progress;
+	// NOTE(Zero): Sum of the samples of each pixel, `NumOfSamples` samples have been added to every pixel
+	v3* Accumulation;
+	i32 NumOfSamples;
+	v2 Jitter;
+	m4x4 View;
+	v3 Origin;
+	f32 AspectRatio;
+	// NOTE(Zero): Angle covered by a pixel at the center of the image
+	f32 Spread;
+	i32 NumOfTilesX;
+	i32 NumOfTiles;
+};
+
+// NOTE(Zero):
+// Traces one sample per pixel of the tile, adds it to the accumulation buffer and
+// writes the average to the frame buffer, so the frame buffer is displayable at any point
+static void a3_RayTraceTile(void* userData, u32 tileIndex, u32)
+{
+	a3_ray_trace_tiles* tiles = (a3_ray_trace_tiles*)userData;
+	if (a3::AtomicLoad(&tiles->Progress->Cancel)) return;
+
+	a3::image* frameBuffer = tiles->FrameBuffer;
 
-		for (i32 j = 0; j < frameBuffer->Height; j++)
+	i32 x0 = ((i32)tileIndex % tiles->NumOfTilesX) * A3_RAY_TRACE_TILE_SIZE;
+	i32 y0 = ((i32)tileIndex / tiles->NumOfTilesX) * A3_RAY_TRACE_TILE_SIZE;
+	i32 x1 = x0 + A3_RAY_TRACE_TILE_SIZE;
+	i32 y1 = y0 + A3_RAY_TRACE_TILE_SIZE;
+	if (x1 > frameBuffer->Width) x1 = frameBuffer->Width;
+	if (y1 > frameBuffer->Height) y1 = frameBuffer->Height;
+
+	f32 invSamples = 1.0f / (f32)(tiles->NumOfSamples + 1);
+
+	// NOTE(Zero): Each packet covers a block of 4x2 pixels, neighbouring rays mostly visit the same nodes
+	a3::ray_packet packet;
+	for (i32 by = y0; by < y1; by += A3_RAY_PACKET_HEIGHT)
+	{
+		for (i32 bx = x0; bx < x1; bx += A3_RAY_PACKET_WIDTH)
 		{
-			for (i32 i = 0; i < frameBuffer->Width; i++)
+			u32 activeMask = 0;
+			for (i32 r = 0; r < A3RAYPACKETSIZE; ++r)
 			{
-				f32 x = (2.0f * ((f32)i + 0.5f) / (f32)frameBuffer->Width - 1.0f) * aspectRatio;
-				f32 y = (1.0f - 2.0f * ((f32)j + 0.5f) / (f32)frameBuffer->Height);
-				v3 dir = v3{ x,y,1.0f } *view;
+				i32 i = bx + r % A3_RAY_PACKET_WIDTH;
+				i32 j = by + r / A3_RAY_PACKET_WIDTH;
+				f32 x = (2.0f * ((f32)i + tiles->Jitter.x) / (f32)frameBuffer->Width - 1.0f) * tiles->AspectRatio;
+				// NOTE(Zero): Rows go from the bottom up like the frame buffers of the rasterizer and `image`
+				f32 y = (2.0f * ((f32)j + tiles->Jitter.y) / (f32)frameBuffer->Height - 1.0f);
+				// NOTE(Zero): Point on the image plane is transformed, the ray goes from the origin through it
+				v3 dir = v3{ x,y,1.0f } *tiles->View - tiles->Origin;
 				dir = Normalize(dir);
-				u32 hColor = CastRay(origin, dir, meshObj, frameBuffer, texture);
-				a3::SetPixel(frameBuffer, i, j, hColor);
-				f32 percentComplete = (f32)x*(f32)y / ((f32)(frameBuffer->Width*frameBuffer->Height));
-				*major = (i32)percentComplete;
-				*minor = (i32)((f32)(percentComplete - *major)*100.0f);
+				packet.OrigX[r] = tiles->Origin.x;
+				packet.OrigY[r] = tiles->Origin.y;
+				packet.OrigZ[r] = tiles->Origin.z;
+				packet.DirX[r] = dir.x;
+				packet.DirY[r] = dir.y;
+				packet.DirZ[r] = dir.z;
+				packet.TNear[r] = max_f32;
+				packet.TriIndex[r] = 0;
+				if (i < x1 && j < y1) activeMask |= (1u << r);
+			}
+
+			u32 hitMask;
+			if (tiles->Scene) hitMask = a3::RayIntersectTLASPacket(tiles->Scene, &packet, activeMask, tiles->TracePacket);
+			else if (tiles->Accel4) hitMask = tiles->TracePacket4(tiles->Accel4, &packet, activeMask);
+			else hitMask = tiles->TracePacket(tiles->Accel, &packet, activeMask);
+
+			for (i32 r = 0; r < A3RAYPACKETSIZE; ++r)
+			{
+				if (!(activeMask & (1u << r))) continue;
+				i32 i = bx + r % A3_RAY_PACKET_WIDTH;
+				i32 j = by + r / A3_RAY_PACKET_WIDTH;
+				v3 color = a3::color::Black;
+				if (tiles->Paths)
+				{
+					v3 dir = v3{ packet.DirX[r], packet.DirY[r], packet.DirZ[r] };
+					v2 uv = v2{ packet.U[r], packet.V[r] };
+					b32 hit = (hitMask & (1u << r)) != 0;
+					a3::path_sampler sampler = a3::CreatePathSampler((u32)(i + j * frameBuffer->Width), (u32)tiles->NumOfSamples);
+					if (tiles->Accel4)
+						color = a3::TracePath(tiles->Paths, tiles->Accel4, tiles->Origin, dir, hit, packet.TNear[r], packet.TriIndex[r], uv, tiles->Texture, &sampler);
+					else
+						color = a3::TracePath(tiles->Paths, tiles->Accel, tiles->Origin, dir, hit, packet.TNear[r], packet.TriIndex[r], uv, tiles->Texture, &sampler);
+				}
+				else if (hitMask & (1u << r))
+				{
+					v3 dir = v3{ packet.DirX[r], packet.DirY[r], packet.DirZ[r] };
+					v2 uv = v2{ packet.U[r], packet.V[r] };
+					if (tiles->Scene)
+						color = a3::ShadeHit(tiles->Origin, dir, tiles->Scene, packet.InstanceIndex[r], packet.TNear[r], packet.TriIndex[r], uv, tiles->Texture, tiles->Spread);
+					else if (tiles->Accel4)
+						color = a3::ShadeHit(tiles->Origin, dir, tiles->Accel4, packet.TNear[r], packet.TriIndex[r], uv, tiles->Texture, tiles->Spread);
+					else
+						color = a3::ShadeHit(tiles->Origin, dir, tiles->Accel, packet.TNear[r], packet.TriIndex[r], uv, tiles->Texture, tiles->Spread);
+				}
+				v3* sum = tiles->Accumulation + (i + j * frameBuffer->Width);
+				*sum += color;
+				v3 average = tiles->Paths ? a3_PathToDisplay(*sum * invSamples) : *sum * invSamples;
+				a3::SetPixel(frameBuffer, i, j, a3Normalv3ToRGBA(average, 0xffffff));
 			}
 		}
 	}
 
-}
\ No newline at end of file
+	a3::AtomicIncrement(&tiles->Progress->TilesCompleted);
+}
+
+// NOTE(Zero): Splits the frame buffer into tiles and resets the progress, returns false if already cancelled
+static b32 a3_BeginRayTrace(a3_ray_trace_tiles* tiles, a3::image* frameBuffer, i32 numOfPasses, a3::ray_trace_progress* progress)
+{
+	tiles->NumOfTilesX = (frameBuffer->Width + A3_RAY_TRACE_TILE_SIZE - 1) / A3_RAY_TRACE_TILE_SIZE;
+	i32 numOfTilesY = (frameBuffer->Height + A3_RAY_TRACE_TILE_SIZE - 1) / A3_RAY_TRACE_TILE_SIZE;
+	tiles->NumOfTiles = tiles->NumOfTilesX * numOfTilesY;
+
+	a3::AtomicExchange(&progress->TilesCompleted, 0);
+	a3::AtomicExchange(&progress->PassesCompleted, 0);
+	a3::AtomicExchange(&progress->TotalTiles, tiles->NumOfTiles * numOfPasses);
+	return !a3::AtomicLoad(&progress->Cancel);
+}
+
+// NOTE(Zero): Runs the passes of `RayTrace`, `tiles` has the scene to trace set
+static i32 a3_RayTracePasses(a3_ray_trace_tiles* tiles, a3::image* frameBuffer, const m4x4& view, const a3::texture* texture, i32 numOfPasses, a3::ray_trace_progress* progress)
+{
+	tiles->FrameBuffer = frameBuffer;
+	tiles->Texture = texture;
+	tiles->TracePacket = a3::QueryRayPacketFunction(a3::QuerySIMDLevel());
+	tiles->TracePacket4 = a3::QueryRayPacket4Function(a3::QuerySIMDLevel());
+	tiles->Progress = progress;
+	tiles->Accumulation = a3Calloc(sizeof(v3) * frameBuffer->Width * frameBuffer->Height, v3);
+	tiles->View = view;
+	tiles->Origin = v3{ 0,0,0 } *view;
+	tiles->AspectRatio = (f32)frameBuffer->Height / (f32)frameBuffer->Width;
+	v3 center = v3{ 0.0f, 0.0f, 1.0f } *view - tiles->Origin;
+	v3 pixelStep = v3{ 0.0f, 2.0f / (f32)frameBuffer->Height, 1.0f } *view - tiles->Origin - center;
+	tiles->Spread = Length(pixelStep) / Length(center);
+
+	i32 pass = 0;
+	for (; pass < numOfPasses; ++pass)
+	{
+		if (a3::AtomicLoad(&progress->Cancel)) break;
+
+		// NOTE(Zero):
+		// First pass samples the pixel centers, rest follow the Halton(2, 3) sequence
+		// All rays of a pass share the offset so the packets stay coherent
+		tiles->NumOfSamples = pass;
+		tiles->Jitter = (pass == 0) ? v2{ 0.5f, 0.5f } : v2{ a3_RadicalInverse(pass, 2), a3_RadicalInverse(pass, 3) };
+
+		a3::job_counter counter = {};
+		a3::Jobs.Dispatch(a3_RayTraceTile, tiles, (u32)tiles->NumOfTiles, &counter);
+		a3::Jobs.Wait(&counter);
+
+		// NOTE(Zero): Tiles skipped because of cancellation leave the pass incomplete
+		if (a3::AtomicLoad(&progress->Cancel)) break;
+		a3::AtomicIncrement(&progress->PassesCompleted);
+	}
+
+	a3Free(tiles->Accumulation);
+	return pass;
+}
+
+namespace a3 {
+
+	// NOTE(Zero):
+	// Renders `numOfPasses` samples per pixel, every pass is one sample at a different sub pixel position
+	// Frame buffer is split into tiles of `A3_RAY_TRACE_TILE_SIZE` and each tile is a job
+	// The calling thread also executes tiles until the pass is finished
+	// Frame buffer always contains the average of the samples traced so far
+	// Returns the number of passes completed, less than `numOfPasses` if cancelled
+	i32 RayTrace(image* frameBuffer, mesh* meshObj, const m4x4& view, const a3::texture* texture, i32 numOfPasses, ray_trace_progress* progress)
+	{
+		a3_ray_trace_tiles tiles;
+		if (!a3_BeginRayTrace(&tiles, frameBuffer, numOfPasses, progress)) return 0;
+
+		bvh accel = BuildBVHBinned(meshObj);
+		tiles.Accel = &accel;
+		tiles.Accel4 = A3NULL;
+		tiles.Scene = A3NULL;
+		tiles.Paths = A3NULL;
+		i32 pass = a3_RayTracePasses(&tiles, frameBuffer, view, texture, numOfPasses, progress);
+
+		FreeBVH(&accel);
+		return pass;
+	}
+
+	// NOTE(Zero): Same as above with a hierarchy built by the caller, e.g. `dynamic_bvh::Accel` of an animated mesh
+	i32 RayTrace(image* frameBuffer, const bvh* accel, const m4x4& view, const a3::texture* texture, i32 numOfPasses, ray_trace_progress* progress)
+	{
+		a3_ray_trace_tiles tiles;
+		if (!a3_BeginRayTrace(&tiles, frameBuffer, numOfPasses, progress)) return 0;
+
+		tiles.Accel = accel;
+		tiles.Accel4 = A3NULL;
+		tiles.Scene = A3NULL;
+		tiles.Paths = A3NULL;
+		return a3_RayTracePasses(&tiles, frameBuffer, view, texture, numOfPasses, progress);
+	}
+
+	i32 RayTrace(image* frameBuffer, const bvh4* accel, const m4x4& view, const a3::texture* texture, i32 numOfPasses, ray_trace_progress* progress)
+	{
+		a3_ray_trace_tiles tiles;
+		if (!a3_BeginRayTrace(&tiles, frameBuffer, numOfPasses, progress)) return 0;
+
+		tiles.Accel = A3NULL;
+		tiles.Accel4 = accel;
+		tiles.Scene = A3NULL;
+		tiles.Paths = A3NULL;
+		return a3_RayTracePasses(&tiles, frameBuffer, view, texture, numOfPasses, progress);
+	}
+
+	// NOTE(Zero):
+	// Same as above for the instances of `scene`, the hierarchies are built by the caller
+	// and shared between the instances, so repeated meshes are stored only once
+	i32 RayTrace(image* frameBuffer, const tlas* scene, const m4x4& view, const a3::texture* texture, i32 numOfPasses, ray_trace_progress* progress)
+	{
+		a3_ray_trace_tiles tiles;
+		if (!a3_BeginRayTrace(&tiles, frameBuffer, numOfPasses, progress)) return 0;
+
+		tiles.Accel = A3NULL;
+		tiles.Accel4 = A3NULL;
+		tiles.Scene = scene;
+		tiles.Paths = A3NULL;
+		return a3_RayTracePasses(&tiles, frameBuffer, view, texture, numOfPasses, progress);
+	}
+
+	// NOTE(Zero):
+	// Path traces `scene` with the hierarchy `accel` built over `scene->Mesh`, on the same tiles and passes as `RayTrace`
+	// Every pass adds one path per pixel, camera rays are still traced in packets and only the bounces are traced one by one
+	// `texture` multiplies the albedo of the materials when the mesh has texture coordinates
+	i32 PathTrace(image* frameBuffer, const path_scene* scene, const bvh* accel, const m4x4& view, const a3::texture* texture, i32 numOfPasses, ray_trace_progress* progress)
+	{
+		a3_ray_trace_tiles tiles;
+		if (!a3_BeginRayTrace(&tiles, frameBuffer, numOfPasses, progress)) return 0;
+
+		tiles.Accel = accel;
+		tiles.Accel4 = A3NULL;
+		tiles.Scene = A3NULL;
+		tiles.Paths = scene;
+		return a3_RayTracePasses(&tiles, frameBuffer, view, texture, numOfPasses, progress);
+	}
+
+	i32 PathTrace(image* frameBuffer, const path_scene* scene, const bvh4* accel, const m4x4& view, const a3::texture* texture, i32 numOfPasses, ray_trace_progress* progress)
+	{
+		a3_ray_trace_tiles tiles;
+		if (!a3_BeginRayTrace(&tiles, frameBuffer, numOfPasses, progress)) return 0;
+
+		tiles.Accel = A3NULL;
+		tiles.Accel4 = accel;
+		tiles.Scene = A3NULL;
+		tiles.Paths = scene;
+		return a3_RayTracePasses(&tiles, frameBuffer, view, texture, numOfPasses, progress);
+	}
+
+}
@@ -0,0 +1,405 @@
+#pragma once
+#include "Common/Core.h"
+#include "Platform/Platform.h"
+#include "Utility/AssetData.h"
+
+//
+// DECLARATIONS
+//
+
+// NOTE(Zero): Enough levels for textures up to 32768 texels wide
+#define A3_TEXTURE_MAX_LEVELS 16
+
+namespace a3 {
+
+	// NOTE(Zero):
+	// Texels of a level are stored in tiles of 4x4 texels (64 bytes, a cache line), tiles are in row major order
+	// and texels inside of a tile are in Morton order, so a bilinear footprint mostly lies in a single tile
+	// `TilesX` is number of tiles in a row, width and height are padded up to a multiple of 4
+	struct texture_level
+	{
+		u32* Texels;
+		i32 Width;
+		i32 Height;
+		i32 TilesX;
+	};
+
+	// NOTE(Zero):
+	// RGBA texture with its mip chain for the software renderers, level 0 is the image itself
+	// and every next level is half the size of the previous one down to 1x1
+	// Texture coordinates are in [0, 1] with texel centers at half texels and are clamped to the edges,
+	// v = 0 is the first row of the image like `SamplePixel`
+	// All levels live in a single allocation, `Memory` is what was allocated
+	struct texture
+	{
+		texture_level Levels[A3_TEXTURE_MAX_LEVELS];
+		void* Memory;
+		i32 NumOfLevels;
+		i32 Width;
+		i32 Height;
+	};
+
+	// NOTE(Zero):
+	// Builds the mip chain with a box filter, only 4 channel images are supported
+	// Image is not referenced after this, returned texture should be freed using `FreeTexture`
+	texture CreateTexture(const image* img);
+	void FreeTexture(texture* tex);
+
+	inline u32 GetTexel(const texture* tex, i32 level, i32 x, i32 y);
+
+	// NOTE(Zero):
+	// Level of detail from the derivatives of texture coordinates along screen x and y,
+	// level 0 when a texel maps to a pixel or larger, not clamped to the levels of the texture
+	inline f32 QueryTextureLevel(const texture* tex, v2 dUVdx, v2 dUVdy);
+
+	inline u32 SampleTextureBilinear(const texture* tex, v2 uv, i32 level);
+	// NOTE(Zero): Blends the bilinear samples of the two levels around `level`, `level` is clamped to the mip chain
+	inline u32 SampleTextureTrilinear(const texture* tex, v2 uv, f32 level);
+	inline u32 SampleTexture(const texture* tex, v2 uv, v2 dUVdx, v2 dUVdy);
+
+	// NOTE(Zero):
+	// `SampleTextureTrilinear` of 4 pixels at once, gives the same colors as sampling them one at a time
+	// Levels, texel addresses and weights are computed for all lanes together, only the texels are loaded one by one
+	inline __m128i SampleTextureTrilinear4(const texture* tex, __m128 u, __m128 v, __m128 level);
+
+}
+
+//
+// INLINE DEFINATIONS
+//
+
+// NOTE(Zero): Index of the texel in its 4x4 tile, bits of x and y are interleaved
+static inline u32 a3_TexelIndex(const a3::texture_level& level, i32 x, i32 y)
+{
+	u32 tile = (u32)(y >> 2) * (u32)level.TilesX + (u32)(x >> 2);
+	u32 morton = (u32)(x & 1) | ((u32)(y & 1) << 1) | ((u32)(x & 2) << 1) | ((u32)(y & 2) << 2);
+	return tile * 16 + morton;
+}
+
+// NOTE(Zero): Approximate log2 from the bits of the float, off by at most 0.09, enough for selecting levels
+static inline f32 a3_TextureLog2(f32 x)
+{
+	union { f32 f; u32 i; } bits;
+	bits.f = x;
+	return (f32)bits.i * (1.0f / 8388608.0f) - 127.0f;
+}
+
+// NOTE(Zero):
+// Bilinear filter of texels {x0 y0, x1 y0, x0 y1, x1 y1} with weights in 1/256,
+// channels are filtered together in 16 bit lanes, result is in the lower 4 lanes
+static inline __m128i a3_FilterBilinear(__m128i texels, i32 weightX, i32 weightY)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i half = _mm_set1_epi16(128);
+	__m128i wx = _mm_set_epi16((i16)weightX, (i16)weightX, (i16)weightX, (i16)weightX, (i16)(256 - weightX), (i16)(256 - weightX), (i16)(256 - weightX), (i16)(256 - weightX));
+	__m128i wy = _mm_set_epi16((i16)weightY, (i16)weightY, (i16)weightY, (i16)weightY, (i16)(256 - weightY), (i16)(256 - weightY), (i16)(256 - weightY), (i16)(256 - weightY));
+
+	// NOTE(Zero): Products are at most 255 * 256 so the sums fit in unsigned 16 bits
+	__m128i top = _mm_mullo_epi16(_mm_unpacklo_epi8(texels, zero), wx);
+	__m128i bottom = _mm_mullo_epi16(_mm_unpackhi_epi8(texels, zero), wx);
+	__m128i rows = _mm_add_epi16(_mm_unpacklo_epi64(top, bottom), _mm_unpackhi_epi64(top, bottom));
+	rows = _mm_srli_epi16(_mm_add_epi16(rows, half), 8);
+	rows = _mm_mullo_epi16(rows, wy);
+	rows = _mm_add_epi16(rows, _mm_srli_si128(rows, 8));
+	return _mm_srli_epi16(_mm_add_epi16(rows, half), 8);
+}
+
+static inline __m128i a3_SampleLevelBilinear(const a3::texture_level& level, v2 uv)
+{
+	f32 x = uv.u * (f32)level.Width - 0.5f;
+	f32 y = uv.v * (f32)level.Height - 0.5f;
+	// NOTE(Zero): Keeps the conversions in range, NaN ends up at the first texel
+	f32 maxX = (f32)(level.Width - 1);
+	f32 maxY = (f32)(level.Height - 1);
+	x = (x > -1.0f) ? ((x < maxX) ? x : maxX) : -1.0f;
+	y = (y > -1.0f) ? ((y < maxY) ? y : maxY) : -1.0f;
+
+	// NOTE(Zero): Values are not below -1 so truncation after the offset is the floor
+	i32 x0 = (i32)(x + 1.0f) - 1;
+	i32 y0 = (i32)(y + 1.0f) - 1;
+	i32 weightX = (i32)((x - (f32)x0) * 256.0f);
+	i32 weightY = (i32)((y - (f32)y0) * 256.0f);
+
+	i32 x1 = (x0 + 1 < level.Width) ? x0 + 1 : level.Width - 1;
+	i32 y1 = (y0 + 1 < level.Height) ? y0 + 1 : level.Height - 1;
+	if (x0 < 0) x0 = 0;
+	if (y0 < 0) y0 = 0;
+
+	const u32* texels = level.Texels;
+	return a3_FilterBilinear(_mm_setr_epi32(
+		(i32)texels[a3_TexelIndex(level, x0, y0)], (i32)texels[a3_TexelIndex(level, x1, y0)],
+		(i32)texels[a3_TexelIndex(level, x0, y1)], (i32)texels[a3_TexelIndex(level, x1, y1)]), weightX, weightY);
+}
+
+// NOTE(Zero): Lower 32 bits of the products of the lanes, SSE2 only multiplies the even lanes
+static inline __m128i a3_MultiplyLow32(__m128i a, __m128i b)
+{
+	__m128i even = _mm_mul_epu32(a, b);
+	__m128i odd = _mm_mul_epu32(_mm_srli_si128(a, 4), _mm_srli_si128(b, 4));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+// NOTE(Zero): `a3_TexelIndex` of 4 lanes, each lane may be in a different level
+static inline __m128i a3_TexelIndex4(__m128i tilesX, __m128i x, __m128i y)
+{
+	__m128i one = _mm_set1_epi32(1);
+	__m128i two = _mm_set1_epi32(2);
+	__m128i tile = _mm_add_epi32(a3_MultiplyLow32(_mm_srai_epi32(y, 2), tilesX), _mm_srai_epi32(x, 2));
+	__m128i morton = _mm_or_si128(_mm_and_si128(x, one), _mm_slli_epi32(_mm_and_si128(y, one), 1));
+	morton = _mm_or_si128(morton, _mm_slli_epi32(_mm_and_si128(x, two), 1));
+	morton = _mm_or_si128(morton, _mm_slli_epi32(_mm_and_si128(y, two), 2));
+	return _mm_add_epi32(_mm_slli_epi32(tile, 4), morton);
+}
+
+// NOTE(Zero): Weights of 4 pixels in 32 bit lanes spread over the 4 channels of each pixel, pixels 0 and 1 in `lo`, 2 and 3 in `hi`
+static inline void a3_SpreadWeights4(__m128i weights, __m128i* lo, __m128i* hi)
+{
+	__m128i pairs = _mm_packs_epi32(weights, weights);
+	pairs = _mm_unpacklo_epi16(pairs, pairs);
+	*lo = _mm_unpacklo_epi32(pairs, pairs);
+	*hi = _mm_unpackhi_epi32(pairs, pairs);
+}
+
+// NOTE(Zero): (a * (256 - weight) + b * weight + 128) / 256 in 16 bit lanes, rounded the same as `a3_FilterBilinear`
+static inline __m128i a3_Lerp16(__m128i a, __m128i b, __m128i weight)
+{
+	__m128i color = _mm_add_epi16(_mm_mullo_epi16(a, _mm_sub_epi16(_mm_set1_epi16(256), weight)), _mm_mullo_epi16(b, weight));
+	return _mm_srli_epi16(_mm_add_epi16(color, _mm_set1_epi16(128)), 8);
+}
+
+// NOTE(Zero):
+// `a3_SampleLevelBilinear` of 4 pixels, each from its own level, channels are in 16 bit lanes, pixels 0 and 1 in `lo`, 2 and 3 in `hi`
+// Size of a level is max(size >> level, 1) which is how `CreateTexture` halves them, the shift is a multiplication
+// by 2^-level built from its exponent bits since SSE2 has no shifts by lane
+static inline void a3_SampleLevelBilinear4(const a3::texture* tex, __m128i level, __m128 u, __m128 v, __m128i* lo, __m128i* hi)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i one = _mm_set1_epi32(1);
+	__m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_sub_epi32(_mm_set1_epi32(127), level), 23));
+	__m128i width = _mm_cvttps_epi32(_mm_mul_ps(_mm_set1_ps((f32)tex->Width), scale));
+	__m128i height = _mm_cvttps_epi32(_mm_mul_ps(_mm_set1_ps((f32)tex->Height), scale));
+	width = _mm_sub_epi32(width, _mm_cmpeq_epi32(width, zero));
+	height = _mm_sub_epi32(height, _mm_cmpeq_epi32(height, zero));
+	__m128i tilesX = _mm_srli_epi32(_mm_add_epi32(width, _mm_set1_epi32(3)), 2);
+
+	__m128 x = _mm_sub_ps(_mm_mul_ps(u, _mm_cvtepi32_ps(width)), _mm_set1_ps(0.5f));
+	__m128 y = _mm_sub_ps(_mm_mul_ps(v, _mm_cvtepi32_ps(height)), _mm_set1_ps(0.5f));
+	// NOTE(Zero): `max` returns its second operand for NaN, so NaN ends up at the first texel like the scalar path
+	x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-1.0f)), _mm_cvtepi32_ps(_mm_sub_epi32(width, one)));
+	y = _mm_min_ps(_mm_max_ps(y, _mm_set1_ps(-1.0f)), _mm_cvtepi32_ps(_mm_sub_epi32(height, one)));
+
+	__m128i x0 = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(x, _mm_set1_ps(1.0f))), one);
+	__m128i y0 = _mm_sub_epi32(_mm_cvttps_epi32(_mm_add_ps(y, _mm_set1_ps(1.0f))), one);
+	__m128i weightX = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(x, _mm_cvtepi32_ps(x0)), _mm_set1_ps(256.0f)));
+	__m128i weightY = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(y, _mm_cvtepi32_ps(y0)), _mm_set1_ps(256.0f)));
+
+	// NOTE(Zero): x0 is in [-1, width - 1], so x1 only has to step back when it reaches the width and x0 only has to leave -1
+	__m128i x1 = _mm_add_epi32(x0, one);
+	__m128i y1 = _mm_add_epi32(y0, one);
+	x1 = _mm_add_epi32(x1, _mm_cmpeq_epi32(x1, width));
+	y1 = _mm_add_epi32(y1, _mm_cmpeq_epi32(y1, height));
+	x0 = _mm_andnot_si128(_mm_srai_epi32(x0, 31), x0);
+	y0 = _mm_andnot_si128(_mm_srai_epi32(y0, 31), y0);
+
+	alignas(16) i32 levels[4];
+	alignas(16) u32 index00[4], index10[4], index01[4], index11[4];
+	_mm_store_si128((__m128i*)levels, level);
+	_mm_store_si128((__m128i*)index00, a3_TexelIndex4(tilesX, x0, y0));
+	_mm_store_si128((__m128i*)index10, a3_TexelIndex4(tilesX, x1, y0));
+	_mm_store_si128((__m128i*)index01, a3_TexelIndex4(tilesX, x0, y1));
+	_mm_store_si128((__m128i*)index11, a3_TexelIndex4(tilesX, x1, y1));
+
+	alignas(16) u32 texels00[4], texels10[4], texels01[4], texels11[4];
+	for (i32 i = 0; i < 4; ++i)
+	{
+		const u32* texels = tex->Levels[levels[i]].Texels;
+		texels00[i] = texels[index00[i]];
+		texels10[i] = texels[index10[i]];
+		texels01[i] = texels[index01[i]];
+		texels11[i] = texels[index11[i]];
+	}
+	__m128i t00 = _mm_load_si128((const __m128i*)texels00);
+	__m128i t10 = _mm_load_si128((const __m128i*)texels10);
+	__m128i t01 = _mm_load_si128((const __m128i*)texels01);
+	__m128i t11 = _mm_load_si128((const __m128i*)texels11);
+
+	__m128i wxLo, wxHi, wyLo, wyHi;
+	a3_SpreadWeights4(weightX, &wxLo, &wxHi);
+	a3_SpreadWeights4(weightY, &wyLo, &wyHi);
+	__m128i topLo = a3_Lerp16(_mm_unpacklo_epi8(t00, zero), _mm_unpacklo_epi8(t10, zero), wxLo);
+	__m128i topHi = a3_Lerp16(_mm_unpackhi_epi8(t00, zero), _mm_unpackhi_epi8(t10, zero), wxHi);
+	__m128i bottomLo = a3_Lerp16(_mm_unpacklo_epi8(t01, zero), _mm_unpacklo_epi8(t11, zero), wxLo);
+	__m128i bottomHi = a3_Lerp16(_mm_unpackhi_epi8(t01, zero), _mm_unpackhi_epi8(t11, zero), wxHi);
+	*lo = a3_Lerp16(topLo, bottomLo, wyLo);
+	*hi = a3_Lerp16(topHi, bottomHi, wyHi);
+}
+
+namespace a3 {
+
+	inline u32 GetTexel(const texture* tex, i32 level, i32 x, i32 y)
+	{
+		a3Assert(level >= 0 && level < tex->NumOfLevels);
+		const texture_level& l = tex->Levels[level];
+		a3Assert(x >= 0 && x < l.Width);
+		a3Assert(y >= 0 && y < l.Height);
+		return l.Texels[a3_TexelIndex(l, x, y)];
+	}
+
+	inline f32 QueryTextureLevel(const texture* tex, v2 dUVdx, v2 dUVdy)
+	{
+		f32 w = (f32)tex->Width;
+		f32 h = (f32)tex->Height;
+		f32 lengthX = dUVdx.u * dUVdx.u * w * w + dUVdx.v * dUVdx.v * h * h;
+		f32 lengthY = dUVdy.u * dUVdy.u * w * w + dUVdy.v * dUVdy.v * h * h;
+		f32 rho = (lengthX > lengthY) ? lengthX : lengthY;
+		if (!(rho > 1.0f)) return 0.0f;
+		return 0.5f * a3_TextureLog2(rho);
+	}
+
+	inline u32 SampleTextureBilinear(const texture* tex, v2 uv, i32 level)
+	{
+		if (level < 0) level = 0;
+		if (level >= tex->NumOfLevels) level = tex->NumOfLevels - 1;
+		__m128i color = a3_SampleLevelBilinear(tex->Levels[level], uv);
+		return (u32)_mm_cvtsi128_si32(_mm_packus_epi16(color, color));
+	}
+
+	inline u32 SampleTextureTrilinear(const texture* tex, v2 uv, f32 level)
+	{
+		i32 last = tex->NumOfLevels - 1;
+		if (!(level > 0.0f)) level = 0.0f;
+		if (level >= (f32)last) return SampleTextureBilinear(tex, uv, last);
+
+		i32 fine = (i32)level;
+		i32 weight = (i32)((level - (f32)fine) * 256.0f);
+		if (weight == 0) return SampleTextureBilinear(tex, uv, fine);
+
+		__m128i a = a3_SampleLevelBilinear(tex->Levels[fine], uv);
+		__m128i b = a3_SampleLevelBilinear(tex->Levels[fine + 1], uv);
+		__m128i w = _mm_set_epi16((i16)weight, (i16)weight, (i16)weight, (i16)weight, (i16)(256 - weight), (i16)(256 - weight), (i16)(256 - weight), (i16)(256 - weight));
+		__m128i color = _mm_mullo_epi16(_mm_unpacklo_epi64(a, b), w);
+		color = _mm_add_epi16(color, _mm_srli_si128(color, 8));
+		color = _mm_srli_epi16(_mm_add_epi16(color, _mm_set1_epi16(128)), 8);
+		return (u32)_mm_cvtsi128_si32(_mm_packus_epi16(color, color));
+	}
+
+	inline u32 SampleTexture(const texture* tex, v2 uv, v2 dUVdx, v2 dUVdy)
+	{
+		return SampleTextureTrilinear(tex, uv, QueryTextureLevel(tex, dUVdx, dUVdy));
+	}
+
+	inline __m128i SampleTextureTrilinear4(const texture* tex, __m128 u, __m128 v, __m128 level)
+	{
+		// NOTE(Zero):
+		// `max` also turns NaN into level 0, lanes at the last level get the last level as both levels with weight 0,
+		// which is the bilinear sample of the last level
+		i32 last = tex->NumOfLevels - 1;
+		level = _mm_min_ps(_mm_max_ps(level, _mm_setzero_ps()), _mm_set1_ps((f32)last));
+		__m128i fine = _mm_cvttps_epi32(level);
+		__m128i weight = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(level, _mm_cvtepi32_ps(fine)), _mm_set1_ps(256.0f)));
+
+		__m128i fineLo, fineHi;
+		a3_SampleLevelBilinear4(tex, fine, u, v, &fineLo, &fineHi);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(weight, _mm_setzero_si128())) == 0xffff) return _mm_packus_epi16(fineLo, fineHi);
+
+		__m128i coarse = _mm_add_epi32(fine, _mm_set1_epi32(1));
+		coarse = _mm_add_epi32(coarse, _mm_cmpgt_epi32(coarse, _mm_set1_epi32(last)));
+		__m128i coarseLo, coarseHi, weightLo, weightHi;
+		a3_SampleLevelBilinear4(tex, coarse, u, v, &coarseLo, &coarseHi);
+		a3_SpreadWeights4(weight, &weightLo, &weightHi);
+		return _mm_packus_epi16(a3_Lerp16(fineLo, coarseLo, weightLo), a3_Lerp16(fineHi, coarseHi, weightHi));
+	}
+
+}
+
+//
+// DEFINATIONS
+//
+
+#ifdef A3_IMPLEMENT_TEXTURE
+
+namespace a3 {
+
+	texture CreateTexture(const image* img)
+	{
+		texture result = {};
+		a3Assert(img->Channels == 4);
+		if (!img->Pixels || img->Width <= 0 || img->Height <= 0) return result;
+
+		u64 numOfTexels = 0;
+		i32 w = img->Width, h = img->Height;
+		for (;;)
+		{
+			texture_level& level = result.Levels[result.NumOfLevels++];
+			level.Width = w;
+			level.Height = h;
+			level.TilesX = (w + 3) / 4;
+			numOfTexels += (u64)level.TilesX * (u64)((h + 3) / 4) * 16;
+			if ((w == 1 && h == 1) || result.NumOfLevels == A3_TEXTURE_MAX_LEVELS) break;
+			w = (w > 1) ? w / 2 : 1;
+			h = (h > 1) ? h / 2 : 1;
+		}
+
+		// NOTE(Zero): Aligned by hand so that every tile is a single cache line
+		result.Memory = a3Malloc(sizeof(u32) * numOfTexels + 63, void);
+		u32* texels = (u32*)(((u64)result.Memory + 63) & ~(u64)63);
+		for (i32 l = 0; l < result.NumOfLevels; ++l)
+		{
+			texture_level& level = result.Levels[l];
+			level.Texels = texels;
+			u64 count = (u64)level.TilesX * (u64)((level.Height + 3) / 4) * 16;
+			// NOTE(Zero): Padding texels are never sampled, they are only cleared
+			a3::MemorySet(texels, 0, sizeof(u32) * count);
+			texels += count;
+		}
+		result.Width = img->Width;
+		result.Height = img->Height;
+
+		const u32* pixels = (const u32*)img->Pixels;
+		texture_level& base = result.Levels[0];
+		for (i32 y = 0; y < base.Height; ++y)
+		{
+			for (i32 x = 0; x < base.Width; ++x)
+			{
+				base.Texels[a3_TexelIndex(base, x, y)] = pixels[x + y * img->Width];
+			}
+		}
+
+		// NOTE(Zero):
+		// Each texel is the rounded average of the 2x2 texels under it, for odd sizes
+		// the last row or column of the previous level is dropped
+		for (i32 l = 1; l < result.NumOfLevels; ++l)
+		{
+			const texture_level& src = result.Levels[l - 1];
+			texture_level& dst = result.Levels[l];
+			__m128i zero = _mm_setzero_si128();
+			for (i32 y = 0; y < dst.Height; ++y)
+			{
+				i32 y0 = 2 * y;
+				i32 y1 = (y0 + 1 < src.Height) ? y0 + 1 : y0;
+				for (i32 x = 0; x < dst.Width; ++x)
+				{
+					i32 x0 = 2 * x;
+					i32 x1 = (x0 + 1 < src.Width) ? x0 + 1 : x0;
+					__m128i quad = _mm_setr_epi32(
+						(i32)src.Texels[a3_TexelIndex(src, x0, y0)], (i32)src.Texels[a3_TexelIndex(src, x1, y0)],
+						(i32)src.Texels[a3_TexelIndex(src, x0, y1)], (i32)src.Texels[a3_TexelIndex(src, x1, y1)]);
+					__m128i sum = _mm_add_epi16(_mm_unpacklo_epi8(quad, zero), _mm_unpackhi_epi8(quad, zero));
+					sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+					sum = _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+					dst.Texels[a3_TexelIndex(dst, x, y)] = (u32)_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum));
+				}
+			}
+		}
+		return result;
+	}
+
+	void FreeTexture(texture* tex)
+	{
+		a3Free(tex->Memory);
+		*tex = {};
+	}
+
+}
+
+#endif
@@ -0,0 +1,580 @@
+#include "Common/Core.h"
+#include "Platform.h"
+#include "Assets.h"
+
+#include "Math/Math.h"
+#include "Utility/AssetManager.h"
+#include "Utility/JobSystem.h"
+#include "Graphics/Rasterizer2D.h"
+#include "Graphics/Rasterizer3D.h"
+#include "Graphics/RayTracer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// NOTE(Zero):
+// Command line front end of the ray tracer for batch rendering, no window or OpenGL is used
+// Only built with A3HEADLESS, the platform layer provides everything except `main`
+//   xRender <mesh.obj> [-o out.png] [-w width] [-h height] [-spp samples]
+//           [-pos x y z] [-rot yaw pitch roll] [-fov degrees] [-threads n] [-raster frames] [-texture image] [-grid n] [-msaa]
+//           [-depth f32|unorm24|unorm16] [-light dir|spot] [-shadow size] [-animate frames] [-builder sweep|binned]
+//           [-bvh4] [-path] [-glossy roughness] [-bounces n]
+// Camera looks along its -z axis like `transform`, rotation is in degrees
+// With -raster the mesh is drawn with the software rasterizer `frames` times instead of ray traced
+// With -grid n x n instances of the mesh are placed on the xz plane, the rasterizer draws them through a draw list
+// and the ray tracer traces them through a top level hierarchy over a single hierarchy of the mesh
+// With -msaa the rasterizer uses 4x multisampling, -depth selects the format of its depth buffer
+// With -texture the mesh is texture mapped with the given image, both by the rasterizer and the ray tracer
+// With -light the rasterizer lights the scene from above, -shadow renders a shadow map of size x size pixels
+// each frame with a depth only pass that is timed on its own
+// With -animate the ray tracer renders `frames` frames of the mesh twisting around its y axis, its hierarchy is refit
+// every frame and rebuilt on a separate thread when refitting has made it too slow
+// With -builder the hierarchy of the ray tracer is built by the full sweep or the parallel binned builder(default),
+// the time and quality of the build are printed
+// With -bvh4 the hierarchy is collapsed to 4 children per node with quantized boxes before tracing
+// With -path the mesh is path traced under a square area light placed above it and a dim sky, the mesh is diffuse
+// or with -glossy a GGX reflector of the given roughness, -bounces limits the length of the paths
+
+struct a3_render_options
+{
+	s8 MeshFile;
+	s8 TextureFile;
+	s8 OutputFile;
+	i32 Width;
+	i32 Height;
+	i32 SamplesPerPixel;
+	v3 Position;
+	v3 Rotation;
+	f32 FieldOfView;
+	i32 NumOfThreads;
+	i32 RasterFrames;
+	i32 GridSize;
+	b32 Multisample;
+	a3::depth_format DepthFormat;
+	b32 Light;
+	a3::light_type LightType;
+	i32 ShadowSize;
+	i32 AnimateFrames;
+	b32 BinnedBuild;
+	b32 Wide;
+	b32 PathTrace;
+	f32 Roughness;
+	i32 Bounces;
+};
+
+// NOTE(Zero): Instances are spaced by the size of the mesh and centered around the origin
+static v3 a3_GridPosition(const a3::mesh_bounds& bounds, i32 gridSize, i32 x, i32 z)
+{
+	v3 size = bounds.Max - bounds.Min;
+	f32 offset = (f32)(gridSize - 1) * 0.5f;
+	return v3{ ((f32)x - offset) * size.x * 1.25f, 0.0f, ((f32)z - offset) * size.z * 1.25f };
+}
+
+static u32* a3_AppendIndices(const u32* indices, u32 numOfTriangles, const u32* lightIndices)
+{
+	u32* result = a3Malloc(sizeof(u32) * (numOfTriangles + 2) * 3, u32);
+	a3::MemoryCopy(result, indices, sizeof(u32) * numOfTriangles * 3);
+	a3::MemoryCopy(result + numOfTriangles * 3, lightIndices, sizeof(u32) * 6);
+	return result;
+}
+
+// NOTE(Zero):
+// Copy of the mesh with a square light added above it as its last 2 triangles, wound so that they face down
+// Texture coordinates and normals are shared with `meshObj`, the light uses the first of each
+// Returned mesh should be freed using `a3_FreeAreaLight`
+static a3::mesh a3_AddAreaLight(const a3::mesh* meshObj)
+{
+	a3::mesh_bounds bounds = a3::ComputeMeshBounds(meshObj);
+	a3::mesh result = *meshObj;
+	result.NumOfVertices = meshObj->NumOfVertices + 4;
+	result.NumOfTriangles = meshObj->NumOfTriangles + 2;
+	result.Vertices = a3Malloc(sizeof(v3) * result.NumOfVertices, v3);
+	a3::MemoryCopy(result.Vertices, meshObj->Vertices, sizeof(v3) * meshObj->NumOfVertices);
+
+	f32 size = 0.5f * bounds.Radius;
+	f32 height = bounds.Max.y + bounds.Radius;
+	v3* corners = result.Vertices + meshObj->NumOfVertices;
+	corners[0] = v3{ bounds.Center.x - size, height, bounds.Center.z - size };
+	corners[1] = v3{ bounds.Center.x + size, height, bounds.Center.z - size };
+	corners[2] = v3{ bounds.Center.x + size, height, bounds.Center.z + size };
+	corners[3] = v3{ bounds.Center.x - size, height, bounds.Center.z + size };
+
+	u32 first = meshObj->NumOfVertices;
+	u32 lightIndices[6] = { first, first + 1, first + 2, first, first + 2, first + 3 };
+	u32 firstIndices[6] = {};
+	result.VertexIndices = a3_AppendIndices(meshObj->VertexIndices, meshObj->NumOfTriangles, lightIndices);
+	if (meshObj->TextureCoordsIndices) result.TextureCoordsIndices = a3_AppendIndices(meshObj->TextureCoordsIndices, meshObj->NumOfTriangles, firstIndices);
+	else result.TextureCoords = A3NULL;
+	if (meshObj->NormalIndices) result.NormalIndices = a3_AppendIndices(meshObj->NormalIndices, meshObj->NumOfTriangles, firstIndices);
+	else result.Normals = A3NULL;
+	return result;
+}
+
+static void a3_FreeAreaLight(a3::mesh* meshObj)
+{
+	a3Free(meshObj->Vertices);
+	a3Free(meshObj->VertexIndices);
+	if (meshObj->TextureCoordsIndices) a3Free(meshObj->TextureCoordsIndices);
+	if (meshObj->NormalIndices) a3Free(meshObj->NormalIndices);
+}
+
+static void a3_PrintUsage(s8 program)
+{
+	printf("Usage: %s <mesh.obj> [-o out.png] [-w width] [-h height] [-spp samples]\n", program);
+	printf("       [-pos x y z] [-rot yaw pitch roll] [-fov degrees] [-threads n] [-raster frames] [-texture image] [-grid n] [-msaa]\n");
+	printf("       [-depth f32|unorm24|unorm16] [-light dir|spot] [-shadow size] [-animate frames] [-builder sweep|binned]\n");
+	printf("       [-bvh4] [-path] [-glossy roughness] [-bounces n]\n");
+}
+
+static b32 a3_ParseRenderOptions(i32 argc, char** argv, a3_render_options* options)
+{
+	options->MeshFile = A3NULL;
+	options->TextureFile = A3NULL;
+	options->OutputFile = "render.png";
+	options->Width = 800;
+	options->Height = 600;
+	options->SamplesPerPixel = 16;
+	options->Position = v3{ 0.0f, 0.0f, 10.0f };
+	options->Rotation = v3{ 0.0f, 0.0f, 0.0f };
+	options->FieldOfView = 60.0f;
+	// NOTE(Zero): Negative means one thread per processor
+	options->NumOfThreads = -1;
+	options->RasterFrames = 0;
+	options->GridSize = 0;
+	options->Multisample = false;
+	options->DepthFormat = a3::DepthFloat32;
+	options->Light = false;
+	options->LightType = a3::LightDirectional;
+	options->ShadowSize = 0;
+	options->AnimateFrames = 0;
+	options->BinnedBuild = true;
+	options->Wide = false;
+	options->PathTrace = false;
+	// NOTE(Zero): Negative means diffuse
+	options->Roughness = -1.0f;
+	options->Bounces = 8;
+
+	for (i32 i = 1; i < argc; ++i)
+	{
+		s8 arg = argv[i];
+		i32 remaining = argc - i - 1;
+		if (!strcmp(arg, "-o") && remaining >= 1) options->OutputFile = argv[++i];
+		else if (!strcmp(arg, "-w") && remaining >= 1) options->Width = atoi(argv[++i]);
+		else if (!strcmp(arg, "-h") && remaining >= 1) options->Height = atoi(argv[++i]);
+		else if (!strcmp(arg, "-spp") && remaining >= 1) options->SamplesPerPixel = atoi(argv[++i]);
+		else if (!strcmp(arg, "-fov") && remaining >= 1) options->FieldOfView = (f32)atof(argv[++i]);
+		else if (!strcmp(arg, "-threads") && remaining >= 1) options->NumOfThreads = atoi(argv[++i]);
+		else if (!strcmp(arg, "-raster") && remaining >= 1) options->RasterFrames = atoi(argv[++i]);
+		else if (!strcmp(arg, "-texture") && remaining >= 1) options->TextureFile = argv[++i];
+		else if (!strcmp(arg, "-grid") && remaining >= 1) options->GridSize = atoi(argv[++i]);
+		else if (!strcmp(arg, "-msaa")) options->Multisample = true;
+		else if (!strcmp(arg, "-bvh4")) options->Wide = true;
+		else if (!strcmp(arg, "-path")) options->PathTrace = true;
+		else if (!strcmp(arg, "-glossy") && remaining >= 1) options->Roughness = (f32)atof(argv[++i]);
+		else if (!strcmp(arg, "-bounces") && remaining >= 1) options->Bounces = atoi(argv[++i]);
+		else if (!strcmp(arg, "-depth") && remaining >= 1)
+		{
+			s8 format = argv[++i];
+			if (!strcmp(format, "f32")) options->DepthFormat = a3::DepthFloat32;
+			else if (!strcmp(format, "unorm24")) options->DepthFormat = a3::DepthUnorm24;
+			else if (!strcmp(format, "unorm16")) options->DepthFormat = a3::DepthUnorm16;
+			else
+			{
+				printf("Invalid depth format: %s\n", format);
+				return false;
+			}
+		}
+		else if (!strcmp(arg, "-light") && remaining >= 1)
+		{
+			s8 type = argv[++i];
+			options->Light = true;
+			if (!strcmp(type, "dir")) options->LightType = a3::LightDirectional;
+			else if (!strcmp(type, "spot")) options->LightType = a3::LightSpot;
+			else
+			{
+				printf("Invalid light type: %s\n", type);
+				return false;
+			}
+		}
+		else if (!strcmp(arg, "-shadow") && remaining >= 1) options->ShadowSize = atoi(argv[++i]);
+		else if (!strcmp(arg, "-animate") && remaining >= 1) options->AnimateFrames = atoi(argv[++i]);
+		else if (!strcmp(arg, "-builder") && remaining >= 1)
+		{
+			s8 builder = argv[++i];
+			if (!strcmp(builder, "sweep")) options->BinnedBuild = false;
+			else if (!strcmp(builder, "binned")) options->BinnedBuild = true;
+			else
+			{
+				printf("Invalid builder: %s\n", builder);
+				return false;
+			}
+		}
+		else if (!strcmp(arg, "-pos") && remaining >= 3)
+		{
+			options->Position.x = (f32)atof(argv[++i]);
+			options->Position.y = (f32)atof(argv[++i]);
+			options->Position.z = (f32)atof(argv[++i]);
+		}
+		else if (!strcmp(arg, "-rot") && remaining >= 3)
+		{
+			options->Rotation.x = a3ToRadians((f32)atof(argv[++i]));
+			options->Rotation.y = a3ToRadians((f32)atof(argv[++i]));
+			options->Rotation.z = a3ToRadians((f32)atof(argv[++i]));
+		}
+		else if (arg[0] != '-' && !options->MeshFile) options->MeshFile = arg;
+		else
+		{
+			printf("Invalid argument: %s\n", arg);
+			return false;
+		}
+	}
+
+	if (!options->MeshFile)
+	{
+		printf("Mesh file is not given\n");
+		return false;
+	}
+	if (options->Width <= 0 || options->Height <= 0 || options->SamplesPerPixel <= 0)
+	{
+		printf("Resolution and samples per pixel must be positive\n");
+		return false;
+	}
+	if (options->RasterFrames < 0 || options->GridSize < 0 || options->ShadowSize < 0 || options->AnimateFrames < 0)
+	{
+		printf("Number of raster frames, grid size, shadow size and animated frames can not be negative\n");
+		return false;
+	}
+	if (options->AnimateFrames && (options->RasterFrames || options->GridSize))
+	{
+		printf("Animation is only supported by the ray tracer for a single mesh\n");
+		return false;
+	}
+	if (options->Wide && (options->RasterFrames || options->GridSize || options->AnimateFrames))
+	{
+		printf("4 wide hierarchy is only supported by the ray tracer for a single static mesh\n");
+		return false;
+	}
+	if (options->PathTrace && (options->RasterFrames || options->GridSize || options->AnimateFrames))
+	{
+		printf("Path tracing is only supported for a single static mesh\n");
+		return false;
+	}
+	if (options->Bounces < 0 || options->Roughness > 1.0f)
+	{
+		printf("Bounces can not be negative and roughness can not be more than 1\n");
+		return false;
+	}
+	if (options->ShadowSize && !options->Light)
+	{
+		printf("Shadows need a light\n");
+		return false;
+	}
+	if (options->FieldOfView <= 0.0f || options->FieldOfView >= 180.0f)
+	{
+		printf("Field of view must be in between 0 and 180 degrees\n");
+		return false;
+	}
+	return true;
+}
+
+int main(int argc, char** argv)
+{
+	a3_render_options options;
+	if (!a3_ParseRenderOptions(argc, argv, &options))
+	{
+		a3_PrintUsage(argv[0]);
+		return 1;
+	}
+
+	// NOTE(Zero): Seeding for random generator is done here
+	{
+		u32 seeds[16];
+		for (i32 i = 0; i < 16; ++i)
+		{
+			f64 time = a3::Platform.GetTime();
+			seeds[i] = (u32)(time * 1e9) + (u32)i;
+		}
+		a3::InitializeGenerator(seeds);
+	}
+
+	u32 numOfWorkers = (options.NumOfThreads > 0) ? (u32)(options.NumOfThreads - 1) : a3::Platform.GetProcessorCount() - 1;
+	a3::Jobs.Initialize(numOfWorkers);
+
+	f64 loadStart = a3::Platform.GetTime();
+	a3::file_content fc = a3::Platform.LoadFileContent(options.MeshFile);
+	if (!fc.Buffer)
+	{
+		printf("Could not read mesh file: %s\n", options.MeshFile);
+		a3::Jobs.Shutdown();
+		return 1;
+	}
+	a3::mesh* meshObj = a3::Asset.LoadMeshFromBuffer(a3::Mesh, fc.Buffer, fc.Size);
+	a3::Platform.FreeFileContent(fc);
+	if (!meshObj)
+	{
+		printf("Could not load mesh: %s\n", options.MeshFile);
+		a3::Jobs.Shutdown();
+		return 1;
+	}
+	f64 loadTime = a3::Platform.GetTime() - loadStart;
+	printf("Loaded %s (%u triangles) in %.3f s\n", options.MeshFile, meshObj->NumOfTriangles, loadTime);
+
+	a3::texture textureObj = {};
+	a3::texture* texture = A3NULL;
+	if (options.TextureFile)
+	{
+		a3::image* textureImage = a3::Asset.LoadImageFromFile(a3::LoadedImageForTexture, options.TextureFile);
+		if (!textureImage || !textureImage->Pixels || textureImage->Channels != 4)
+		{
+			printf("Could not load RGBA texture: %s\n", options.TextureFile);
+			a3::Jobs.Shutdown();
+			return 1;
+		}
+		textureObj = a3::CreateTexture(textureImage);
+		texture = &textureObj;
+		printf("Loaded %s (%dx%d, %d levels)\n", options.TextureFile, texture->Width, texture->Height, texture->NumOfLevels);
+	}
+
+	a3::image frameBuffer = a3::CreateImageBuffer(options.Width, options.Height);
+
+	if (options.RasterFrames)
+	{
+		a3::swapchain swapChain;
+		swapChain.SetFrameBuffer(&frameBuffer);
+		swapChain.SetProjection(a3ToRadians(options.FieldOfView), (f32)options.Width / (f32)options.Height, 0.01f, 1000.0f);
+		swapChain.SetCamera(QuatToMat4x4R(EulerAnglesToQuat(options.Rotation)) * m4x4::TranslationR(options.Position));
+		swapChain.SetMesh(meshObj);
+		if (texture) swapChain.SetTexture(texture);
+		swapChain.SetMultisample(options.Multisample);
+		swapChain.SetDepthFormat(options.DepthFormat);
+		a3::render_type renderType = texture ? a3::RenderMapTexture : a3::RenderShade;
+		m4x4 model;
+
+		a3::draw_list drawList = {};
+		a3::mesh_bounds bounds = a3::ComputeMeshBounds(meshObj);
+		v3 sceneCenter = bounds.Center;
+		f32 sceneRadius = bounds.Radius;
+		if (options.GridSize)
+		{
+			for (i32 z = 0; z < options.GridSize; ++z)
+			{
+				for (i32 x = 0; x < options.GridSize; ++x)
+				{
+					v3 position = a3_GridPosition(bounds, options.GridSize, x, z);
+					a3::AddDrawInstance(&drawList, meshObj, bounds, m4x4::TranslationR(position));
+				}
+			}
+			v3 extent = a3_GridPosition(bounds, options.GridSize, options.GridSize - 1, options.GridSize - 1);
+			sceneRadius += Length(extent);
+		}
+
+		// NOTE(Zero):
+		// Light comes from above the scene, the spot light is placed at twice the radius of the scene so its cone encloses it
+		// Shadow pass renders the same draws from the light, its frame buffer has no pixels since only depth is written
+		a3::light light = {};
+		light.Type = options.LightType;
+		light.Direction = Normalize(v3{ -0.4f, -1.0f, -0.6f });
+		light.Position = sceneCenter - light.Direction * (2.0f * sceneRadius);
+		light.Angle = 2.0f * ArcSinf(0.5f);
+		light.Ambient = 0.2f;
+		if (options.Light) swapChain.SetLight(&light);
+
+		a3::swapchain shadowChain;
+		a3::shadow_map shadowMap = a3::CreateShadowMap();
+		a3::image shadowBuffer = {};
+		if (options.ShadowSize)
+		{
+			shadowBuffer.Width = options.ShadowSize;
+			shadowBuffer.Height = options.ShadowSize;
+			shadowBuffer.Channels = 4;
+			shadowChain.SetFrameBuffer(&shadowBuffer);
+			shadowChain.SetMesh(meshObj);
+			shadowChain.SetLightView(light, sceneCenter, sceneRadius);
+			swapChain.SetShadowMap(&shadowMap);
+		}
+
+		s8 depthFormats[] = { "f32", "unorm24", "unorm16" };
+		printf("Rasterizing %dx%d%s with %s depth for %d frames on %u threads\n", options.Width, options.Height, options.Multisample ? " (4x MSAA)" : "",
+			depthFormats[options.DepthFormat], options.RasterFrames, a3::Jobs.QueryThreadCount());
+		u32 numOfDrawn = 1;
+		u32 numOfShadowDrawn = 1;
+		f64 shadowTime = 0.0;
+		f64 renderTime = 0.0;
+		for (i32 frame = 0; frame < options.RasterFrames; ++frame)
+		{
+			f64 shadowStart = a3::Platform.GetTime();
+			if (options.ShadowSize)
+			{
+				shadowChain.Clear();
+				if (options.GridSize) numOfShadowDrawn = shadowChain.Render(drawList, a3::RenderDepth);
+				else shadowChain.Render(model, a3::RenderDepth);
+				shadowChain.CopyShadowMap(&shadowMap);
+			}
+			f64 renderStart = a3::Platform.GetTime();
+			swapChain.Clear(a3::color::LightSlateGray);
+			if (options.GridSize) numOfDrawn = swapChain.Render(drawList, renderType);
+			else swapChain.Render(model, renderType, a3::color::White);
+			f64 renderEnd = a3::Platform.GetTime();
+			shadowTime += renderStart - shadowStart;
+			renderTime += renderEnd - renderStart;
+		}
+
+		if (options.GridSize) printf("Drew %u of %u instances\n", numOfDrawn, drawList.NumOfInstances);
+		a3::FreeDrawList(&drawList);
+		a3::FreeShadowMap(&shadowMap);
+		a3::FreeSwapchain(&shadowChain);
+		a3::FreeSwapchain(&swapChain);
+
+		if (options.ShadowSize)
+		{
+			f64 numOfShadowTriangles = (f64)meshObj->NumOfTriangles * (f64)numOfShadowDrawn * (f64)options.RasterFrames;
+			printf("Depth only %dx%d shadow pass, %.3f ms per frame, %.2f Mtris/s\n", options.ShadowSize, options.ShadowSize,
+				shadowTime * 1e3 / (f64)options.RasterFrames, numOfShadowTriangles / (shadowTime * 1e6));
+		}
+
+		f64 numOfTriangles = (f64)meshObj->NumOfTriangles * (f64)numOfDrawn * (f64)options.RasterFrames;
+		printf("Rasterized %d frames in %.3f s, %.3f ms per frame, %.2f Mtris/s\n", options.RasterFrames, renderTime, renderTime * 1e3 / (f64)options.RasterFrames, numOfTriangles / (renderTime * 1e6));
+	}
+	else
+	{
+		// NOTE(Zero):
+		// Primary rays go through {x, y, 1} * view with x, y in [-1, 1] (x is scaled by aspect ratio)
+		// so field of view is folded into the scale of the camera transform, negative z makes it look forward
+		f32 fovScale = Tanf(a3ToRadians(options.FieldOfView) * 0.5f);
+		m4x4 view = m4x4::ScaleR(v3{ fovScale, fovScale, -1.0f }) * QuatToMat4x4R(EulerAnglesToQuat(options.Rotation)) * m4x4::TranslationR(options.Position);
+
+		a3::ray_trace_progress progress = {};
+
+		// NOTE(Zero): Path traced mesh is lit by a light added to a copy of it, the hierarchy is built over the copy
+		a3::mesh litMesh = {};
+		a3::mesh* traceMesh = meshObj;
+		if (options.PathTrace)
+		{
+			litMesh = a3_AddAreaLight(meshObj);
+			traceMesh = &litMesh;
+		}
+
+		// NOTE(Zero): Animated mesh builds its own hierarchy
+		a3::bvh accel = {};
+		if (!options.AnimateFrames)
+		{
+			a3::bvh_build_stats stats;
+			accel = options.BinnedBuild ? a3::BuildBVHBinned(traceMesh, &stats) : a3::BuildBVH(traceMesh, &stats);
+			printf("Built hierarchy with the %s builder in %.3f s\n", options.BinnedBuild ? "binned" : "sweep", stats.BuildTime);
+			printf("%u nodes, %u leaves of %.2f triangles on average (max %u), depth %u, cost %.2f\n",
+				stats.NumOfNodes, stats.NumOfLeaves, stats.AverageLeafSize, stats.MaxLeafSize, stats.MaxDepth, stats.Cost);
+		}
+
+		a3::bvh4 accel4 = {};
+		if (options.Wide)
+		{
+			accel4 = a3::BuildBVH4(&accel);
+			f64 binarySize = (f64)(sizeof(a3::bvh_node) * accel.NumOfNodes) / 1024.0;
+			f64 wideSize = (f64)(sizeof(a3::bvh4_node) * accel4.NumOfNodes) / 1024.0;
+			printf("Collapsed to %u 4 wide nodes, %.1f KB of nodes from %.1f KB (%.2fx smaller)\n", accel4.NumOfNodes, wideSize, binarySize, binarySize / wideSize);
+		}
+
+		printf("%s %dx%d at %d samples per pixel on %u threads\n", options.PathTrace ? "Path tracing" : "Rendering",
+			options.Width, options.Height, options.SamplesPerPixel, a3::Jobs.QueryThreadCount());
+		f64 renderStart = a3::Platform.GetTime();
+		i32 passes = 0;
+		if (options.GridSize)
+		{
+			// NOTE(Zero): Every instance shares the hierarchy of the mesh, only the top level grows with the grid
+			a3::mesh_bounds bounds = a3::ComputeMeshBounds(meshObj);
+			u32 numOfInstances = (u32)(options.GridSize * options.GridSize);
+			a3::bvh_instance* instances = a3Malloc(sizeof(a3::bvh_instance) * numOfInstances, a3::bvh_instance);
+			for (i32 z = 0; z < options.GridSize; ++z)
+			{
+				for (i32 x = 0; x < options.GridSize; ++x)
+				{
+					a3::bvh_instance* instance = instances + (x + z * options.GridSize);
+					instance->Accel = &accel;
+					instance->Transform = m4x4::TranslationR(a3_GridPosition(bounds, options.GridSize, x, z));
+				}
+			}
+			a3::tlas scene = a3::BuildTLAS(instances, numOfInstances);
+			a3Free(instances);
+			printf("Built hierarchy over %u instances\n", scene.NumOfInstances);
+
+			passes = a3::RayTrace(&frameBuffer, &scene, view, texture, options.SamplesPerPixel, &progress);
+
+			a3::FreeTLAS(&scene);
+		}
+		else if (options.AnimateFrames)
+		{
+			// NOTE(Zero):
+			// Twist grows every frame, so the refit hierarchy keeps getting worse until it is rebuilt
+			// Rebuilds run alongside the rendering and only replace the hierarchy once they are done
+			a3::mesh_bounds bounds = a3::ComputeMeshBounds(meshObj);
+			v3* restVertices = a3Malloc(sizeof(v3) * meshObj->NumOfVertices, v3);
+			a3::MemoryCopy(restVertices, meshObj->Vertices, sizeof(v3) * meshObj->NumOfVertices);
+			a3::dynamic_bvh dynamic = a3::CreateDynamicBVH(meshObj);
+
+			f64 refitTime = 0.0;
+			for (i32 frame = 0; frame < options.AnimateFrames; ++frame)
+			{
+				f32 twist = 3.0f * (f32)(frame + 1) / (f32)options.AnimateFrames;
+				for (u32 i = 0; i < meshObj->NumOfVertices; ++i)
+				{
+					v3 rest = restVertices[i];
+					f32 angle = twist * (rest.y - bounds.Center.y) / bounds.Radius;
+					f32 c = Cosf(angle);
+					f32 s = Sinf(angle);
+					meshObj->Vertices[i] = v3{ rest.x * c - rest.z * s, rest.y, rest.x * s + rest.z * c };
+				}
+
+				f64 refitStart = a3::Platform.GetTime();
+				a3::UpdateDynamicBVH(&dynamic);
+				refitTime += a3::Platform.GetTime() - refitStart;
+
+				passes += a3::RayTrace(&frameBuffer, &dynamic.Accel, view, texture, options.SamplesPerPixel, &progress);
+			}
+
+			printf("Animated %d frames, refit %.3f ms per frame, %u rebuilds, cost %.2fx of the last build\n", options.AnimateFrames,
+				refitTime * 1e3 / (f64)options.AnimateFrames, dynamic.NumOfRebuilds, dynamic.CostRatio);
+			a3::FreeDynamicBVH(&dynamic);
+			a3Free(restVertices);
+		}
+		else if (options.PathTrace)
+		{
+			// NOTE(Zero): Light is bright enough that diffuse surfaces right below it, about the radius of the mesh away, reflect a radiance of almost 1
+			a3::material materials[2];
+			if (options.Roughness >= 0.0f) materials[0] = a3::GlossyMaterial(v3{ 0.95f, 0.64f, 0.54f }, options.Roughness);
+			else materials[0] = a3::DiffuseMaterial(v3{ 0.75f, 0.75f, 0.75f });
+			materials[1] = a3::EmissiveMaterial(v3{ 4.0f, 4.0f, 4.0f });
+			u32* materialIndices = a3Calloc(sizeof(u32) * litMesh.NumOfTriangles, u32);
+			materialIndices[litMesh.NumOfTriangles - 2] = 1;
+			materialIndices[litMesh.NumOfTriangles - 1] = 1;
+
+			a3::path_scene scene = a3::CreatePathScene(&litMesh, materials, materialIndices, v3{ 0.1f, 0.12f, 0.15f }, (u32)options.Bounces);
+			if (options.Wide) passes = a3::PathTrace(&frameBuffer, &scene, &accel4, view, texture, options.SamplesPerPixel, &progress);
+			else passes = a3::PathTrace(&frameBuffer, &scene, &accel, view, texture, options.SamplesPerPixel, &progress);
+
+			a3::FreePathScene(&scene);
+			a3Free(materialIndices);
+		}
+		else
+		{
+			if (options.Wide) passes = a3::RayTrace(&frameBuffer, &accel4, view, texture, options.SamplesPerPixel, &progress);
+			else passes = a3::RayTrace(&frameBuffer, &accel, view, texture, options.SamplesPerPixel, &progress);
+		}
+		f64 renderTime = a3::Platform.GetTime() - renderStart;
+		a3::FreeBVH(&accel);
+		a3::FreeBVH4(&accel4);
+		if (options.PathTrace) a3_FreeAreaLight(&litMesh);
+
+		f64 numOfRays = (f64)options.Width * (f64)options.Height * (f64)passes;
+		printf("Rendered %d passes in %.3f s, %.2f M%s/s\n", passes, renderTime, numOfRays / (renderTime * 1e6), options.PathTrace ? "paths" : "rays");
+	}
+
+	b32 written = a3::WriteImageToFile(options.OutputFile, frameBuffer.Pixels, frameBuffer.Width, frameBuffer.Height, frameBuffer.Channels, 4);
+	if (written) printf("Image written to %s\n", options.OutputFile);
+	else printf("Could not write image: %s\n", options.OutputFile);
+
+	a3::FreeImgeBuffer(&frameBuffer);
+	if (texture) a3::FreeTexture(texture);
+	a3::Jobs.Shutdown();
+	return written ? 0 : 1;
+}
@@ -172,6 +172,10 @@ namespace a3 {
 		MessageBoxIconError,
 		MessageBoxIconHand
 	};
+
+	typedef void* thread_handle;
+	typedef void* semaphore_handle;
+	typedef u32(*thread_proc)(void* userData);
 }
 
 struct a3_platform
@@ -208,10 +212,28 @@ struct a3_platform
 #endif
 	b32 Release(void* ptr) const;
 
+	// NOTE(Zero): Dialogues and message boxes are not available to headless builds(A3HEADLESS)
+#ifndef A3HEADLESS
 	utf8* LoadFromDialogue(s8 title, a3::file_type type) const;
 	utf8* SaveFromDialogue(s8 title, a3::file_type type) const;
 	void FreeDialogueData(utf8* data) const;
 	a3::message_box_result MessageBox(s8 title, s8 caption, a3::message_box_type type, a3::message_box_icon icon) const;
+#endif
+
+	// NOTE(Zero): Seconds elapsed from an arbitrary fixed point, never goes backwards
+	f64 GetTime() const;
+
+	// NOTE(Zero):
+	// Threads and semaphores, handles must be released by `WaitForThread` and `DestroySemaphore`
+	// `WaitForThread` blocks until the thread exits and then frees the handle
+	u32 GetProcessorCount() const;
+	a3::thread_handle CreateThread(a3::thread_proc proc, void* userData) const;
+	void WaitForThread(a3::thread_handle thread) const;
+	void YieldThread() const;
+	a3::semaphore_handle CreateSemaphore(u32 initialCount) const;
+	void SignalSemaphore(a3::semaphore_handle semaphore, u32 count = 1) const;
+	void WaitForSemaphore(a3::semaphore_handle semaphore) const;
+	void DestroySemaphore(a3::semaphore_handle semaphore) const;
 
 
 #if defined(A3DEBUG) || defined(A3INTERNAL)
@@ -225,6 +247,144 @@ namespace a3 {
 	extern const a3_platform Platform;
 }
 
+//
+// CONTAINS: Atomic operations
+// NOTE(Zero): All of these are full memory barriers
+//
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace a3 {
+	// NOTE(Zero): Returns the resulting value
+	inline i32 AtomicIncrement(volatile i32* value)
+	{
+#if defined(_MSC_VER)
+		return (i32)_InterlockedIncrement((volatile long*)value);
+#else
+		return __sync_add_and_fetch(value, 1);
+#endif
+	}
+
+	// NOTE(Zero): Returns the resulting value
+	inline i32 AtomicDecrement(volatile i32* value)
+	{
+#if defined(_MSC_VER)
+		return (i32)_InterlockedDecrement((volatile long*)value);
+#else
+		return __sync_sub_and_fetch(value, 1);
+#endif
+	}
+
+	// NOTE(Zero): Returns the initial value
+	inline i32 AtomicAdd(volatile i32* value, i32 addend)
+	{
+#if defined(_MSC_VER)
+		return (i32)_InterlockedExchangeAdd((volatile long*)value, (long)addend);
+#else
+		return __sync_fetch_and_add(value, addend);
+#endif
+	}
+
+	// NOTE(Zero): Returns the initial value
+	inline i64 AtomicAdd(volatile i64* value, i64 addend)
+	{
+#if defined(_MSC_VER)
+		return (i64)_InterlockedExchangeAdd64((volatile long long*)value, (long long)addend);
+#else
+		return __sync_fetch_and_add(value, addend);
+#endif
+	}
+
+	// NOTE(Zero): Returns the initial value, exchange happened if it is equal to `comparand`
+	inline i32 AtomicCompareExchange(volatile i32* dest, i32 exchange, i32 comparand)
+	{
+#if defined(_MSC_VER)
+		return (i32)_InterlockedCompareExchange((volatile long*)dest, (long)exchange, (long)comparand);
+#else
+		return __sync_val_compare_and_swap(dest, comparand, exchange);
+#endif
+	}
+
+	inline i32 AtomicLoad(volatile i32* value)
+	{
+		return AtomicAdd(value, 0);
+	}
+
+	inline i64 AtomicLoad(volatile i64* value)
+	{
+		return AtomicAdd(value, 0);
+	}
+
+	// NOTE(Zero): Returns the initial value
+	inline i32 AtomicExchange(volatile i32* dest, i32 value)
+	{
+#if defined(_MSC_VER)
+		return (i32)_InterlockedExchange((volatile long*)dest, (long)value);
+#else
+		return __atomic_exchange_n(dest, value, __ATOMIC_SEQ_CST);
+#endif
+	}
+}
+
+//
+// CONTAINS: CPU features
+// NOTE(Zero):
+// Functions using wider instruction sets than the build targets are marked with `a3TargetAVX2`
+// and must only be called after checking `QuerySIMDLevel`
+// MSVC allows intrinsics of any instruction set, GCC/Clang need the target attribute,
+// `flatten` inlines the (template) helpers into the marked function so they are compiled for the same target
+//
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <immintrin.h>
+#define a3TargetAVX2
+#else
+#include <cpuid.h>
+#include <immintrin.h>
+#define a3TargetAVX2 __attribute__((target("avx2"), flatten))
+#endif
+
+namespace a3 {
+	enum simd_level
+	{
+		SIMDLevelScalar, SIMDLevelSSE, SIMDLevelAVX2
+	};
+
+	// NOTE(Zero): Widest instruction set supported by both the CPU and the OS
+	inline simd_level QuerySIMDLevel()
+	{
+		i32 info[4] = {};
+#if defined(_MSC_VER)
+		__cpuid(info, 0);
+		i32 maxLeaf = info[0];
+		__cpuid(info, 1);
+#else
+		i32 maxLeaf = (i32)__get_cpuid_max(0, 0);
+		__cpuid(1, info[0], info[1], info[2], info[3]);
+#endif
+		// NOTE(Zero): SSE2 is part of x64, every 64 bit processor has it
+		if (!(info[3] & (1 << 26))) return SIMDLevelScalar;
+
+		// NOTE(Zero): OS must save the YMM registers on context switch (XCR0 bits 1 and 2)
+		b32 osxsave = (info[2] & (1 << 27)) != 0;
+		b32 avx = (info[2] & (1 << 28)) != 0;
+		if (!osxsave || !avx || maxLeaf < 7) return SIMDLevelSSE;
+#if defined(_MSC_VER)
+		u64 xcr0 = _xgetbv(0);
+		__cpuidex(info, 7, 0);
+#else
+		u32 xcr0Low, xcr0High;
+		__asm__ __volatile__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+		u64 xcr0 = ((u64)xcr0High << 32) | xcr0Low;
+		__cpuid_count(7, 0, info[0], info[1], info[2], info[3]);
+#endif
+		if ((xcr0 & 6) != 6) return SIMDLevelSSE;
+		if (!(info[1] & (1 << 5))) return SIMDLevelSSE;
+		return SIMDLevelAVX2;
+	}
+}
+
 //
 // NOTE(Zero):
 // C++ new and delete operator override
@@ -0,0 +1,454 @@
+#include "Common/Core.h"
+#include "Platform.h"
+
+// NOTE(Zero):
+// Platform layer for Linux and other POSIX systems
+// Only headless builds(A3HEADLESS) are supported, there is no window or OpenGL context here
+// Built by the Makefile, `main` is provided by HeadlessMain.cpp
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//
+// Globals
+//
+namespace a3 {
+	const a3_platform Platform;
+}
+
+static const u64 s_PageSize = (u64)sysconf(_SC_PAGESIZE);
+
+// NOTE(Zero):
+// Every block carries its size in a header in front of it
+// C heap can't clear the grown part of a reallocated block so `Recalloc` needs the old size,
+// and persistent blocks are mapped pages that need the size to be unmapped
+// Header is 16 bytes to keep the 16 byte alignment of malloc for SSE loads
+#define A3_POSIX_HEADER_SIZE 16
+#define a3PosixGetHeader(p) ((u64*)((u8*)(p) - A3_POSIX_HEADER_SIZE))
+#define a3PosixGetUserPtr(h) ((void*)((u8*)(h) + A3_POSIX_HEADER_SIZE))
+#define a3PosixMappingSize(size) ((((size) + A3_POSIX_HEADER_SIZE) + s_PageSize - 1) & ~(s_PageSize - 1))
+
+#if defined(A3DEBUG) || defined(A3INTERNAL)
+// NOTE(Zero): Updated atomically, worker and background threads allocate too
+static volatile i64 s_TotalHeapAllocated;
+static volatile i64 s_TotalHeapFreed;
+static volatile i64 s_PersistantHeapAllocated;
+static volatile i64 s_PersistantHeapFreed;
+
+#define a3InternalHeapAllocation(newSize, oldSize) \
+if((newSize) > a3MegaBytes(1)) \
+a3LogWarn("Large Heap Allocation of {u} bytes at {s}:{i}", (u32)(newSize), file, line); \
+a3::AtomicAdd(&s_TotalHeapAllocated, (i64)((newSize) - (oldSize)));
+#define a3InternalHeapFree(size) a3::AtomicAdd(&s_TotalHeapFreed, (i64)(size));
+#define a3InternalPersistantHeapAllocation(newSize, oldSize) \
+if((newSize) > a3MegaBytes(1)) \
+a3LogWarn("Large Heap Allocation of {u} bytes at {s}:{i}", (u32)(newSize), file, line); \
+a3::AtomicAdd(&s_PersistantHeapAllocated, (i64)((newSize) - (oldSize)));
+#define a3InternalPersistantHeapFree(size) a3::AtomicAdd(&s_PersistantHeapFreed, (i64)(size));
+#else
+#define a3InternalHeapAllocation(newSize, oldSize)
+#define a3InternalHeapFree(size)
+#define a3InternalPersistantHeapAllocation(newSize, oldSize)
+#define a3InternalPersistantHeapFree(size)
+#endif
+
+// NOTE(Zero):
+// Files are mapped instead of read, pages are loaded on first access
+// Mapping is private so writes to the buffer are not carried to the file
+// Like the pages given by VirtualAlloc on Win32, the rest of the last page is zero
+const a3::file_content a3_platform::LoadFileContent(s8 fileName) const
+{
+	a3::file_content result = {};
+	i32 fd = open(fileName, O_RDONLY);
+	if (fd == -1)
+	{
+		return result;
+	}
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) == -1 || fileStat.st_size <= 0)
+	{
+		close(fd);
+		return result;
+	}
+	void* buffer = mmap(0, (u64)fileStat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	// NOTE(Zero): Mapping stays valid after the file is closed
+	close(fd);
+	if (buffer == MAP_FAILED)
+	{
+		return result;
+	}
+	result.Buffer = buffer;
+	result.Size = (u64)fileStat.st_size;
+	return result;
+}
+
+void a3_platform::FreeFileContent(a3::file_content fileReadInfo) const
+{
+	if (fileReadInfo.Buffer)
+	{
+		munmap(fileReadInfo.Buffer, fileReadInfo.Size);
+	}
+}
+
+static b32 a3_PosixWriteFile(s8 fileName, const a3::file_content& file, i32 flags)
+{
+	i32 fd = open(fileName, O_WRONLY | O_CREAT | flags, 0644);
+	if (fd == -1)
+	{
+		return false;
+	}
+	u8* writingPtr = (u8*)file.Buffer;
+	u64 remaining = file.Size;
+	while (remaining)
+	{
+		ssize_t written = write(fd, writingPtr, remaining);
+		if (written < 0)
+		{
+			if (errno == EINTR) continue;
+			close(fd);
+			return false;
+		}
+		writingPtr += written;
+		remaining -= (u64)written;
+	}
+	close(fd);
+	return true;
+}
+
+b32 a3_platform::WriteFileContent(s8 fileName, const a3::file_content & file) const
+{
+	return a3_PosixWriteFile(fileName, file, O_EXCL);
+}
+
+b32 a3_platform::ReplaceFileContent(s8 fileName, const a3::file_content & file) const
+{
+	return a3_PosixWriteFile(fileName, file, O_TRUNC);
+}
+
+#if defined(A3DEBUG) || defined(A3INTERNAL)
+#define A3_DEFINE_ALLOCATION(name) name(u64 size, s8 file, i32 line)
+#define A3_DEFINE_REALLOCATION(name) name(void* usrPtr, u64 size, s8 file, i32 line)
+#else
+#define A3_DEFINE_ALLOCATION(name) name(u64 size)
+#define A3_DEFINE_REALLOCATION(name) name(void* usrPtr, u64 size)
+#endif
+
+void* a3_platform::A3_DEFINE_ALLOCATION(Malloc) const
+{
+	u64* header = (u64*)malloc(size + A3_POSIX_HEADER_SIZE);
+	if (!header)
+	{
+		a3LogWarn("Nullptr returned by heap allocation");
+		return A3NULL;
+	}
+	*header = size;
+	a3InternalHeapAllocation(size, 0);
+	return a3PosixGetUserPtr(header);
+}
+
+void* a3_platform::A3_DEFINE_ALLOCATION(Calloc) const
+{
+	u64* header = (u64*)calloc(1, size + A3_POSIX_HEADER_SIZE);
+	if (!header)
+	{
+		a3LogWarn("Nullptr returned by heap allocation");
+		return A3NULL;
+	}
+	*header = size;
+	a3InternalHeapAllocation(size, 0);
+	return a3PosixGetUserPtr(header);
+}
+
+void* a3_platform::A3_DEFINE_REALLOCATION(Realloc) const
+{
+	if (usrPtr)
+	{
+		u64 oldSize = *a3PosixGetHeader(usrPtr);
+		// NOTE(Zero): Only read by the heap counters, which are compiled out of release builds
+		(void)oldSize;
+		u64* header = (u64*)realloc(a3PosixGetHeader(usrPtr), size + A3_POSIX_HEADER_SIZE);
+		if (!header) return A3NULL;
+		*header = size;
+		a3InternalHeapAllocation(size, oldSize);
+		return a3PosixGetUserPtr(header);
+	}
+	// NOTE(Zero):
+	// If the usrPtr is null, Malloc is called
+	// Following the Standard Library
+	return a3Malloc(size, void);
+}
+
+void* a3_platform::A3_DEFINE_REALLOCATION(Recalloc) const
+{
+	if (usrPtr)
+	{
+		u64 oldSize = *a3PosixGetHeader(usrPtr);
+		u64* header = (u64*)realloc(a3PosixGetHeader(usrPtr), size + A3_POSIX_HEADER_SIZE);
+		if (!header) return A3NULL;
+		*header = size;
+		a3InternalHeapAllocation(size, oldSize);
+		void* ptr = a3PosixGetUserPtr(header);
+		if (size > oldSize) memset((u8*)ptr + oldSize, 0, size - oldSize);
+		return ptr;
+	}
+	// NOTE(Zero):
+	// If the usrPtr is null, Malloc is called
+	// Following the Standard Library
+	return a3Calloc(size, void);
+}
+
+b32 a3_platform::Free(void* ptr) const
+{
+	if (ptr)
+	{
+		u64* header = a3PosixGetHeader(ptr);
+		a3InternalHeapFree(*header);
+		free(header);
+		return true;
+	}
+	return false;
+}
+
+// NOTE(Zero):
+// Persistent blocks are mapped pages, these are zeroed by the OS
+// Every block takes at least a page so these should be used for few and large resources
+void * a3_platform::A3_DEFINE_ALLOCATION(AllocMemory) const
+{
+	void* mapping = mmap(0, a3PosixMappingSize(size), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (mapping == MAP_FAILED)
+	{
+		a3LogWarn("Nullptr returned by heap allocation");
+		return A3NULL;
+	}
+	u64* header = (u64*)mapping;
+	*header = size;
+	a3InternalPersistantHeapAllocation(size, 0);
+	return a3PosixGetUserPtr(header);
+}
+
+void * a3_platform::A3_DEFINE_REALLOCATION(ResizeMemory) const
+{
+	if (usrPtr)
+	{
+		u64* header = a3PosixGetHeader(usrPtr);
+		u64 oldSize = *header;
+		u64 oldMappingSize = a3PosixMappingSize(oldSize);
+		u64 newMappingSize = a3PosixMappingSize(size);
+		if (oldMappingSize != newMappingSize)
+		{
+#if defined(__linux__)
+			void* mapping = mremap(header, oldMappingSize, newMappingSize, MREMAP_MAYMOVE);
+			if (mapping == MAP_FAILED) return A3NULL;
+#else
+			void* mapping = mmap(0, newMappingSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (mapping == MAP_FAILED) return A3NULL;
+			memcpy(mapping, header, (oldMappingSize < newMappingSize) ? oldMappingSize : newMappingSize);
+			munmap(header, oldMappingSize);
+#endif
+			header = (u64*)mapping;
+		}
+		*header = size;
+		a3InternalPersistantHeapAllocation(size, oldSize);
+		void* ptr = a3PosixGetUserPtr(header);
+		// NOTE(Zero):
+		// Newly mapped pages are already zero, only the part of old pages left over
+		// from an earlier shrink needs to be cleared
+		if (size > oldSize)
+		{
+			u64 oldCapacity = oldMappingSize - A3_POSIX_HEADER_SIZE;
+			u64 clearEnd = (size < oldCapacity) ? size : oldCapacity;
+			if (clearEnd > oldSize) memset((u8*)ptr + oldSize, 0, clearEnd - oldSize);
+		}
+		return ptr;
+	}
+	// NOTE(Zero):
+	// If the usrPtr is null, Malloc is called
+	// Following the Standard Library
+	return a3Allocate(size, void);
+}
+
+b32 a3_platform::Release(void * ptr) const
+{
+	if (ptr)
+	{
+		u64* header = a3PosixGetHeader(ptr);
+		u64 size = *header;
+		a3InternalPersistantHeapFree(size);
+		return munmap(header, a3PosixMappingSize(size)) == 0;
+	}
+	return false;
+}
+
+f64 a3_platform::GetTime() const
+{
+	timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (f64)now.tv_sec + (f64)now.tv_nsec * 1.0e-9;
+}
+
+struct posix_thread
+{
+	pthread_t thread;
+	a3::thread_proc proc;
+	void* userData;
+};
+
+static void* a3_PosixThreadProc(void* param)
+{
+	posix_thread* thread = (posix_thread*)param;
+	return (void*)(uintptr_t)thread->proc(thread->userData);
+}
+
+u32 a3_platform::GetProcessorCount() const
+{
+	i64 count = sysconf(_SC_NPROCESSORS_ONLN);
+	return (count > 0) ? (u32)count : 1;
+}
+
+a3::thread_handle a3_platform::CreateThread(a3::thread_proc proc, void * userData) const
+{
+	posix_thread* thread = a3Malloc(sizeof(posix_thread), posix_thread);
+	thread->proc = proc;
+	thread->userData = userData;
+	if (pthread_create(&thread->thread, 0, a3_PosixThreadProc, thread) != 0)
+	{
+		a3LogError("Thread could not be created!");
+		a3Free(thread);
+		return A3NULL;
+	}
+	return (a3::thread_handle)thread;
+}
+
+void a3_platform::WaitForThread(a3::thread_handle thread) const
+{
+	if (thread)
+	{
+		pthread_join(((posix_thread*)thread)->thread, 0);
+		a3Free(thread);
+	}
+}
+
+void a3_platform::YieldThread() const
+{
+	sched_yield();
+}
+
+a3::semaphore_handle a3_platform::CreateSemaphore(u32 initialCount) const
+{
+	sem_t* semaphore = a3Malloc(sizeof(sem_t), sem_t);
+	if (sem_init(semaphore, 0, initialCount) != 0)
+	{
+		a3LogError("Semaphore could not be created!");
+		a3Free(semaphore);
+		return A3NULL;
+	}
+	return (a3::semaphore_handle)semaphore;
+}
+
+void a3_platform::SignalSemaphore(a3::semaphore_handle semaphore, u32 count) const
+{
+	for (u32 i = 0; i < count; ++i)
+	{
+		sem_post((sem_t*)semaphore);
+	}
+}
+
+void a3_platform::WaitForSemaphore(a3::semaphore_handle semaphore) const
+{
+	// NOTE(Zero): Wait is interrupted by signals, it is restarted
+	while (sem_wait((sem_t*)semaphore) == -1 && errno == EINTR);
+}
+
+void a3_platform::DestroySemaphore(a3::semaphore_handle semaphore) const
+{
+	if (semaphore)
+	{
+		sem_destroy((sem_t*)semaphore);
+		a3Free(semaphore);
+	}
+}
+
+#if defined(A3DEBUG) || defined(A3INTERNAL)
+u64 a3_platform::GetTotalHeapAllocated() const
+{
+	return (u64)a3::AtomicLoad(&s_TotalHeapAllocated);
+}
+u64 a3_platform::GetTotalHeapFreed() const
+{
+	return (u64)a3::AtomicLoad(&s_TotalHeapFreed);
+}
+u64 a3_platform::GetPersistantHeapAllocated() const
+{
+	return (u64)a3::AtomicLoad(&s_PersistantHeapAllocated);
+}
+u64 a3_platform::GetPersistantHeapFreed() const
+{
+	return (u64)a3::AtomicLoad(&s_PersistantHeapFreed);
+}
+#endif
+
+void* operator A3_DEFINE_ALLOCATION(new)
+{
+#if defined(A3DEBUG) || defined(A3INTERNAL)
+	return a3::Platform.Malloc(size, file, line);
+#else
+	return a3::Platform.Malloc(size);
+#endif
+}
+
+void* operator A3_DEFINE_ALLOCATION(new[])
+{
+#if defined(A3DEBUG) || defined(A3INTERNAL)
+	return a3::Platform.Malloc(size, file, line);
+#else
+	return a3::Platform.Malloc(size);
+#endif
+}
+
+void * operator new(u64, void * where)
+{
+	return where;
+}
+
+void * operator new[](u64, void * where)
+{
+	return where;
+}
+
+void operator delete(void* ptr)
+{
+	a3::Platform.Free(ptr);
+}
+
+void operator delete[](void* ptr)
+{
+	a3::Platform.Free(ptr);
+}
+
+// NOTE(Zero): GCC and Clang call the sized versions when the size is known, these must not reach the C heap
+void operator delete(void* ptr, u64)
+{
+	a3::Platform.Free(ptr);
+}
+
+void operator delete[](void* ptr, u64)
+{
+	a3::Platform.Free(ptr);
+}
+
+void operator delete[](void*, void*)
+{
+}
+
+void operator delete(void*, void*)
+{
+}
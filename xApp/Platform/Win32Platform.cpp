@@ -1,5 +1,10 @@
 #include "Common/Core.h"
 #include "Platform.h"
+
+// NOTE(Zero):
+// Headless builds(A3HEADLESS) only use the platform layer from this file,
+// window, OpenGL and the application are left out and `main` is provided by HeadlessMain.cpp
+#ifndef A3HEADLESS
 #include "GL/LoadOpenGL.h"
 
 #include "GL/GLDebug.h"
@@ -10,16 +15,20 @@
 #include "Math/Color.h"
 #include "Utility/UIContext.h"
 #include "Utility/Algorithm.h"
+#include "Utility/JobSystem.h"
 
 #include "Graphics/Rasterizer3D.h"
 #include "Graphics/RayTracer.h"
 #include "HardwarePlatform.h"
+#endif
 
 #include <Windows.h>
+#ifndef A3HEADLESS
 #include <windowsx.h> // for mouse macros
 // for windows dialogue windows/boxes
 #include <objbase.h>
 #include <shobjidl_core.h>
+#endif
 
 #include <stdio.h> // For _snprintf_s
 
@@ -37,6 +46,10 @@
 #undef MessageBox
 #endif
 
+#ifdef CreateSemaphore
+#undef CreateSemaphore
+#endif
+
 //
 // Globals
 //
@@ -47,6 +60,7 @@ namespace a3 {
 static const HANDLE s_GenericHeapHandle = GetProcessHeap();
 static const HANDLE s_PersistentHeapHandle = HeapCreate(0, a3MegaBytes(512), 0);
 
+#ifndef A3HEADLESS
 // TODO(Zero):
 // Make keyboard input system
 // Input system should be moved from platforn layer and needs to be made proper
@@ -61,12 +75,14 @@ win32_user_data* Win32GetUserData()
 	static win32_user_data s_Win32UserData;
 	return &s_Win32UserData;
 }
+#endif
 
 #if defined(A3DEBUG) || defined(A3INTERNAL)
-static u64 s_TotalHeapAllocated;
-static u64 s_TotalHeapFreed;
-static u64 s_PersistantHeapAllocated;
-static u64 s_PersistantHeapFreed;
+// NOTE(Zero): Updated atomically, worker and background threads allocate too
+static volatile i64 s_TotalHeapAllocated;
+static volatile i64 s_TotalHeapFreed;
+static volatile i64 s_PersistantHeapAllocated;
+static volatile i64 s_PersistantHeapFreed;
 #define a3Main() main()
 
 #define a3InternalAllocationSize(x) ((x) + sizeof(u64))
@@ -76,7 +92,7 @@ static u64 s_PersistantHeapFreed;
 if(ptr) { \
     if(size > a3MegaBytes(1)) \
     a3LogWarn("Large Heap Allocation of {u} bytes at {s}:{i}", size, file, line); \
-    s_TotalHeapAllocated += size;\
+    a3::AtomicAdd(&s_TotalHeapAllocated, (i64)size);\
     u64* loc = (u64*)ptr; \
     *loc = size; \
     ptr = ((u8*)loc + sizeof(u64)); \
@@ -87,7 +103,7 @@ a3LogWarn("Nullptr returned by heap allocation");
 if(ptr) { \
     if(size > a3MegaBytes(1)) \
     a3LogWarn("Large Heap Re Allocation of {u} bytes at {s}:{i}", size, file, line); \
-    s_TotalHeapAllocated += (size - *(u64*)ptr);\
+    a3::AtomicAdd(&s_TotalHeapAllocated, (i64)(size - *(u64*)ptr));\
     u64* loc = (u64*)ptr; \
     *loc = size; \
     ptr = ((u8*)loc + sizeof(u64)); \
@@ -95,14 +111,14 @@ if(ptr) { \
 #define a3InternalHeapFree(x) u64 freed = *(u64*)(a3InternalGetActualPtr(ptr)); \
 x;\
 if(result) { \
-    s_TotalHeapFreed += freed; \
+    a3::AtomicAdd(&s_TotalHeapFreed, (i64)freed); \
 }
 
 #define a3InternalPersistantHeapAllocation(x) x;\
 if(ptr) { \
     if(size > a3MegaBytes(1)) \
     a3LogWarn("Large Heap Allocation of {u} bytes at {s}:{i}", size, file, size); \
-    s_PersistantHeapAllocated += size;\
+    a3::AtomicAdd(&s_PersistantHeapAllocated, (i64)size);\
     u64* loc = (u64*)ptr; \
     *loc = size; \
     ptr = ((u8*)loc + sizeof(u64)); \
@@ -113,7 +129,7 @@ a3LogWarn("Nullptr returned by heap allocation");
 if(ptr) { \
     if(size > a3MegaBytes(1)) \
     a3LogWarn("Large Heap Re Allocation of {u} bytes at {s}:{i}", size, file, size); \
-    s_PersistantHeapAllocated += (size - *(u64*)ptr);\
+    a3::AtomicAdd(&s_PersistantHeapAllocated, (i64)(size - *(u64*)ptr));\
     u64* loc = (u64*)ptr; \
     *loc = size; \
     ptr = ((u8*)loc + sizeof(u64)); \
@@ -121,7 +137,7 @@ if(ptr) { \
 #define a3InternalPersistantHeapFree(x) u64 freed = *(u64*)(a3InternalGetActualPtr(ptr)); \
 x;\
 if(result) { \
-    s_PersistantHeapFreed += freed; \
+    a3::AtomicAdd(&s_PersistantHeapFreed, (i64)freed); \
 }
 #else
 #define a3Main() CALLBACK WinMain(HINSTANCE, HINSTANCE, LPSTR, i32)
@@ -325,6 +341,7 @@ b32 a3_platform::Release(void * ptr) const
 	return false;
 }
 
+#ifndef A3HEADLESS
 utf8 * a3_platform::LoadFromDialogue(s8 title, a3::file_type type) const
 {
 	IFileOpenDialog *pOpenDialog = A3NULL;
@@ -494,23 +511,101 @@ a3::message_box_result a3_platform::MessageBox(s8 title, s8 caption, a3::message
 	default: return a3::message_box_result::MessageBoxResultError;
 	}
 }
+#endif
+
+f64 a3_platform::GetTime() const
+{
+	static LARGE_INTEGER s_PerformanceFrequency;
+	if (!s_PerformanceFrequency.QuadPart) QueryPerformanceFrequency(&s_PerformanceFrequency);
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (f64)counter.QuadPart / (f64)s_PerformanceFrequency.QuadPart;
+}
+
+struct win32_thread_start
+{
+	a3::thread_proc proc;
+	void* userData;
+};
+
+static DWORD WINAPI Win32ThreadProc(LPVOID param)
+{
+	win32_thread_start start = *(win32_thread_start*)param;
+	a3Free(param);
+	return (DWORD)start.proc(start.userData);
+}
+
+u32 a3_platform::GetProcessorCount() const
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return (u32)info.dwNumberOfProcessors;
+}
+
+a3::thread_handle a3_platform::CreateThread(a3::thread_proc proc, void * userData) const
+{
+	win32_thread_start* start = a3Malloc(sizeof(win32_thread_start), win32_thread_start);
+	start->proc = proc;
+	start->userData = userData;
+	HANDLE thread = ::CreateThread(0, 0, Win32ThreadProc, start, 0, 0);
+	if (!thread)
+	{
+		a3LogError("Thread could not be created!");
+		a3Free(start);
+	}
+	return (a3::thread_handle)thread;
+}
+
+void a3_platform::WaitForThread(a3::thread_handle thread) const
+{
+	if (thread)
+	{
+		WaitForSingleObject((HANDLE)thread, INFINITE);
+		CloseHandle((HANDLE)thread);
+	}
+}
+
+void a3_platform::YieldThread() const
+{
+	SwitchToThread();
+}
+
+a3::semaphore_handle a3_platform::CreateSemaphore(u32 initialCount) const
+{
+	return (a3::semaphore_handle)CreateSemaphoreA(0, (LONG)initialCount, MAXLONG, 0);
+}
+
+void a3_platform::SignalSemaphore(a3::semaphore_handle semaphore, u32 count) const
+{
+	ReleaseSemaphore((HANDLE)semaphore, (LONG)count, 0);
+}
+
+void a3_platform::WaitForSemaphore(a3::semaphore_handle semaphore) const
+{
+	WaitForSingleObject((HANDLE)semaphore, INFINITE);
+}
+
+void a3_platform::DestroySemaphore(a3::semaphore_handle semaphore) const
+{
+	if (semaphore) CloseHandle((HANDLE)semaphore);
+}
 
 #if defined(A3DEBUG) || defined(A3INTERNAL)
 u64 a3_platform::GetTotalHeapAllocated() const
 {
-	return s_TotalHeapAllocated;
+	return (u64)a3::AtomicLoad(&s_TotalHeapAllocated);
 }
 u64 a3_platform::GetTotalHeapFreed() const
 {
-	return s_TotalHeapFreed;
+	return (u64)a3::AtomicLoad(&s_TotalHeapFreed);
 }
 u64 a3_platform::GetPersistantHeapAllocated() const
 {
-	return s_PersistantHeapAllocated;
+	return (u64)a3::AtomicLoad(&s_PersistantHeapAllocated);
 }
 u64 a3_platform::GetPersistantHeapFreed() const
 {
-	return s_PersistantHeapFreed;
+	return (u64)a3::AtomicLoad(&s_PersistantHeapFreed);
 }
 #endif
 
@@ -560,6 +655,8 @@ void operator delete(void*, void*)
 {
 }
 
+#ifndef A3HEADLESS
+
 // TODO(Zero):
 // Do not force window resolution
 // Make the window size fixed
@@ -919,32 +1016,25 @@ const v3 transform::WorldUp = v3{ 0,1,0 };
 const v3 transform::WorldRight = v3{ 1,0,0 };
 const v3 transform::WorldForward = v3{ 0,0,-1 };
 
-struct percent
-{
-	i32 major;
-	i32 minor;
-};
+// NOTE(Zero): Number of samples per pixel of the progressive ray tracer
+#define A3_RAY_TRACE_PASSES 16
 
 struct thread_shared
 {
 	a3::image* frameBuffer;
 	a3::mesh* meshObj;
-	a3::image* texture;
+	const a3::texture* texture;
 	m4x4 view;
-	percent completePercent;
+	a3::ray_trace_progress progress;
 };
 
-static b32 s_RayThreadRunning;
-static b32 s_ShouldRenderToTexture;
+static volatile i32 s_RayThreadRunning;
 
-DWORD WINAPI RayTracingThreadFunction(LPVOID userPtr)
+u32 RayTracingThreadFunction(void* userPtr)
 {
-	s_RayThreadRunning = true;
 	thread_shared* data = (thread_shared*)userPtr;
-	a3::RayTrace(data->frameBuffer, data->meshObj, data->view, data->texture, &data->completePercent.major, &data->completePercent.minor);
-	s_RayThreadRunning = false;
-	s_ShouldRenderToTexture = true;
-	ExitThread(0);
+	a3::RayTrace(data->frameBuffer, data->meshObj, data->view, data->texture, A3_RAY_TRACE_PASSES, &data->progress);
+	a3::AtomicExchange(&s_RayThreadRunning, false);
 	return 0;
 }
 
@@ -1002,6 +1092,9 @@ i32 a3Main()
 		a3::InitializeGenerator(seeds);
 	}
 
+	// NOTE(Zero): Main thread and ray tracing thread help executing jobs while they wait
+	a3::Jobs.Initialize(a3::Platform.GetProcessorCount() - 1);
+
 	a3::basic2d_renderer renderer = a3::Renderer.Create2DRenderer(a3::shaders::GLBasic2DVertex, a3::shaders::GLBasic2DFragment);
 	renderer.SetRegion(0.0f, 1280.0f, 0.0f, 720.0f);
 
@@ -1017,7 +1110,11 @@ i32 a3Main()
 	a3::FillImageBuffer(&rayTraceBuffer, a3::color::LightYellow);
 	a3::Asset.LoadTexture2DFromPixels(a3::RayTraceBuffer, rayTraceBuffer.Pixels, rayTraceBuffer.Width, rayTraceBuffer.Height, rayTraceBuffer.Channels, a3::FilterLinear, a3::WrapClampToEdge);
 	thread_shared* rayTracingData = a3Allocate(sizeof(thread_shared), thread_shared);
+	a3::thread_handle rayTracingThread = A3NULL;
+	i32 rayTracePassesUploaded = 0;
 	a3::image* loadedTexture = A3NULL;
+	// NOTE(Zero): Mip chain of `loadedTexture` for the software renderers
+	a3::texture loadedMips = {};
 
 	a3::image fontBack = a3::CreateImageBuffer(500, 500);
 	a3::FillImageBuffer(&fontBack, a3::color::Black, 0.5f);
@@ -1059,6 +1156,7 @@ i32 a3Main()
 
 	v3 shadeColor = a3::color::Blurple;
 	b32 showNormals = false;
+	b32 multisample = false;
 	a3::render_type rType = a3::render_type::RenderShade;
 
 	b32 shouldRun = true;
@@ -1121,15 +1219,27 @@ i32 a3Main()
 			camera.RotateOrientation(-angle * deltaTime, transform::WorldRight);
 		}
 
-		if (s_ShouldRenderToTexture)
+		if (rayTracingThread)
 		{
-			s_ShouldRenderToTexture = false;
-			a3::Asset.LoadTexture2DFromPixels(a3::RayTraceBuffer, rayTraceBuffer.Pixels, rayTraceBuffer.Width, rayTraceBuffer.Height, rayTraceBuffer.Channels, a3::FilterLinear, a3::WrapClampToEdge);
+			// NOTE(Zero): Ray traced image is uploaded after every pass and once more when the thread finishes
+			b32 running = a3::AtomicLoad(&s_RayThreadRunning);
+			i32 passes = a3::AtomicLoad(&rayTracingData->progress.PassesCompleted);
+			if (passes != rayTracePassesUploaded || !running)
+			{
+				rayTracePassesUploaded = passes;
+				a3::Asset.LoadTexture2DFromPixels(a3::RayTraceBuffer, rayTraceBuffer.Pixels, rayTraceBuffer.Width, rayTraceBuffer.Height, rayTraceBuffer.Channels, a3::FilterLinear, a3::WrapClampToEdge);
+			}
+			if (!running)
+			{
+				a3::Platform.WaitForThread(rayTracingThread);
+				rayTracingThread = A3NULL;
+			}
 		}
 
 		m4x4 model;
 		swapChain.SetCamera(camera.CalculateModelM4X4());
 		swapChain.SetDrawNormals(showNormals);
+		swapChain.SetMultisample(multisample);
 		swapChain.Clear(a3::color::LightSlateGray);
 		swapChain.Render(model, rType, shadeColor, a3::color::Red);
 
@@ -1197,6 +1307,10 @@ i32 a3Main()
 		{
 			showNormals = !showNormals;
 		}
+		if (uiContext.Checkbox(a3::Hash("msaa"), dim, multisample, "MSAA"))
+		{
+			multisample = !multisample;
+		}
 		uiContext.EndFrame();
 
 		if (rType == a3::RenderShade || rType == a3::RenderShadeWithOutline)
@@ -1245,17 +1359,34 @@ i32 a3Main()
 			loadedTexture = a3::Asset.LoadImageFromFile(a3::LoadedImageForTexture, file);
 			a3::Platform.FreeDialogueData(file);
 			a3::Asset.LoadTexture2DFromPixels(a3::LoadedTexture, loadedTexture->Pixels, loadedTexture->Width, loadedTexture->Height, loadedTexture->Channels, a3::FilterLinear, a3::WrapClampToEdge);
+			if (!rayTracingThread)
+			{
+				a3::FreeTexture(&loadedMips);
+				loadedMips = a3::CreateTexture(loadedTexture);
+			}
 		}
-		if (uiContext.Button(a3::Hash("ray"), opdim, "Ray Trace"))
+		if (uiContext.Button(a3::Hash("ray"), opdim, rayTracingThread ? "Cancel Ray Trace" : "Ray Trace"))
 		{
-			a3::FillImageBuffer(&rayTraceBuffer, a3::color::White);
-
-			rayTracingData->frameBuffer = &rayTraceBuffer;
-			rayTracingData->meshObj = a3::Asset.Get<a3::mesh>(a3::Mesh);
-			rayTracingData->texture = loadedTexture;
-			rayTracingData->view = camera.CalculateModelM4X4() * m4x4::PerspectiveR(a3ToDegrees(60.0f), 4.0f / 3.0f, 0.1f, 1000.0f);
-
-			CreateThread(0, 0, RayTracingThreadFunction, rayTracingData, 0, 0);
+			if (rayTracingThread)
+			{
+				a3::CancelRayTrace(&rayTracingData->progress);
+			}
+			else
+			{
+				a3::FillImageBuffer(&rayTraceBuffer, a3::color::White);
+
+				rayTracingData->frameBuffer = &rayTraceBuffer;
+				rayTracingData->meshObj = a3::Asset.Get<a3::mesh>(a3::Mesh);
+				rayTracingData->texture = loadedMips.Memory ? &loadedMips : A3NULL;
+				// NOTE(Zero): Image plane at z = -1 scaled for 60 degrees field of view, same camera as xRender
+				f32 fovScale = Tanf(a3ToRadians(60.0f) * 0.5f);
+				rayTracingData->view = m4x4::ScaleR(v3{ fovScale, fovScale, -1.0f }) * camera.CalculateModelM4X4();
+				rayTracingData->progress = {};
+
+				rayTracePassesUploaded = 0;
+				s_RayThreadRunning = true;
+				rayTracingThread = a3::Platform.CreateThread(RayTracingThreadFunction, rayTracingData);
+			}
 		}
 
 		if (uiContext.Button(a3::Hash("save"), opdim, "Save Frame"))
@@ -1295,6 +1426,15 @@ i32 a3Main()
 		fontRenderer.Render("Loaded Texture", v2{ 1000.0f, 300.0f }, 20.0f, a3::color::White);
 		fontRenderer.Render("Properties", v2{ 10.0f, 75.0f }, 20.0f, a3::color::White);
 
+		if (rayTracingThread)
+		{
+			i32 major, minor;
+			a3::QueryRayTraceProgress(&rayTracingData->progress, &major, &minor);
+			utf8 buffer[256];
+			_snprintf_s(buffer, 256, 256, "Ray Tracing: %d.%02d%% (%d/%d samples)", major, minor, a3::AtomicLoad(&rayTracingData->progress.PassesCompleted), A3_RAY_TRACE_PASSES);
+			fontRenderer.Render(buffer, v2{ 10.0f, 315.0f }, 20.0f, a3::color::White);
+		}
+
 		if (sceneMesh)
 		{
 			v3 col = a3::color::Black;
@@ -1355,5 +1495,14 @@ i32 a3Main()
 		SwapBuffers(windowDeviceContext);
 	}
 
+	if (rayTracingThread)
+	{
+		a3::CancelRayTrace(&rayTracingData->progress);
+		a3::Platform.WaitForThread(rayTracingThread);
+	}
+	a3::Jobs.Shutdown();
+
 	return 0;
-}
\ No newline at end of file
+}
+
+#endif
@@ -9,6 +9,12 @@ namespace a3 {
     
 	template <typename Type>
         void Swap(Type* a, Type* b);
+
+    // NOTE(Zero):
+    // In place unstable sort, `less(a, b)` should return true if `a` goes before `b`
+    // Quick sort with median of three pivot, small ranges are finished with insertion sort
+    template <typename Type, typename Compare>
+        void Sort(Type* arr, u64 count, Compare less);
     
     // NOTE(Zero):
     // Pseudo Random NUmber Generator uses Well RNG Algorithm
@@ -53,6 +59,56 @@ namespace a3 {
 		*b = temp;
 	}
 
+	template <typename Type, typename Compare>
+	void Sort(Type * arr, u64 count, Compare less)
+	{
+		while (count > 16)
+		{
+			u64 mid = count / 2;
+			if (less(arr[mid], arr[0])) a3::Swap(&arr[mid], &arr[0]);
+			if (less(arr[count - 1], arr[0])) a3::Swap(&arr[count - 1], &arr[0]);
+			if (less(arr[count - 1], arr[mid])) a3::Swap(&arr[count - 1], &arr[mid]);
+			Type pivot = arr[mid];
+
+			u64 i = 0;
+			u64 j = count - 1;
+			for (;;)
+			{
+				while (less(arr[i], pivot)) ++i;
+				while (less(pivot, arr[j])) --j;
+				if (i >= j) break;
+				a3::Swap(&arr[i], &arr[j]);
+				++i; --j;
+			}
+
+			// NOTE(Zero): Recurse on the smaller half so stack depth stays logarithmic
+			u64 split = j + 1;
+			if (split < count - split)
+			{
+				a3::Sort(arr, split, less);
+				arr += split;
+				count -= split;
+			}
+			else
+			{
+				a3::Sort(arr + split, count - split, less);
+				count = split;
+			}
+		}
+
+		for (u64 i = 1; i < count; ++i)
+		{
+			Type e = arr[i];
+			u64 j = i;
+			while (j > 0 && less(e, arr[j - 1]))
+			{
+				arr[j] = arr[j - 1];
+				--j;
+			}
+			arr[j] = e;
+		}
+	}
+
 	template <typename Type>
 	random_generator<Type>::random_generator(const Type& min, const Type& max) :
 		Min(min), Max(max)
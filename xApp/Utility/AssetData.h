@@ -633,6 +633,8 @@ a3::mesh a3::DecodeMeshFromBuffer(void * buffer, u64 length, mesh_info* pms, v3
 			}
 			else if (id == 't')
 			{
+				// NOTE(Zero): Two letter tags are followed by a space before the first value
+				line.MoveForwardPass(' ');
 				f32 u = a3::ParseF32((utf8*)line.GetWorkingBufferPointer());
 				line.MoveForwardPass(' ');
 				f32 v = a3::ParseF32((utf8*)line.GetWorkingBufferPointer());
@@ -641,6 +643,7 @@ a3::mesh a3::DecodeMeshFromBuffer(void * buffer, u64 length, mesh_info* pms, v3
 			}
 			else if (id == 'n')
 			{
+				line.MoveForwardPass(' ');
 				f32 x = a3::ParseF32((utf8*)line.GetWorkingBufferPointer());
 				line.MoveForwardPass(' ');
 				f32 y = a3::ParseF32((utf8*)line.GetWorkingBufferPointer());
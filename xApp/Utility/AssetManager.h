@@ -17,11 +17,14 @@ public:
 	a3::image* LoadImageFromFile(u64 id, s8 file);
 	a3::font* LoadFontFromBuffer(u64 id, void* buffer, u64 length, f32 scale);
 	a3::font* LoadFontFromFile(u64 id, s8 file, f32 scale);
+	// NOTE(Zero): Textures need a GPU, these are not available to headless builds(A3HEADLESS)
+#ifndef A3HEADLESS
 	a3::image_texture* LoadTexture2DFromPixels(u64 id, void* pixels, i32 w, i32 h, i32 channels, a3::filter filter, a3::wrap wrap);
 	a3::image_texture* LoadTexture2DFromBuffer(u64 id, void* buffer, i32 length, a3::filter filter, a3::wrap wrap);
 	a3::image_texture* LoadTexture2DFromFile(u64 id, s8 file, a3::filter filter, a3::wrap wrap);
 	a3::font_texture* LoadFontTextureAtlasFromBuffer(u64 id, void* buffer, i32 length, f32 scale);
 	a3::font_texture* LoadFontTextureAtlasFromFile(u64 id, s8 file, f32 scale);
+#endif
 	a3::mesh* LoadMeshFromBuffer(u64 id, void* buffer, u64 len);
 	a3::mesh* LoadMeshFromFile(u64 id, s8 file);
 
@@ -41,7 +44,9 @@ namespace a3 {
 #ifdef A3_IMPLEMENT_ASSETMANAGER
 
 #include "Platform/Platform.h"
+#ifndef A3HEADLESS
 #include "Platform/HardwarePlatform.h"
+#endif
 
 #define A3_ASSET_NUM_JUMP_ON_FULL 10
 
@@ -108,6 +113,7 @@ a3::font* a3_asset::LoadFontFromFile(u64 id, s8 file, f32 scale)
 	return res;
 }
 
+#ifndef A3HEADLESS
 a3::image_texture* a3_asset::LoadTexture2DFromPixels(u64 id, void * pixels, i32 w, i32 h, i32 channels, a3::filter filter, a3::wrap wrap)
 {
 	if (m_AssetsCount <= id) Resize(id + A3_ASSET_NUM_JUMP_ON_FULL);
@@ -165,6 +171,7 @@ a3::font_texture* a3_asset::LoadFontTextureAtlasFromFile(u64 id, s8 file, f32 sc
 	a3::Platform.FreeFileContent(fc);
 	return res;
 }
+#endif
 
 a3::mesh * a3_asset::LoadMeshFromBuffer(u64 id, void * buffer, u64 len)
 {
@@ -222,7 +229,8 @@ a3::mesh * a3_asset::LoadMeshFromFile(u64 id, s8 file)
 void a3_asset::Free(u64 id)
 {
 	a3Assert(id < m_AssetsCount);
-	a3::Platform.Free(m_Assets[id]);
+	// NOTE(Zero): Assets are persistent allocations, see `Resize` and the loaders
+	a3Release(m_Assets[id]);
 	m_Assets[id] = A3NULL;
 }
 
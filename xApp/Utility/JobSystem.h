@@ -0,0 +1,344 @@
+#pragma once
+#include "Common/Core.h"
+#include "Platform/Platform.h"
+
+//
+// DECLARATIONS
+//
+
+// NOTE(Zero):
+// Each thread owns a queue of jobs, the owner pushes and pops jobs from the back of its queue
+// while idle threads steal jobs from the front of other thread's queues
+// Queue 0 is shared by all the threads that are not part of the job system (like main thread),
+// these threads help executing jobs when they call `Wait`, but only the jobs of the counter they wait on
+// so that a thread (like UI) never ends up running the jobs dispatched by another (like ray tracing)
+#define A3MAXJOBTHREADS 64
+
+namespace a3 {
+
+	// NOTE(Zero):
+	// `jobIndex` is the index of the job in the dispatched batch
+	// `threadIndex` is the queue the job is executing on, it should be passed to
+	// `Push` and `Wait` if the job spawns more jobs
+	typedef void(*job_function)(void* userData, u32 jobIndex, u32 threadIndex);
+
+	// NOTE(Zero): Value reaches 0 when all the jobs attached to the counter are finished
+	struct job_counter
+	{
+		volatile i32 Value;
+	};
+
+	struct job
+	{
+		job_function Function;
+		void* UserData;
+		u32 Index;
+		job_counter* Counter;
+	};
+
+}
+
+struct a3_job_queue
+{
+	a3::job* Jobs;
+	u32 Head;
+	u32 Tail;
+	volatile i32 Lock;
+};
+
+struct a3_job_system
+{
+private:
+	a3_job_queue* m_Queues;
+	a3::thread_handle* m_Threads;
+	a3::semaphore_handle m_Semaphore;
+	u32 m_NumOfWorkers;
+	volatile i32 m_Running;
+
+	b32 PushJob(u32 queue, const a3::job& j);
+	// NOTE(Zero): If `counter` is not null, only a job attached to it is taken
+	b32 PopJob(u32 queue, a3::job* j, const a3::job_counter* counter);
+	b32 StealJob(u32 queue, a3::job* j, const a3::job_counter* counter);
+	b32 RunJob(u32 threadIndex, const a3::job_counter* counter = A3NULL);
+	friend u32 a3_JobWorkerProc(void* userData);
+
+public:
+	// NOTE(Zero): If `numOfWorkers` is 0, jobs are executed on the calling thread
+	void Initialize(u32 numOfWorkers);
+	void Shutdown();
+	// NOTE(Zero): Number of threads that execute jobs, including the waiting thread
+	u32 QueryThreadCount() const;
+
+	// NOTE(Zero):
+	// Queues `count` jobs with indices [0, count) spread over all the queues
+	// `counter` is incremented by `count` and decremented as each job finishes
+	void Dispatch(a3::job_function function, void* userData, u32 count, a3::job_counter* counter, u32 threadIndex = 0);
+	// NOTE(Zero): Queues a single job to the queue of `threadIndex`
+	void Push(a3::job_function function, void* userData, u32 jobIndex, a3::job_counter* counter, u32 threadIndex = 0);
+	// NOTE(Zero): Executes queued jobs until `counter` reaches 0, on queue 0 only the jobs attached to `counter`
+	void Wait(a3::job_counter* counter, u32 threadIndex = 0);
+};
+
+namespace a3 {
+	extern a3_job_system Jobs;
+}
+
+//
+// IMPLEMENTATION
+//
+
+#ifdef A3_IMPLEMENT_JOBSYSTEM
+
+#include <emmintrin.h> // for _mm_pause
+
+// NOTE(Zero): Must be power of 2
+#define A3_JOB_QUEUE_CAPACITY 4096
+
+namespace a3 {
+	a3_job_system Jobs = {};
+}
+
+struct a3_job_worker
+{
+	a3_job_system* System;
+	u32 Index;
+};
+
+static a3_job_worker s_JobWorkers[A3MAXJOBTHREADS];
+
+static inline void a3_LockJobQueue(a3_job_queue* queue)
+{
+	while (a3::AtomicCompareExchange(&queue->Lock, 1, 0) != 0)
+	{
+		_mm_pause();
+	}
+}
+
+static inline void a3_UnlockJobQueue(a3_job_queue* queue)
+{
+	a3::AtomicExchange(&queue->Lock, 0);
+}
+
+static inline void a3_ExecuteJob(const a3::job& j, u32 threadIndex)
+{
+	j.Function(j.UserData, j.Index, threadIndex);
+	if (j.Counter) a3::AtomicDecrement(&j.Counter->Value);
+}
+
+u32 a3_JobWorkerProc(void* userData)
+{
+	a3_job_worker* worker = (a3_job_worker*)userData;
+	a3_job_system* system = worker->System;
+	while (a3::AtomicLoad(&system->m_Running))
+	{
+		if (!system->RunJob(worker->Index))
+		{
+			a3::Platform.WaitForSemaphore(system->m_Semaphore);
+		}
+	}
+	return 0;
+}
+
+b32 a3_job_system::PushJob(u32 queue, const a3::job& j)
+{
+	a3_job_queue* q = m_Queues + queue;
+	b32 pushed = false;
+	a3_LockJobQueue(q);
+	if (q->Tail - q->Head < A3_JOB_QUEUE_CAPACITY)
+	{
+		q->Jobs[q->Tail & (A3_JOB_QUEUE_CAPACITY - 1)] = j;
+		q->Tail++;
+		pushed = true;
+	}
+	a3_UnlockJobQueue(q);
+	return pushed;
+}
+
+b32 a3_job_system::PopJob(u32 queue, a3::job* j, const a3::job_counter* counter)
+{
+	a3_job_queue* q = m_Queues + queue;
+	b32 popped = false;
+	a3_LockJobQueue(q);
+	if (q->Tail != q->Head && (!counter || q->Jobs[(q->Tail - 1) & (A3_JOB_QUEUE_CAPACITY - 1)].Counter == counter))
+	{
+		q->Tail--;
+		*j = q->Jobs[q->Tail & (A3_JOB_QUEUE_CAPACITY - 1)];
+		popped = true;
+	}
+	a3_UnlockJobQueue(q);
+	return popped;
+}
+
+b32 a3_job_system::StealJob(u32 queue, a3::job* j, const a3::job_counter* counter)
+{
+	a3_job_queue* q = m_Queues + queue;
+	// NOTE(Zero): Peek without locking so empty queues don't get contended
+	if (q->Tail == q->Head) return false;
+	b32 stolen = false;
+	a3_LockJobQueue(q);
+	if (q->Tail != q->Head && (!counter || q->Jobs[q->Head & (A3_JOB_QUEUE_CAPACITY - 1)].Counter == counter))
+	{
+		*j = q->Jobs[q->Head & (A3_JOB_QUEUE_CAPACITY - 1)];
+		q->Head++;
+		stolen = true;
+	}
+	a3_UnlockJobQueue(q);
+	return stolen;
+}
+
+b32 a3_job_system::RunJob(u32 threadIndex, const a3::job_counter* counter)
+{
+	a3::job j;
+	if (PopJob(threadIndex, &j, counter))
+	{
+		a3_ExecuteJob(j, threadIndex);
+		return true;
+	}
+	u32 numOfQueues = m_NumOfWorkers + 1;
+	for (u32 i = 1; i < numOfQueues; ++i)
+	{
+		u32 victim = (threadIndex + i) % numOfQueues;
+		if (StealJob(victim, &j, counter))
+		{
+			a3_ExecuteJob(j, threadIndex);
+			return true;
+		}
+	}
+	return false;
+}
+
+void a3_job_system::Initialize(u32 numOfWorkers)
+{
+	if (numOfWorkers > A3MAXJOBTHREADS - 1) numOfWorkers = A3MAXJOBTHREADS - 1;
+	m_NumOfWorkers = numOfWorkers;
+	m_Running = true;
+	if (!numOfWorkers) return;
+
+	u32 numOfQueues = numOfWorkers + 1;
+	m_Queues = a3Allocate(sizeof(a3_job_queue) * numOfQueues, a3_job_queue);
+	for (u32 i = 0; i < numOfQueues; ++i)
+	{
+		m_Queues[i].Jobs = a3Allocate(sizeof(a3::job) * A3_JOB_QUEUE_CAPACITY, a3::job);
+		m_Queues[i].Head = 0;
+		m_Queues[i].Tail = 0;
+		m_Queues[i].Lock = 0;
+	}
+
+	m_Semaphore = a3::Platform.CreateSemaphore(0);
+	m_Threads = a3Allocate(sizeof(a3::thread_handle) * numOfWorkers, a3::thread_handle);
+	for (u32 i = 0; i < numOfWorkers; ++i)
+	{
+		s_JobWorkers[i].System = this;
+		s_JobWorkers[i].Index = i + 1;
+		m_Threads[i] = a3::Platform.CreateThread(a3_JobWorkerProc, &s_JobWorkers[i]);
+	}
+	a3Log("Job system initialized with {u} worker threads", numOfWorkers);
+}
+
+void a3_job_system::Shutdown()
+{
+	a3::AtomicExchange(&m_Running, false);
+	if (!m_NumOfWorkers) return;
+
+	a3::Platform.SignalSemaphore(m_Semaphore, m_NumOfWorkers);
+	for (u32 i = 0; i < m_NumOfWorkers; ++i)
+	{
+		a3::Platform.WaitForThread(m_Threads[i]);
+	}
+	a3::Platform.DestroySemaphore(m_Semaphore);
+	for (u32 i = 0; i < m_NumOfWorkers + 1; ++i)
+	{
+		a3Release(m_Queues[i].Jobs);
+	}
+	a3Release(m_Queues);
+	a3Release(m_Threads);
+	m_NumOfWorkers = 0;
+}
+
+u32 a3_job_system::QueryThreadCount() const
+{
+	return m_NumOfWorkers + 1;
+}
+
+void a3_job_system::Dispatch(a3::job_function function, void * userData, u32 count, a3::job_counter * counter, u32 threadIndex)
+{
+	if (!count) return;
+	if (counter) a3::AtomicAdd(&counter->Value, (i32)count);
+
+	a3::job j;
+	j.Function = function;
+	j.UserData = userData;
+	j.Counter = counter;
+
+	if (!m_NumOfWorkers)
+	{
+		for (u32 i = 0; i < count; ++i)
+		{
+			j.Index = i;
+			a3_ExecuteJob(j, threadIndex);
+		}
+		return;
+	}
+
+	// NOTE(Zero):
+	// Contiguous ranges of jobs are given to each queue, starting with the queue of dispatching thread
+	// Neighbouring jobs (tiles) usually touch neighbouring memory
+	u32 numOfQueues = m_NumOfWorkers + 1;
+	u32 perQueue = (count + numOfQueues - 1) / numOfQueues;
+	b32 signaled = false;
+	for (u32 i = 0; i < count; ++i)
+	{
+		j.Index = i;
+		u32 queue = (threadIndex + i / perQueue) % numOfQueues;
+		while (!PushJob(queue, j))
+		{
+			// NOTE(Zero):
+			// Queue is full, workers are woken up to drain it and this thread helps
+			// until there is room, so the rest of the range is not executed serially here
+			if (!signaled)
+			{
+				a3::Platform.SignalSemaphore(m_Semaphore, m_NumOfWorkers);
+				signaled = true;
+			}
+			if (!RunJob(threadIndex, threadIndex ? A3NULL : counter))
+			{
+				_mm_pause();
+			}
+		}
+	}
+	a3::Platform.SignalSemaphore(m_Semaphore, (count < m_NumOfWorkers) ? count : m_NumOfWorkers);
+}
+
+void a3_job_system::Push(a3::job_function function, void * userData, u32 jobIndex, a3::job_counter * counter, u32 threadIndex)
+{
+	a3::job j;
+	j.Function = function;
+	j.UserData = userData;
+	j.Index = jobIndex;
+	j.Counter = counter;
+	if (counter) a3::AtomicIncrement(&counter->Value);
+
+	if (!m_NumOfWorkers || !PushJob(threadIndex, j))
+	{
+		a3_ExecuteJob(j, threadIndex);
+		return;
+	}
+	a3::Platform.SignalSemaphore(m_Semaphore, 1);
+}
+
+void a3_job_system::Wait(a3::job_counter * counter, u32 threadIndex)
+{
+	// NOTE(Zero):
+	// Workers run any job while waiting, so jobs stuck behind other jobs always get executed,
+	// threads outside the job system only help with their own jobs
+	const a3::job_counter* only = threadIndex ? A3NULL : counter;
+	while (a3::AtomicLoad(&counter->Value) > 0)
+	{
+		if (!m_NumOfWorkers || !RunJob(threadIndex, only))
+		{
+			a3::Platform.YieldThread();
+		}
+	}
+}
+
+#endif
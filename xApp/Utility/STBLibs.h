@@ -46,7 +46,9 @@
 #define STBTT_STATIC
 #include "External/STBTrueType.h"
 
+#if defined(_MSC_VER)
 #define STBI_MSC_SECURE_CRT
+#endif
 #define STB_IMAGE_WRITE_STATIC
 #define STBIW_ASSERT(x)			a3Assert(x)
 #define STBIW_MALLOC(s)			a3Malloc(s, void)
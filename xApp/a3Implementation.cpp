@@ -19,11 +19,19 @@
 #define A3_IMPLEMENT_ASSETDATA
 #include "Utility/AssetData.h"
 
+#define A3_IMPLEMENT_TEXTURE
+#include "Graphics/Texture.h"
+
 #define A3_IMPLEMENT_RASTERIZER2D
 #include "Graphics/Rasterizer2D.h"
 
+#define A3_IMPLEMENT_JOBSYSTEM
+#include "Utility/JobSystem.h"
+
 #define A3_IMPLEMENT_ASSETMANAGER
 #include "Utility/AssetManager.h"
 
+#ifndef A3HEADLESS
 #define A3_IMPLEMENT_RENDERER
 #include "Platform/GlRenderer.h"
+#endif